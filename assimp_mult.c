@@ -1,25 +1,147 @@
 #include <assert.h>
+#include <float.h>
+#include <math.h>
 
 #include <GL4D/gl4duw_SDL2.h>
-#include <SDL_image.h>
 
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "assimp_mult.h"
+#include "mat4.h"
+#include "meshcache.h"
+#include "meshopt.h"
+#include "prof.h"
+#include "shadervar.h"
+#include "simplify.h"
+#include "stats.h"
+#include "texcache.h"
+
+/* the post-processing flags are part of the cache key */
+#define ASSIMP_PPFLAGS (aiProcessPreset_TargetRealtime_MaxQuality | \
+                        aiProcess_CalcTangentSpace |                \
+                        aiProcess_Triangulate |                     \
+                        aiProcess_JoinIdenticalVertices |           \
+                        aiProcess_SortByPType)
+/* 0 keeps the vertex cache order of the baked meshes without the
+ * overdraw sort (bump MC_VERSION when changing it) */
+#define ASSIMP_OVERDRAW 1
+/* levels of detail baked per mesh, the full one included (1 to
+ * MC_MAX_LODS, bump MC_VERSION when changing it or the tables) */
+#define ASSIMP_LODS MC_MAX_LODS
+#if ASSIMP_MAX_LODS != MC_MAX_LODS
+#error "ASSIMP_MAX_LODS and MC_MAX_LODS differ"
+#endif
+
+/*!\brief triangles kept by each level, and its error bound relative
+ * to the diagonal of the mesh */
+static const float _lodRatios[MC_MAX_LODS] = {1.0f, 0.5f, 0.25f, 0.125f};
+static const float _lodErrors[MC_MAX_LODS] = {0.0f, 0.005f, 0.015f, 0.04f};
+/*!\brief a level is only kept if it has at most this fraction of the
+ * triangles of the previous one */
+#define LOD_MIN_REDUCTION 0.85f
+
 static int _size = 0;
 static int _alloc = 0;
 static int _count = 1;
 
+/*!\brief an object compiled at load time into a flat list of draw
+ * records, stored as structure-of-arrays. At level of detail l,
+ * record r draws \a count[MC_MAX_LODS r + l] indices from \a
+ * firstIndex[MC_MAX_LODS r + l] (offset by \a baseVertex) in the
+ * shared buffers with the world matrix \a worlds[matrix[r]]
+ * (row-major, as gl4du expects), material \a material[r] and texture
+ * \a texture[r] (0 if none). Records are in node pre-order, so
+ * consecutive records usually share their matrix. */
+typedef struct drawList_t
+{
+    GLuint n, nbWorlds;
+    GLfloat *worlds;
+    GLuint *matrix;
+    GLint *baseVertex;
+    GLuint *firstIndex;
+    GLsizei *count;
+    GLuint *material;
+    GLuint *texture;
+} drawList_t;
+
 typedef struct objectScene
 {
     uint id;
-    struct aiScene *_scene;
+    meshCache_t _cache;
     struct aiVector3D _scene_min, _scene_max, _scene_center;
-    GLuint *_vaos, *_buffers, *_counts, *_textures, _nbMeshes, _nbTextures;
+    drawList_t _draws;
+    /* per material: texture cache handle (-1 if none) and GL name */
+    int *_texHandles;
+    GLuint *_textures, _nbMeshes, _nbTextures, _materialBase;
 } objectScene_t;
 
+/*!\brief std140 image of the Material uniform block of basic.fs */
+typedef struct materialBlock_t
+{
+    GLfloat diffuse[4], specular[4], ambient[4], emission[4];
+    GLfloat shininess;
+    GLfloat pad[3];
+} materialBlock_t;
+
+/* uniform block binding point of the materials */
+#define MATERIAL_BINDING 0
+
+/* _objects/_count/_size may be grown while loader threads run: any
+ * reservation or publication of a slot holds _lock. */
 static objectScene_t *_objects = NULL;
+static SDL_mutex *_lock = NULL;
+
+/* every object shares one VAO over one interleaved vertex buffer and
+ * one index buffer; both grow by doubling and are append-only. */
+static GLuint _vao = 0, _vbo = 0, _ibo = 0;
+static GLsizeiptr _vboSize = 0, _vboUsed = 0, _iboSize = 0, _iboUsed = 0;
+
+/* the materials of every object are packed once at load time in one
+ * UBO, one block every _uboStride bytes (the offset alignment) */
+static GLuint _ubo = 0;
+static GLsizeiptr _uboSize = 0, _uboUsed = 0, _uboStride = 0;
+
+/* programs whose block binding and sampler are already set */
+static GLuint _programs[SV_VARIANTS];
+static int _nbPrograms = 0;
+
+/* per-instance model-view (locations 4 to 7) and normal (8 to 10)
+ * matrices, column-major, computed in _instanceData */
+#define INSTANCE_FLOATS 25
+static GLuint _instanceVBO = 0;
+static GLfloat *_instanceData = NULL;
+static GLsizei _instanceCapacity = 0;
+
+/* CPU time spent in assimpDrawScene, reported by assimpQuit */
+static double _drawTime = 0.0;
+static unsigned long _drawCalls = 0;
+
+/*!\brief level of detail of the next draws, the projected sizes (in
+ * pixels) below which each level is used, and per level statistics */
+static int _lod = 0;
+static float _lodThresholds[MC_MAX_LODS - 1] = {160.0f, 64.0f, 24.0f};
+static int _nbLodThresholds = MC_MAX_LODS - 1;
+static unsigned long _lodDraws[MC_MAX_LODS];
+static double _lodTriangles[MC_MAX_LODS], _fullTriangles = 0.0;
+
+typedef struct loadJob_t
+{
+    const char *path;
+    objectScene_t obj;
+    int *textures;
+    int status;
+} loadJob_t;
+
+typedef struct asyncLoad_t
+{
+    loadJob_t *jobs;
+    int n, nready, *ready;
+    SDL_atomic_t next;
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+} asyncLoad_t;
 
 
 
@@ -49,163 +171,478 @@ static void realloc_memory(void)
 }
 
 int assimpInit(const char *filename);
+int assimpInitAsync(const char **paths, int n, int *ids);
+int assimpBake(const char *filename);
 void assimpDrawScene(int id);
+void assimpDrawSceneInstanced(int id, const GLfloat *instanceMatrices, int n);
 void freeObj(int id);
 void assimpQuit(void);
-static void get_bounding_box_for_node(const struct aiNode *nd, struct aiVector3D *min, struct aiVector3D *max, struct aiMatrix4x4 *trafo, int id);
-static void get_bounding_box(struct aiVector3D *min, struct aiVector3D *max, int id);
+static void get_bounding_box_for_node(const struct aiScene *sc, const struct aiNode *nd, struct aiVector3D *min, struct aiVector3D *max, struct aiMatrix4x4 *trafo);
+static void get_bounding_box(const struct aiScene *sc, struct aiVector3D *min, struct aiVector3D *max);
 static void color4_to_float4(const struct aiColor4D *c, float f[4]);
 static void set_float4(float f[4], float a, float b, float c, float d);
-static void apply_material(const struct aiMaterial *mtl);
-static void sceneMkVAOs(const struct aiScene *sc, const struct aiNode *nd, GLuint *ivao, int obj_id);
-static void sceneDrawVAOs(const struct aiScene *sc, const struct aiNode *nd, GLuint *ivao, int obj_id);
-static int sceneNbMeshes(const struct aiScene *sc, const struct aiNode *nd, int subtotal);
-static int loadasset(const char *path, int obj_id);
+static void bake_material(const struct aiMaterial *mtl, mcMaterial_t *out);
+static void pack_material(const mcMaterial_t *mtl, materialBlock_t *out);
+static void sceneMkMaterials(int obj_id);
+static void setup_program(GLuint id);
+static void sceneCount(const struct aiScene *sc, const struct aiNode *nd, uint32_t counts[4]);
+static void sceneBake(const struct aiScene *sc, const struct aiNode *nd, meshCache_t *mc, uint32_t cursors[4]);
+static void grow_buffer(GLuint *buffer, GLsizeiptr *size, GLsizeiptr used, GLsizeiptr needed);
+static void sceneMkVAOs(int obj_id);
+static void sceneMkDrawList(int obj_id, const GLfloat *parent, GLuint *inode, GLuint *imesh, GLint baseVertex, GLuint firstIndex);
+static void sceneSortDrawList(drawList_t *dl);
+static void sceneDrawList(int obj_id, const GLfloat *instanceMatrices, GLsizei instances);
+static void optimize_meshes(const char *path, meshCache_t *mc);
+static void build_lods(const char *path, meshCache_t *mc);
+static int importasset(const char *path, meshCache_t *mc);
+static int loadasset(const char *path, objectScene_t *obj);
+static int reserve_slot(void);
+static int load_worker(void *data);
+static int *load_textures(const char *filename, const objectScene_t *obj);
+static void upload_object(int id, const objectScene_t *obj, int *textures);
 
 int assimpInit(const char *filename)
 {
-    if (!_alloc)
-    {
-        alloc_memory();
-    }
-    if (!(_count < _size))
+    objectScene_t obj;
+    int *textures = NULL;
+    int id = reserve_slot();
+    struct aiLogStream stream;
+    stream = aiGetPredefinedLogStream(aiDefaultLogStream_STDOUT, NULL);
+    aiAttachLogStream(&stream);
+    stream = aiGetPredefinedLogStream(aiDefaultLogStream_FILE, "assimp_log.txt");
+    aiAttachLogStream(&stream);
+    memset(&obj, 0, sizeof obj);
+    obj.id = id;
+    if (loadasset(filename, &obj) != 0)
     {
-        realloc_memory();
+        fprintf(stderr, "Erreur lors du chargement du fichier %s\n", filename);
+        exit(3);
     }
+    textures = load_textures(filename, &obj);
+    upload_object(id, &obj, textures);
+    return id;
+}
 
-    _objects[_count].id = _count;
-    int i;
-    GLuint ivao = 0;
+/*!\brief loads \a n models in parallel and stores their ids in \a ids
+ * (in the order of \a paths).
+ *
+ * Worker threads run the cache lookup or Assimp import, the bounding
+ * box, the vertex/index flattening and the texture decoding; every
+ * finished model is queued to the calling thread, which must own the
+ * GL context and only creates the GL objects. Returns once all the
+ * models are uploaded.
+ */
+int assimpInitAsync(const char **paths, int n, int *ids)
+{
+    asyncLoad_t al;
+    SDL_Thread **threads;
+    int i, nthreads, uploaded = 0;
     struct aiLogStream stream;
+    if (n <= 0)
+        return 0;
     stream = aiGetPredefinedLogStream(aiDefaultLogStream_STDOUT, NULL);
     aiAttachLogStream(&stream);
     stream = aiGetPredefinedLogStream(aiDefaultLogStream_FILE, "assimp_log.txt");
     aiAttachLogStream(&stream);
-    if (loadasset(filename, _count) != 0)
+    memset(&al, 0, sizeof al);
+    al.n = n;
+    al.jobs = calloc(n, sizeof *al.jobs);
+    al.ready = malloc(n * sizeof *al.ready);
+    assert(al.jobs && al.ready);
+    for (i = 0; i < n; ++i)
     {
-        fprintf(stderr, "Erreur lors du chargement du fichier %s\n", filename);
-        exit(3);
+        al.jobs[i].path = paths[i];
+        al.jobs[i].obj.id = ids[i] = reserve_slot();
     }
-    /* XXX docs say all polygons are emitted CCW, but tests show that some aren't. */
-    if (getenv("MODEL_IS_BROKEN"))
-        glFrontFace(GL_CW);
+    SDL_AtomicSet(&al.next, 0);
+    al.mutex = SDL_CreateMutex();
+    al.cond = SDL_CreateCond();
+    nthreads = SDL_GetCPUCount();
+    nthreads = aisgl_max(1, aisgl_min(nthreads, n));
+    threads = malloc(nthreads * sizeof *threads);
+    assert(threads);
+    for (i = 0; i < nthreads; ++i)
+        threads[i] = SDL_CreateThread(load_worker, "assimp_loader", &al);
+    /* GL uploads stay on this thread, in completion order */
+    while (uploaded < n)
+    {
+        loadJob_t *job;
+        SDL_LockMutex(al.mutex);
+        while (al.nready == uploaded)
+            SDL_CondWait(al.cond, al.mutex);
+        job = &al.jobs[al.ready[uploaded]];
+        SDL_UnlockMutex(al.mutex);
+        if (job->status != 0)
+        {
+            fprintf(stderr, "Erreur lors du chargement du fichier %s\n", job->path);
+            exit(3);
+        }
+        upload_object(job->obj.id, &job->obj, job->textures);
+        ++uploaded;
+    }
+    for (i = 0; i < nthreads; ++i)
+        SDL_WaitThread(threads[i], NULL);
+    free(threads);
+    SDL_DestroyCond(al.cond);
+    SDL_DestroyMutex(al.mutex);
+    free(al.ready);
+    free(al.jobs);
+    return 0;
+}
 
-    _objects[_count]._textures = malloc((_objects[_count]._nbTextures = _objects[_count]._scene->mNumMaterials) *
-                                         sizeof *_objects[_count]._textures);
-    assert(_objects[_count]._textures);
+/* reserves a slot in the registry; the lock makes it safe to call
+ * while loader threads are running. */
+static int reserve_slot(void)
+{
+    int id;
+    if (!_lock)
+        _lock = SDL_CreateMutex();
+    SDL_LockMutex(_lock);
+    if (!_alloc)
+    {
+        alloc_memory();
+    }
+    if (!(_count < _size))
+    {
+        realloc_memory();
+    }
+    id = _count++;
+    _objects[id].id = id;
+    SDL_UnlockMutex(_lock);
+    return id;
+}
 
-    glGenTextures(_objects[_count]._nbTextures, _objects[_count]._textures);
+static int load_worker(void *data)
+{
+    asyncLoad_t *al = data;
+    int i;
+    profThreadName("assimp_loader");
+    while ((i = SDL_AtomicAdd(&al->next, 1)) < al->n)
+    {
+        loadJob_t *job = &al->jobs[i];
+        if ((job->status = loadasset(job->path, &job->obj)) == 0)
+            job->textures = load_textures(job->path, &job->obj);
+        SDL_LockMutex(al->mutex);
+        al->ready[al->nready++] = i;
+        SDL_CondSignal(al->cond);
+        SDL_UnlockMutex(al->mutex);
+    }
+    return 0;
+}
 
-    for (i = 0; i < _objects[_count]._scene->mNumMaterials; i++)
+/* requests the diffuse texture of every material from the texture
+ * cache, which decodes the images not seen yet; no GL call, so it may
+ * run on a loader thread. */
+static int *load_textures(const char *filename, const objectScene_t *obj)
+{
+    GLuint i, nb = obj->_cache.header->nbMaterials;
+    int *textures = malloc((nb ? nb : 1) * sizeof *textures);
+    assert(textures);
+    for (i = 0; i < nb; i++)
     {
-        const struct aiMaterial *pMaterial = _objects[_count]._scene->mMaterials[i];
-        if (aiGetMaterialTextureCount(pMaterial, aiTextureType_DIFFUSE) > 0)
+        const mcMaterial_t *pMaterial = &obj->_cache.materials[i];
+        textures[i] = -1;
+        if (pMaterial->hasTexture)
         {
-            struct aiString tfname;
-            char *dir = pathOf(filename), buf[BUFSIZ];
-            if (aiGetMaterialTexture(pMaterial, aiTextureType_DIFFUSE, 0, &tfname, NULL, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS)
-            {
-                SDL_Surface *t;
-                snprintf(buf, sizeof buf, "%s/%s", dir, tfname.data);
+            char buf[BUFSIZ];
+            const char *sep = strrchr(filename, '/');
+            int t;
+            /* not pathOf(), which is not reentrant */
+            if (sep)
+                snprintf(buf, sizeof buf, "%.*s/%s", (int)(sep - filename), filename, pMaterial->texture);
+            else
+                snprintf(buf, sizeof buf, "./%s", pMaterial->texture);
 
-                if (!(t = IMG_Load(buf)))
+            if ((t = texCacheRequest(buf)) < 0)
+            {
+                fprintf(stderr, "Probleme de chargement de textures %s\n", buf);
+                fprintf(stderr, "\tNouvel essai avec %s\n", pMaterial->texture);
+                if ((t = texCacheRequest(pMaterial->texture)) < 0)
                 {
-                    fprintf(stderr, "Probleme de chargement de textures %s\n", buf);
-                    fprintf(stderr, "\tNouvel essai avec %s\n", tfname.data);
-                    if (!(t = IMG_Load(tfname.data)))
-                    {
-                        fprintf(stderr, "Probleme de chargement de textures %s\n", tfname.data);
-                        continue;
-                    }
+                    fprintf(stderr, "Probleme de chargement de textures %s\n", pMaterial->texture);
+                    continue;
                 }
-                glBindTexture(GL_TEXTURE_2D, _objects[_count]._textures[i]);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT /* GL_CLAMP_TO_EDGE */);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT /* GL_CLAMP_TO_EDGE */);
-#ifdef __APPLE__
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, t->w, t->h, 0, t->format->BytesPerPixel == 3 ? GL_BGR : GL_BGRA, GL_UNSIGNED_BYTE, t->pixels);
-#else
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, t->w, t->h, 0, t->format->BytesPerPixel == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, t->pixels);
-#endif
-                SDL_FreeSurface(t);
             }
+            textures[i] = t;
         }
     }
+    return textures;
+}
+
+/* publishes \a obj in the registry slot \a id and creates its GL
+ * objects; must run on the GL thread. Keeps \a textures (the cache
+ * handles), released by freeObj. */
+static void upload_object(int id, const objectScene_t *obj, int *textures)
+{
+    objectScene_t *o;
+    GLuint i;
+    SDL_LockMutex(_lock);
+    _objects[id] = *obj;
+    o = &_objects[id];
+    SDL_UnlockMutex(_lock);
+    /* XXX docs say all polygons are emitted CCW, but tests show that some aren't. */
+    if (getenv("MODEL_IS_BROKEN"))
+        glFrontFace(GL_CW);
+
+    o->_texHandles = textures;
+    o->_textures = malloc((o->_nbTextures = o->_cache.header->nbMaterials) * sizeof *o->_textures);
+    assert(o->_textures);
+    /* shared with every other material or object using the same image */
+    for (i = 0; i < o->_nbTextures; i++)
+        o->_textures[i] = texCacheTexture(textures[i]);
+
+    o->_nbMeshes = o->_cache.header->nbMeshes;
+    sceneMkMaterials(id);
+    sceneMkVAOs(id);
+}
+
+/*!\brief imports \a filename with Assimp and writes its binary cache
+ * next to it, without any GL call. Then reports the cold (import and
+ * bake) time against the warm (cache mapping) time.
+ *
+ * \return 0 on success.
+ */
+int assimpBake(const char *filename)
+{
+    meshCache_t mc;
+    char cpath[BUFSIZ];
+    double t0, tcold, twarm;
+    mcPath(filename, cpath, sizeof cpath);
+    t0 = now_ms();
+    if (importasset(filename, &mc) != 0)
+    {
+        fprintf(stderr, "Erreur lors du chargement du fichier %s\n", filename);
+        return 1;
+    }
+    tcold = now_ms() - t0;
+    if (mcWrite(&mc, cpath) != 0)
+    {
+        fprintf(stderr, "Erreur lors de l'ecriture du cache %s\n", cpath);
+        mcFree(&mc);
+        return 1;
+    }
+    mcFree(&mc);
+    t0 = now_ms();
+    if (mcOpen(&mc, cpath, filename, ASSIMP_PPFLAGS) != 0)
+    {
+        fprintf(stderr, "Cache %s illisible\n", cpath);
+        return 1;
+    }
+    twarm = now_ms() - t0;
+    fprintf(stderr, "%s -> %s: %u meshes, %u vertices, %u indices; cold %.2f ms, warm %.2f ms\n",
+            filename, cpath, mc.header->nbMeshes, mc.header->nbVertices, mc.header->nbIndices, tcold, twarm);
+    mcFree(&mc);
+    return 0;
+}
+
+/*!\brief bounding box of object \a id in the space where
+ * assimpDrawScene draws it: the largest side is 1 and the box is
+ * centred on the origin. */
+void assimpGetBoundingBox(int id, float min[3], float max[3])
+{
+    const objectScene_t *o = &_objects[id];
+    GLfloat s = o->_scene_max.x - o->_scene_min.x;
+    s = aisgl_max(o->_scene_max.y - o->_scene_min.y, s);
+    s = aisgl_max(o->_scene_max.z - o->_scene_min.z, s);
+    s = 1.0f / s;
+    min[0] = (o->_scene_min.x - o->_scene_center.x) * s;
+    min[1] = (o->_scene_min.y - o->_scene_center.y) * s;
+    min[2] = (o->_scene_min.z - o->_scene_center.z) * s;
+    max[0] = (o->_scene_max.x - o->_scene_center.x) * s;
+    max[1] = (o->_scene_max.y - o->_scene_center.y) * s;
+    max[2] = (o->_scene_max.z - o->_scene_center.z) * s;
+}
+
+/*!\brief sets the projected sizes, in pixels, below which levels 1,
+ * 2... are drawn (\a n decreasing values, at most ASSIMP_MAX_LODS -
+ * 1; none: always the full meshes). */
+void assimpSetLodThresholds(const float *pixels, int n)
+{
+    _nbLodThresholds = aisgl_min(aisgl_max(n, 0), MC_MAX_LODS - 1);
+    if (_nbLodThresholds)
+        memcpy(_lodThresholds, pixels, _nbLodThresholds * sizeof *_lodThresholds);
+    _lod = aisgl_min(_lod, _nbLodThresholds);
+}
+
+/*!\brief the level of detail of an object whose bounding box spans
+ * \a pixels on screen. */
+int assimpLodLevel(float pixels)
+{
+    int l = 0;
+    while (l < _nbLodThresholds && pixels < _lodThresholds[l])
+        ++l;
+    return l;
+}
 
-    _objects[_count]._nbMeshes = sceneNbMeshes(_objects[_count]._scene, _objects[_count]._scene->mRootNode, 0);
-    _objects[_count]._vaos = malloc(_objects[_count]._nbMeshes * sizeof *_objects[_count]._vaos);
-    assert(_objects[_count]._vaos);
-    glGenVertexArrays(_objects[_count]._nbMeshes, _objects[_count]._vaos);
-    _objects[_count]._buffers = malloc(2 * _objects[_count]._nbMeshes * sizeof *_objects[_count]._buffers);
-    assert(_objects[_count]._buffers);
-    glGenBuffers(2 * _objects[_count]._nbMeshes, _objects[_count]._buffers);
-    _objects[_count]._counts = calloc(_objects[_count]._nbMeshes, sizeof *_objects[_count]._counts);
-    assert(_objects[_count]._counts);
-    sceneMkVAOs(_objects[_count]._scene, _objects[_count]._scene->mRootNode, &ivao, _count);
-    ++_count;
-    return _count - 1;
+/*!\brief sets the level of detail used by the next assimpDrawScene
+ * and assimpDrawSceneInstanced calls (0: full meshes). */
+void assimpSetLod(int level)
+{
+    _lod = aisgl_min(aisgl_max(level, 0), MC_MAX_LODS - 1);
 }
 
 void assimpDrawScene(int id)
 {
     GLfloat tmp;
-    GLuint ivao = 0;
+    double t0 = now_ms();
+    PROF_BEGIN("assimpDrawScene");
+    tmp = _objects[id]._scene_max.x - _objects[id]._scene_min.x;
+    tmp = aisgl_max(_objects[id]._scene_max.y - _objects[id]._scene_min.y, tmp);
+    tmp = aisgl_max(_objects[id]._scene_max.z - _objects[id]._scene_min.z, tmp);
+    tmp = 1.0f / tmp;
+    gl4duScalef(tmp, tmp, tmp);
+    gl4duTranslatef(-_objects[id]._scene_center.x, -_objects[id]._scene_center.y, -_objects[id]._scene_center.z);
+    STATS_CALL(glBindVertexArray(_vao));
+    sceneDrawList(id, NULL, 0);
+    STATS_CALL(glBindVertexArray(0));
+    _drawTime += now_ms() - t0;
+    ++_drawCalls;
+    PROF_END();
+}
+
+/*!\brief draws \a n copies of object \a id with one instanced draw
+ * per mesh.
+ *
+ * \a instanceMatrices holds \a n column-major (OpenGL convention)
+ * 4x4 matrices; each one is applied on top of the current modelMatrix,
+ * i.e. copy i is drawn as if assimpDrawScene had been called with
+ * instanceMatrices[i] multiplied on the left of the model matrix.
+ */
+void assimpDrawSceneInstanced(int id, const GLfloat *instanceMatrices, int n)
+{
+    GLfloat tmp;
+    double t0 = now_ms();
+    int c;
+    if (n <= 0)
+        return;
+    PROF_BEGIN("assimpDrawSceneInstanced");
     tmp = _objects[id]._scene_max.x - _objects[id]._scene_min.x;
     tmp = aisgl_max(_objects[id]._scene_max.y - _objects[id]._scene_min.y, tmp);
     tmp = aisgl_max(_objects[id]._scene_max.z - _objects[id]._scene_min.z, tmp);
     tmp = 1.0f / tmp;
     gl4duScalef(tmp, tmp, tmp);
     gl4duTranslatef(-_objects[id]._scene_center.x, -_objects[id]._scene_center.y, -_objects[id]._scene_center.z);
-    sceneDrawVAOs(_objects[id]._scene, _objects[id]._scene->mRootNode, &ivao, id);
+    if (!_instanceVBO)
+        STATS_CALL(glGenBuffers(1, &_instanceVBO));
+    if (n > _instanceCapacity)
+    {
+        _instanceData = realloc(_instanceData, n * INSTANCE_FLOATS * sizeof *_instanceData);
+        assert(_instanceData);
+        _instanceCapacity = n;
+    }
+    STATS_CALL(glBindVertexArray(_vao));
+    STATS_CALL(glBindBuffer(GL_ARRAY_BUFFER, _instanceVBO));
+    /* the storage itself is specified by sceneDrawList */
+    for (c = 0; c < 7; ++c)
+    {
+        STATS_CALL(glEnableVertexAttribArray(4 + c));
+        STATS_CALL(glVertexAttribPointer(4 + c, c < 4 ? 4 : 3, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS * sizeof(GLfloat),
+                                         (const void *)((c < 4 ? 4 * c : 16 + 3 * (c - 4)) * sizeof(GLfloat))));
+        STATS_CALL(glVertexAttribDivisor(4 + c, 1));
+    }
+    sceneDrawList(id, instanceMatrices, n);
+    STATS_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    for (c = 0; c < 7; ++c)
+        STATS_CALL(glDisableVertexAttribArray(4 + c));
+    STATS_CALL(glBindVertexArray(0));
+    _drawTime += now_ms() - t0;
+    ++_drawCalls;
+    PROF_END();
 }
 
 void freeObj(int id)
 {
-    /* cleanup - calling 'aiReleaseImport' is important, as the library 
-     keeps internal resources until the scene is freed again. Not 
-     doing so can cause severe resource leaking. */
-    aiReleaseImport(_objects[id]._scene);
+    /* the Assimp scene itself is released right after baking; only
+     the cache (mapped or in memory) remains alive with the object. */
+    mcFree(&_objects[id]._cache);
     /* We added a log stream to the library, it's our job to disable it
      again. This will definitely release the last resources allocated
      by Assimp.*/
     aiDetachAllLogStreams();
-    if (_objects[id]._counts)
+    /* the object's ranges in the shared buffers are not reclaimed:
+     they are released all together by assimpQuit. */
+    if (_objects[id]._draws.worlds)
     {
-        free(_objects[id]._counts);
-        _objects[id]._counts = NULL;
+        drawList_t *dl = &_objects[id]._draws;
+        free(dl->worlds);
+        free(dl->matrix);
+        free(dl->baseVertex);
+        free(dl->firstIndex);
+        free(dl->count);
+        free(dl->material);
+        free(dl->texture);
+        memset(dl, 0, sizeof *dl);
     }
     if (_objects[id]._textures)
     {
-        glDeleteTextures(_objects[id]._nbTextures, _objects[id]._textures);
+        for (GLuint i = 0; i < _objects[id]._nbTextures; ++i)
+            texCacheRelease(_objects[id]._texHandles[i]);
+        free(_objects[id]._texHandles);
         free(_objects[id]._textures);
+        _objects[id]._texHandles = NULL;
         _objects[id]._textures = NULL;
     }
-    if (_objects[id]._vaos)
-    {
-        glDeleteVertexArrays(_objects[id]._nbMeshes, _objects[id]._vaos);
-        free(_objects[id]._vaos);
-        _objects[id]._vaos = NULL;
-    }
-    if (_objects[id]._buffers)
-    {
-        glDeleteBuffers(2 * _objects[id]._nbMeshes, _objects[id]._buffers);
-        free(_objects[id]._buffers);
-        _objects[id]._buffers = NULL;
-    }
 }
 
 void assimpQuit(void)
 {
+    if (_drawCalls)
+    {
+        fprintf(stderr, "assimpDrawScene[Instanced]: %lu calls, %.2f us CPU per call\n",
+                _drawCalls, 1000.0 * _drawTime / _drawCalls);
+        double drawn = 0.0;
+        for (int l = 0; l < MC_MAX_LODS; ++l)
+            drawn += _lodTriangles[l];
+        fprintf(stderr, "lod: %.0f triangles drawn instead of %.0f (%.1f%%);", drawn, _fullTriangles,
+                100.0 * drawn / (_fullTriangles > 0.0 ? _fullTriangles : 1.0));
+        for (int l = 0; l < MC_MAX_LODS; ++l)
+            fprintf(stderr, " level %d: %lu draws, %.0f triangles%s", l, _lodDraws[l], _lodTriangles[l],
+                    l + 1 < MC_MAX_LODS ? "," : "\n");
+    }
+    _drawCalls = 0;
+    _drawTime = 0.0;
+    memset(_lodDraws, 0, sizeof _lodDraws);
+    memset(_lodTriangles, 0, sizeof _lodTriangles);
+    _fullTriangles = 0.0;
     for (int iobj = 1; iobj < _count; ++iobj)
     {
         freeObj(iobj);
     }
     free(_objects);
     _objects = NULL;
+    if (_vao)
+    {
+        glDeleteVertexArrays(1, &_vao);
+        glDeleteBuffers(1, &_vbo);
+        glDeleteBuffers(1, &_ibo);
+        _vao = _vbo = _ibo = 0;
+        _vboSize = _vboUsed = _iboSize = _iboUsed = 0;
+    }
+    if (_ubo)
+    {
+        glDeleteBuffers(1, &_ubo);
+        _ubo = 0;
+        _uboSize = _uboUsed = 0;
+    }
+    _nbPrograms = 0;
+    if (_instanceVBO)
+    {
+        glDeleteBuffers(1, &_instanceVBO);
+        _instanceVBO = 0;
+    }
+    free(_instanceData);
+    _instanceData = NULL;
+    _instanceCapacity = 0;
+    _count = 1;
+    _size = 0;
+    if (_lock)
+    {
+        SDL_DestroyMutex(_lock);
+        _lock = NULL;
+    }
 }
 
-static void get_bounding_box_for_node(const struct aiNode *nd, struct aiVector3D *min, struct aiVector3D *max, struct aiMatrix4x4 *trafo, int id)
+static void get_bounding_box_for_node(const struct aiScene *sc, const struct aiNode *nd, struct aiVector3D *min, struct aiVector3D *max, struct aiMatrix4x4 *trafo)
 {
     struct aiMatrix4x4 prev;
     unsigned int n = 0, t;
@@ -213,7 +650,7 @@ static void get_bounding_box_for_node(const struct aiNode *nd, struct aiVector3D
     aiMultiplyMatrix4(trafo, &nd->mTransformation);
     for (; n < nd->mNumMeshes; ++n)
     {
-        const struct aiMesh *mesh = _objects[id]._scene->mMeshes[nd->mMeshes[n]];
+        const struct aiMesh *mesh = sc->mMeshes[nd->mMeshes[n]];
         for (t = 0; t < mesh->mNumVertices; ++t)
         {
             struct aiVector3D tmp = mesh->mVertices[t];
@@ -228,18 +665,20 @@ static void get_bounding_box_for_node(const struct aiNode *nd, struct aiVector3D
     }
     for (n = 0; n < nd->mNumChildren; ++n)
     {
-        get_bounding_box_for_node(nd->mChildren[n], min, max, trafo, id);
+        get_bounding_box_for_node(sc, nd->mChildren[n], min, max, trafo);
     }
     *trafo = prev;
 }
 
-static void get_bounding_box(struct aiVector3D *min, struct aiVector3D *max, int id)
+static void get_bounding_box(const struct aiScene *sc, struct aiVector3D *min, struct aiVector3D *max)
 {
     struct aiMatrix4x4 trafo;
+    PROF_BEGIN("get_bounding_box");
     aiIdentityMatrix4(&trafo);
     min->x = min->y = min->z = 1e10f;
     max->x = max->y = max->z = -1e10f;
-    get_bounding_box_for_node(_objects[id]._scene->mRootNode, min, max, &trafo, id);
+    get_bounding_box_for_node(sc, sc->mRootNode, min, max, &trafo);
+    PROF_END();
 }
 
 static void color4_to_float4(const struct aiColor4D *c, float f[4])
@@ -258,127 +697,184 @@ static void set_float4(float f[4], float a, float b, float c, float d)
     f[3] = d;
 }
 
-static void apply_material(const struct aiMaterial *mtl)
+static void bake_material(const struct aiMaterial *mtl, mcMaterial_t *out)
 {
-    float c[4];
     unsigned int max;
     float shininess, strength;
     struct aiColor4D diffuse, specular, ambient, emission;
-    GLint id;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &id);
+    struct aiString tfname;
 
-    set_float4(c, 0.8f, 0.8f, 0.8f, 1.0f);
+    set_float4(out->diffuse, 0.8f, 0.8f, 0.8f, 1.0f);
     if (AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_DIFFUSE, &diffuse))
     {
-        color4_to_float4(&diffuse, c);
+        color4_to_float4(&diffuse, out->diffuse);
     }
-    glUniform4fv(glGetUniformLocation(id, "diffuse_color"), 1, c);
 
-    set_float4(c, 0.0f, 0.0f, 0.0f, 1.0f);
+    set_float4(out->specular, 0.0f, 0.0f, 0.0f, 1.0f);
     if (AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_SPECULAR, &specular))
     {
-        color4_to_float4(&specular, c);
+        color4_to_float4(&specular, out->specular);
     }
-    glUniform4fv(glGetUniformLocation(id, "specular_color"), 1, c);
 
-    set_float4(c, 0.2f, 0.2f, 0.2f, 1.0f);
+    set_float4(out->ambient, 0.2f, 0.2f, 0.2f, 1.0f);
     if (AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_AMBIENT, &ambient))
     {
-        color4_to_float4(&ambient, c);
+        color4_to_float4(&ambient, out->ambient);
     }
-    glUniform4fv(glGetUniformLocation(id, "ambient_color"), 1, c);
 
-    set_float4(c, 0.0f, 0.0f, 0.0f, 1.0f);
+    set_float4(out->emission, 0.0f, 0.0f, 0.0f, 1.0f);
     if (AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_EMISSIVE, &emission))
     {
-        color4_to_float4(&emission, c);
+        color4_to_float4(&emission, out->emission);
     }
-    glUniform4fv(glGetUniformLocation(id, "emission_color"), 1, c);
 
     max = 1;
     if (aiGetMaterialFloatArray(mtl, AI_MATKEY_SHININESS, &shininess, &max) == AI_SUCCESS)
     {
         max = 1;
         if (aiGetMaterialFloatArray(mtl, AI_MATKEY_SHININESS_STRENGTH, &strength, &max) == AI_SUCCESS)
-            glUniform1f(glGetUniformLocation(id, "shininess"), shininess * strength);
+            out->shininess = shininess * strength;
         else
-            glUniform1f(glGetUniformLocation(id, "shininess"), shininess);
+            out->shininess = shininess;
     }
     else
     {
-        shininess = 0.0;
-        glUniform1f(glGetUniformLocation(id, "shininess"), shininess);
+        out->shininess = 0.0;
+    }
+
+    out->hasTexture = 0;
+    out->texture[0] = '\0';
+    if (aiGetMaterialTextureCount(mtl, aiTextureType_DIFFUSE) > 0 &&
+        aiGetMaterialTexture(mtl, aiTextureType_DIFFUSE, 0, &tfname, NULL, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS)
+    {
+        out->hasTexture = 1;
+        snprintf(out->texture, sizeof out->texture, "%s", tfname.data);
+    }
+}
+
+static void pack_material(const mcMaterial_t *mtl, materialBlock_t *out)
+{
+    memset(out, 0, sizeof *out);
+    memcpy(out->diffuse, mtl->diffuse, sizeof out->diffuse);
+    memcpy(out->specular, mtl->specular, sizeof out->specular);
+    memcpy(out->ambient, mtl->ambient, sizeof out->ambient);
+    memcpy(out->emission, mtl->emission, sizeof out->emission);
+    out->shininess = mtl->shininess;
+}
+
+/* packs the object's materials and appends them to the material UBO */
+static void sceneMkMaterials(int obj_id)
+{
+    objectScene_t *o = &_objects[obj_id];
+    GLuint i, nb = o->_cache.header->nbMaterials;
+    char *blocks;
+    if (!_uboStride)
+    {
+        GLint align = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        _uboStride = ((sizeof(materialBlock_t) + align - 1) / align) * align;
     }
+    o->_materialBase = _uboUsed / _uboStride;
+    if (!nb)
+        return;
+    blocks = calloc(nb, _uboStride);
+    assert(blocks);
+    /* whether a material is textured selects its shader variant
+     * (sceneDrawList), it is not part of the block */
+    for (i = 0; i < nb; ++i)
+        pack_material(&o->_cache.materials[i], (materialBlock_t *)(blocks + i * _uboStride));
+    grow_buffer(&_ubo, &_uboSize, _uboUsed, _uboUsed + nb * _uboStride);
+    glBindBuffer(GL_UNIFORM_BUFFER, _ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, _uboUsed, nb * _uboStride, blocks);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    _uboUsed += nb * _uboStride;
+    free(blocks);
+}
+
+/* the only string lookups of the draw path, done once per program */
+static void setup_program(GLuint id)
+{
+    GLuint block;
+    int i;
+    for (i = 0; i < _nbPrograms; ++i)
+        if (_programs[i] == id)
+            return;
+    if ((block = STATS_CALL(glGetUniformBlockIndex(id, "Material"))) != GL_INVALID_INDEX)
+        STATS_CALL(glUniformBlockBinding(id, block, MATERIAL_BINDING));
+    STATS_CALL(glUniform1i(STATS_CALL(glGetUniformLocation(id, "myTexture")), 0));
+    if (_nbPrograms < (int)(sizeof _programs / sizeof *_programs))
+        _programs[_nbPrograms++] = id;
 }
 
-static void sceneMkVAOs(const struct aiScene *sc, const struct aiNode *nd, GLuint *ivao, int obj_id)
+/* counts nodes, meshes, vertices and (an upper bound of) indices */
+static void sceneCount(const struct aiScene *sc, const struct aiNode *nd, uint32_t counts[4])
 {
-    int i, j, comp;
+    unsigned int n;
+    ++counts[0];
+    counts[1] += nd->mNumMeshes;
+    for (n = 0; n < nd->mNumMeshes; ++n)
+    {
+        const struct aiMesh *mesh = sc->mMeshes[nd->mMeshes[n]];
+        counts[2] += mesh->mNumVertices;
+        counts[3] += mesh->mFaces ? 3 * mesh->mNumFaces : 0;
+    }
+    for (n = 0; n < nd->mNumChildren; ++n)
+        sceneCount(sc, nd->mChildren[n], counts);
+}
+
+/* flattens the scene in pre-order into the cache; cursors are the
+ * next node, mesh, vertex and index to fill. Vertices are
+ * interleaved (position, normal, uv) and missing attributes zeroed. */
+static void sceneBake(const struct aiScene *sc, const struct aiNode *nd, meshCache_t *mc, uint32_t cursors[4])
+{
+    int j;
     unsigned int n = 0;
-    static int temp = 0;
+    mcNode_t *node = &mc->nodes[cursors[0]++];
 
-    temp++;
+    /* By VB Inutile de transposer la matrice, gl4dummies fonctionne avec des transpose de GL. */
+    memcpy(node->transform, &nd->mTransformation, sizeof node->transform);
+    node->nbMeshes = nd->mNumMeshes;
+    node->nbChildren = nd->mNumChildren;
 
     for (; n < nd->mNumMeshes; ++n)
     {
-        GLfloat *vertices = NULL;
-        GLuint *indices = NULL;
         const struct aiMesh *mesh = sc->mMeshes[nd->mMeshes[n]];
-        comp = mesh->mVertices ? 3 : 0;
-        comp += mesh->mNormals ? 3 : 0;
-        comp += mesh->mTextureCoords[0] ? 2 : 0;
-        if (!comp)
-            continue;
-
-        glBindVertexArray(_objects[obj_id]._vaos[*ivao]);
-        glBindBuffer(GL_ARRAY_BUFFER, _objects[obj_id]._buffers[2 * (*ivao)]);
+        mcMesh_t *m = &mc->meshes[cursors[1]++];
+        GLfloat *vertices = &mc->vertices[MC_VERTEX_FLOATS * cursors[2]];
+        GLuint *indices = &mc->indices[cursors[3]];
+        uint32_t i = 0;
 
-        vertices = malloc(comp * mesh->mNumVertices * sizeof *vertices);
-        assert(vertices);
-        i = 0;
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
-        if (mesh->mVertices)
+        m->material = mesh->mMaterialIndex;
+        m->nbVertices = mesh->mNumVertices;
+        m->firstVertex = cursors[2];
+        m->firstIndex = cursors[3];
+        m->attribs = (mesh->mVertices ? MC_POSITIONS : 0) | (mesh->mNormals ? MC_NORMALS : 0) |
+                     (mesh->mTextureCoords[0] ? MC_TEXCOORDS : 0);
+        for (j = 0; j < mesh->mNumVertices; ++j)
         {
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void *)(i * sizeof *vertices));
-            for (j = 0; j < mesh->mNumVertices; ++j)
+            GLfloat *v = &vertices[MC_VERTEX_FLOATS * j];
+            if (mesh->mVertices)
             {
-                vertices[i++] = mesh->mVertices[j].x;
-                vertices[i++] = mesh->mVertices[j].y;
-                vertices[i++] = mesh->mVertices[j].z;
+                v[0] = mesh->mVertices[j].x;
+                v[1] = mesh->mVertices[j].y;
+                v[2] = mesh->mVertices[j].z;
             }
-        }
-        if (mesh->mNormals)
-        {
-            glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const void *)(i * sizeof *vertices));
-            for (j = 0; j < mesh->mNumVertices; ++j)
+            if (mesh->mNormals)
             {
-                vertices[i++] = mesh->mNormals[j].x;
-                vertices[i++] = mesh->mNormals[j].y;
-                vertices[i++] = mesh->mNormals[j].z;
+                v[3] = mesh->mNormals[j].x;
+                v[4] = mesh->mNormals[j].y;
+                v[5] = mesh->mNormals[j].z;
             }
-        }
-        if (mesh->mTextureCoords[0])
-        {
-            glEnableVertexAttribArray(2);
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (const void *)(i * sizeof *vertices));
-            for (j = 0; j < mesh->mNumVertices; ++j)
+            if (mesh->mTextureCoords[0])
             {
-                vertices[i++] = mesh->mTextureCoords[0][j].x;
-                vertices[i++] = mesh->mTextureCoords[0][j].y;
+                v[6] = mesh->mTextureCoords[0][j].x;
+                v[7] = mesh->mTextureCoords[0][j].y;
             }
         }
-        glBufferData(GL_ARRAY_BUFFER, (i * sizeof *vertices), vertices, GL_STATIC_DRAW);
-        free(vertices);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _objects[obj_id]._buffers[2 * (*ivao) + 1]);
+        cursors[2] += mesh->mNumVertices;
         if (mesh->mFaces)
         {
-            indices = malloc(3 * mesh->mNumFaces * sizeof *indices);
-            assert(indices);
-            for (i = 0, j = 0; j < mesh->mNumFaces; ++j)
+            for (j = 0; j < mesh->mNumFaces; ++j)
             {
                 assert(mesh->mFaces[j].mNumIndices < 4);
                 if (mesh->mFaces[j].mNumIndices != 3)
@@ -387,91 +883,442 @@ static void sceneMkVAOs(const struct aiScene *sc, const struct aiNode *nd, GLuin
                 indices[i++] = mesh->mFaces[j].mIndices[1];
                 indices[i++] = mesh->mFaces[j].mIndices[2];
             }
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, i * sizeof *indices, indices, GL_STATIC_DRAW);
-            _objects[obj_id]._counts[*ivao] = i;
-            free(indices);
         }
-        glBindVertexArray(0);
-        (*ivao)++;
+        m->nbIndices = i;
+        cursors[3] += i;
     }
     for (n = 0; n < nd->mNumChildren; ++n)
     {
-        sceneMkVAOs(sc, nd->mChildren[n], ivao, obj_id);
+        sceneBake(sc, nd->mChildren[n], mc, cursors);
     }
 }
 
-static void sceneDrawVAOs(const struct aiScene *sc, const struct aiNode *nd, GLuint *ivao, int obj_id)
+/* (re)allocates \a buffer so that it holds at least \a needed bytes,
+ * keeping its first \a used bytes. */
+static void grow_buffer(GLuint *buffer, GLsizeiptr *size, GLsizeiptr used, GLsizeiptr needed)
 {
-    unsigned int n = 0;
-    struct aiMatrix4x4 m = nd->mTransformation;
-    GLint id;
+    GLuint nb;
+    GLsizeiptr nsize = *size ? *size : needed;
+    if (*buffer && needed <= *size)
+        return;
+    while (nsize < needed)
+        nsize *= 2;
+    glGenBuffers(1, &nb);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, nb);
+    glBufferData(GL_COPY_WRITE_BUFFER, nsize, NULL, GL_STATIC_DRAW);
+    if (*buffer)
+    {
+        if (used)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, *buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glDeleteBuffers(1, buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    *buffer = nb;
+    *size = nsize;
+}
 
-    glGetIntegerv(GL_CURRENT_PROGRAM, &id);
-    /* By VB Inutile de transposer la matrice, gl4dummies fonctionne avec des transpose de GL. */
-    /* aiTransposeMatrix4(&m); */
-    gl4duPushMatrix();
-    gl4duMultMatrixf((GLfloat *)&m);
-    gl4duSendMatrices();
+/* appends the object's vertices and indices to the shared buffers and
+ * records each mesh as a (baseVertex, firstIndex, count) range. */
+static void sceneMkVAOs(int obj_id)
+{
+    const meshCache_t *mc = &_objects[obj_id]._cache;
+    const GLsizei vstride = MC_VERTEX_FLOATS * sizeof(GLfloat);
+    GLsizeiptr vbytes = (GLsizeiptr)mc->header->nbVertices * vstride;
+    GLsizeiptr ibytes = (GLsizeiptr)mc->header->nbIndices * sizeof(GLuint);
+    GLint baseVertex = _vboUsed / vstride;
+    GLuint firstIndex = _iboUsed / sizeof(GLuint), inode = 0, imesh = 0, nb;
+    drawList_t *dl;
 
-    for (; n < nd->mNumMeshes; ++n)
+    PROF_BEGIN("sceneMkVAOs");
+    if (!_vao)
+        glGenVertexArrays(1, &_vao);
+    glBindVertexArray(_vao);
+    if (!_vbo || _vboUsed + vbytes > _vboSize)
     {
-        const struct aiMesh *mesh = sc->mMeshes[nd->mMeshes[n]];
-        if (_objects[obj_id]._counts[*ivao])
+        grow_buffer(&_vbo, &_vboSize, _vboUsed, _vboUsed + vbytes);
+        /* the VAO captured the previous buffer object: re-point it */
+        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vstride, (const void *)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vstride, (const void *)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, vstride, (const void *)(6 * sizeof(GLfloat)));
+    }
+    if (!_ibo || _iboUsed + ibytes > _iboSize)
+    {
+        grow_buffer(&_ibo, &_iboSize, _iboUsed, _iboUsed + ibytes);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
+    }
+    /* an object's meshes are contiguous in its cache: one copy each */
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, _vboUsed, vbytes, mc->vertices);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, _iboUsed, ibytes, mc->indices);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    _vboUsed += vbytes;
+    _iboUsed += ibytes;
+
+    dl = &_objects[obj_id]._draws;
+    memset(dl, 0, sizeof *dl);
+    nb = mc->header->nbMeshes ? mc->header->nbMeshes : 1;
+    dl->worlds = malloc(16 * mc->header->nbNodes * sizeof *dl->worlds);
+    dl->matrix = malloc(nb * sizeof *dl->matrix);
+    dl->baseVertex = malloc(nb * sizeof *dl->baseVertex);
+    dl->firstIndex = malloc(MC_MAX_LODS * nb * sizeof *dl->firstIndex);
+    dl->count = malloc(MC_MAX_LODS * nb * sizeof *dl->count);
+    dl->material = malloc(nb * sizeof *dl->material);
+    dl->texture = malloc(nb * sizeof *dl->texture);
+    assert(dl->worlds && dl->matrix && dl->baseVertex && dl->firstIndex && dl->count && dl->material && dl->texture);
+    sceneMkDrawList(obj_id, NULL, &inode, &imesh, baseVertex, firstIndex);
+    sceneSortDrawList(dl);
+    PROF_END();
+}
+
+/* walks the baked hierarchy once, at load time, to precompute the
+ * world matrix of every node and append one record per drawable mesh. */
+static void sceneMkDrawList(int obj_id, const GLfloat *parent, GLuint *inode, GLuint *imesh, GLint baseVertex, GLuint firstIndex)
+{
+    const meshCache_t *mc = &_objects[obj_id]._cache;
+    drawList_t *dl = &_objects[obj_id]._draws;
+    const mcNode_t *nd = &mc->nodes[(*inode)++];
+    GLuint n, w = dl->nbWorlds++;
+    GLfloat *world = &dl->worlds[16 * w];
+
+    if (parent)
+        mat4Mul(world, parent, nd->transform);
+    else
+        memcpy(world, nd->transform, 16 * sizeof *world);
+    for (n = 0; n < nd->nbMeshes; ++n)
+    {
+        const mcMesh_t *mesh = &mc->meshes[(*imesh)++];
+        GLuint r = dl->n, l;
+        if (!(mesh->attribs & MC_POSITIONS) || !mesh->nbIndices)
+            continue;
+        dl->matrix[r] = w;
+        dl->baseVertex[r] = baseVertex + mesh->firstVertex;
+        /* the levels a mesh lacks repeat its coarsest one */
+        for (l = 0; l < MC_MAX_LODS; ++l)
+        {
+            GLuint ml = mesh->nbLods ? aisgl_min(l, mesh->nbLods - 1) : 0;
+            dl->firstIndex[MC_MAX_LODS * r + l] = firstIndex + (ml ? mesh->lodFirst[ml] : mesh->firstIndex);
+            dl->count[MC_MAX_LODS * r + l] = ml ? mesh->lodCount[ml] : mesh->nbIndices;
+        }
+        dl->material[r] = mesh->material;
+        dl->texture[r] = mc->materials[mesh->material].hasTexture ? _objects[obj_id]._textures[mesh->material] : 0;
+        ++dl->n;
+    }
+    for (n = 0; n < nd->nbChildren; ++n)
+    {
+        sceneMkDrawList(obj_id, world, inode, imesh, baseVertex, firstIndex);
+    }
+}
+
+/* reorders the n elements of size bytes of a as order says */
+static void permute(void *a, size_t size, const GLuint *order, GLuint n, char *tmp)
+{
+    GLuint r;
+    for (r = 0; r < n; ++r)
+        memcpy(tmp + r * size, (char *)a + order[r] * size, size);
+    memcpy(a, tmp, n * size);
+}
+
+/* groups the records by shader variant, untextured ones first, so that
+ * drawing the list switches programs at most once; the records of a
+ * group keep their order, thus their matrix and material runs. */
+static void sceneSortDrawList(drawList_t *dl)
+{
+    GLuint *order = malloc((dl->n ? dl->n : 1) * sizeof *order), r, k = 0, t;
+    char *tmp = malloc((dl->n ? dl->n : 1) * MC_MAX_LODS * sizeof(GLuint));
+    assert(order && tmp);
+    for (t = 0; t < 2; ++t)
+        for (r = 0; r < dl->n; ++r)
+            if (!dl->texture[r] == !t)
+                order[k++] = r;
+    permute(dl->matrix, sizeof *dl->matrix, order, dl->n, tmp);
+    permute(dl->baseVertex, sizeof *dl->baseVertex, order, dl->n, tmp);
+    permute(dl->firstIndex, MC_MAX_LODS * sizeof *dl->firstIndex, order, dl->n, tmp);
+    permute(dl->count, MC_MAX_LODS * sizeof *dl->count, order, dl->n, tmp);
+    permute(dl->material, sizeof *dl->material, order, dl->n, tmp);
+    permute(dl->texture, sizeof *dl->texture, order, dl->n, tmp);
+    free(order);
+    free(tmp);
+}
+
+/* fills _instanceData, then the bound instance buffer, with the
+ * model-view and normal matrices of the \a n copies of a node whose
+ * model matrix is \a model: view . instance . model for each. */
+static void instance_matrices(const GLfloat *view, const GLfloat *model, const GLfloat *instanceMatrices, GLsizei n)
+{
+    GLfloat mv[16], nm[9];
+    GLsizei i;
+    for (i = 0; i < n; ++i)
+    {
+        GLfloat *out = &_instanceData[INSTANCE_FLOATS * i];
+        mat4Transpose(mv, &instanceMatrices[16 * i]);
+        mat4Mul(mv, mv, model);
+        mat4Mul(mv, view, mv);
+        mat4Transpose(out, mv);
+        mat4NormalMatrix(nm, mv);
+        /* mat3 attribute: column-major as well */
+        out[16] = nm[0], out[17] = nm[3], out[18] = nm[6];
+        out[19] = nm[1], out[20] = nm[4], out[21] = nm[7];
+        out[22] = nm[2], out[23] = nm[5], out[24] = nm[8];
+    }
+    /* re-specified each time: the driver orphans the previous storage */
+    STATS_CALL(glBufferData(GL_ARRAY_BUFFER, n * INSTANCE_FLOATS * sizeof *_instanceData, _instanceData, GL_STREAM_DRAW));
+}
+
+/* draws the precompiled records of an object: a linear loop, the
+ * program (shader variant), matrices, material block and texture are
+ * only re-bound when they change from one record to the next. The
+ * matrices are computed here, once per record (or per record and copy,
+ * in the bound instance buffer, when \a instances), not per vertex. */
+static void sceneDrawList(int obj_id, const GLfloat *instanceMatrices, GLsizei instances)
+{
+    const drawList_t *dl = &_objects[obj_id]._draws;
+    GLuint r, current = (GLuint)-1, material = (GLuint)-1, texture = 0;
+    GLfloat model[16], view[16], world[16];
+    GLuint id = 0;
+    int variant = -1, instanced = instances ? SV_INSTANCED : 0;
+
+    if (instances)
+        mat4Current(model, view, NULL, "modelMatrix");
+    ++_lodDraws[_lod];
+    for (r = 0; r < dl->n; ++r)
+    {
+        GLuint lr = MC_MAX_LODS * r + _lod;
+        if ((int)(SV_COMPLEX | instanced | (dl->texture[r] ? SV_TEXTURE : 0)) != variant)
+        {
+            /* the uniforms below belong to the program */
+            variant = SV_COMPLEX | instanced | (dl->texture[r] ? SV_TEXTURE : 0);
+            id = shaderVarUse(variant);
+            setup_program(id);
+            if (instances)
+            {
+                /* the projection matrix, read by the instanced shader */
+                mat4SendMatrices(id, "modelMatrix");
+            }
+            else
+                current = (GLuint)-1;
+        }
+        if (dl->matrix[r] != current)
         {
-            glBindVertexArray(_objects[obj_id]._vaos[*ivao]);
-            apply_material(sc->mMaterials[mesh->mMaterialIndex]);
-            if (aiGetMaterialTextureCount(sc->mMaterials[mesh->mMaterialIndex], aiTextureType_DIFFUSE) > 0)
+            current = dl->matrix[r];
+            if (instances)
             {
-                glBindTexture(GL_TEXTURE_2D, _objects[obj_id]._textures[mesh->mMaterialIndex]);
-                glUniform1i(glGetUniformLocation(id, "hasTexture"), 1);
-                glUniform1i(glGetUniformLocation(id, "myTexture"), 0);
+                mat4Mul(world, model, &dl->worlds[16 * current]);
+                instance_matrices(view, world, instanceMatrices, instances);
             }
             else
             {
-                glUniform1i(glGetUniformLocation(id, "hasTexture"), 0);
+                gl4duPushMatrix();
+                gl4duMultMatrixf(&dl->worlds[16 * current]);
+                mat4SendMatrices(id, "modelMatrix");
+                gl4duPopMatrix();
             }
-            glDrawElements(GL_TRIANGLES, _objects[obj_id]._counts[*ivao], GL_UNSIGNED_INT, 0);
-            glBindVertexArray(0);
-            glBindTexture(GL_TEXTURE_2D, 0);
         }
-        (*ivao)++;
+        if (dl->material[r] != material)
+        {
+            material = dl->material[r];
+            STATS_CALL(glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BINDING, _ubo,
+                                         (_objects[obj_id]._materialBase + material) * _uboStride, sizeof(materialBlock_t)));
+        }
+        if (dl->texture[r] && dl->texture[r] != texture)
+        {
+            texture = dl->texture[r];
+            STATS_CALL(glBindTexture(GL_TEXTURE_2D, texture));
+        }
+        if (instances)
+        {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, dl->count[lr], GL_UNSIGNED_INT,
+                                              (const void *)(dl->firstIndex[lr] * sizeof(GLuint)), instances, dl->baseVertex[r]);
+            STATS_DRAW(instances * (dl->count[lr] / 3));
+        }
+        else
+        {
+            glDrawElementsBaseVertex(GL_TRIANGLES, dl->count[lr], GL_UNSIGNED_INT,
+                                     (const void *)(dl->firstIndex[lr] * sizeof(GLuint)), dl->baseVertex[r]);
+            STATS_DRAW(dl->count[lr] / 3);
+        }
+        _lodTriangles[_lod] += (instances ? instances : 1) * (dl->count[lr] / 3);
+        _fullTriangles += (instances ? instances : 1) * (dl->count[MC_MAX_LODS * r] / 3);
     }
-    for (n = 0; n < nd->mNumChildren; ++n)
+    if (texture)
+        STATS_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+/* reorders the triangles and vertices of each baked mesh for the
+ * vertex cache, the vertex fetch and (ASSIMP_OVERDRAW) overdraw, and
+ * reports the simulated cache efficiency before and after. */
+static void optimize_meshes(const char *path, meshCache_t *mc)
+{
+    uint32_t i;
+    for (i = 0; i < mc->header->nbMeshes; ++i)
     {
-        sceneDrawVAOs(sc, nd->mChildren[n], ivao, obj_id);
+        const mcMesh_t *m = &mc->meshes[i];
+        GLfloat *vertices = &mc->vertices[MC_VERTEX_FLOATS * m->firstVertex];
+        GLuint *indices = &mc->indices[m->firstIndex];
+        meshOptStats_t before, after;
+        int clusters = 0;
+        if (!m->nbIndices)
+            continue;
+        before = meshOptAnalyze(indices, m->nbIndices, m->nbVertices, MO_CACHE_SIZE);
+        if (meshOptVertexCache(indices, m->nbIndices, m->nbVertices) != 0 ||
+            (ASSIMP_OVERDRAW && (clusters = meshOptOverdraw(indices, m->nbIndices, vertices, MC_VERTEX_FLOATS, m->nbVertices)) < 0) ||
+            meshOptVertexFetch(vertices, MC_VERTEX_FLOATS, indices, m->nbIndices, m->nbVertices) != 0)
+        {
+            fprintf(stderr, "Erreur lors de l'optimisation du maillage %u de %s\n", i, path);
+            continue;
+        }
+        after = meshOptAnalyze(indices, m->nbIndices, m->nbVertices, MO_CACHE_SIZE);
+        fprintf(stderr, "meshopt: %s mesh %u: %u triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %d clusters\n",
+                path, i, m->nbIndices / 3, before.acmr, after.acmr, before.atvr, after.atvr, clusters);
     }
-    gl4duPopMatrix();
 }
 
-static int sceneNbMeshes(const struct aiScene *sc, const struct aiNode *nd, int subtotal)
+/* appends ASSIMP_LODS - 1 simplified index lists per mesh after the
+ * full ones, each ordered for the vertex cache, and trims the index
+ * block; a level stops the chain when it is not much smaller than the
+ * previous one (the error bound was reached first). */
+static void build_lods(const char *path, meshCache_t *mc)
 {
-    int n = 0;
-    subtotal += nd->mNumMeshes;
-    for (n = 0; n < nd->mNumChildren; ++n)
-        subtotal += sceneNbMeshes(sc, nd->mChildren[n], 0);
-    return subtotal;
+    uint32_t i, l, next = mc->header->nbIndices;
+    GLuint *out = NULL, *grown;
+    /* the full meshes are level 0, all that is left of a mesh whose
+     * levels could not be built */
+    for (i = 0; i < mc->header->nbMeshes; ++i)
+    {
+        mcMesh_t *m = &mc->meshes[i];
+        m->nbLods = 1;
+        m->lodFirst[0] = m->firstIndex;
+        m->lodCount[0] = m->nbIndices;
+        m->lodError[0] = 0.0f;
+    }
+    for (i = 0; i < mc->header->nbMeshes; ++i)
+    {
+        mcMesh_t *m = &mc->meshes[i];
+        const GLfloat *vertices = &mc->vertices[MC_VERTEX_FLOATS * m->firstVertex];
+        GLfloat min[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX}, diagonal;
+        char levels[BUFSIZ];
+        int len;
+        if (!m->nbIndices || ASSIMP_LODS < 2)
+            continue;
+        if (!(grown = realloc(out, m->nbIndices * sizeof *out)))
+        {
+            fprintf(stderr, "Erreur lors de la simplification du maillage %u de %s\n", i, path);
+            break;
+        }
+        out = grown;
+        for (l = 0; l < m->nbVertices; ++l)
+            for (int k = 0; k < 3; ++k)
+            {
+                min[k] = aisgl_min(min[k], vertices[MC_VERTEX_FLOATS * l + k]);
+                max[k] = aisgl_max(max[k], vertices[MC_VERTEX_FLOATS * l + k]);
+            }
+        diagonal = sqrtf((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1]) +
+                         (max[2] - min[2]) * (max[2] - min[2]));
+        len = snprintf(levels, sizeof levels, "%u", m->nbIndices / 3);
+        for (l = 1; l < ASSIMP_LODS; ++l)
+        {
+            uint32_t n = simplifyMesh(out, &mc->indices[m->firstIndex], m->nbIndices, vertices, MC_VERTEX_FLOATS,
+                                      m->nbVertices, (uint32_t)(_lodRatios[l] * m->nbIndices) / 3 * 3,
+                                      _lodErrors[l] * diagonal, &m->lodError[l]);
+            if (n > LOD_MIN_REDUCTION * m->lodCount[l - 1])
+                break;
+            meshOptVertexCache(out, n, m->nbVertices);
+            memcpy(&mc->indices[next], out, n * sizeof *out);
+            m->lodFirst[l] = next;
+            m->lodCount[l] = n;
+            ++m->nbLods;
+            next += n;
+            len += snprintf(levels + len, sizeof levels - len, " / %u (%.2g%%)", n / 3, 100.0f * m->lodError[l] / diagonal);
+        }
+        fprintf(stderr, "lod: %s mesh %u: %s triangles\n", path, i, levels);
+    }
+    free(out);
+    mcTrimIndices(mc, next);
 }
 
-static int loadasset(const char *path, int obj_id)
+/* runs Assimp on \a path and bakes the result into \a mc; the Assimp
+ * scene does not outlive this function. */
+static int importasset(const char *path, meshCache_t *mc)
 {
+    const struct aiScene *sc;
+    struct aiVector3D min, max;
+    uint32_t counts[4] = {0, 0, 0, 0}, cursors[4] = {0, 0, 0, 0};
+    unsigned int i;
     /* we are taking one of the postprocessing presets to avoid
      spelling out 20+ single postprocessing flags here. */
     /* struct aiString str; */
     /* aiGetExtensionList(&str); */
     /* fprintf(stderr, "EXT %s\n", str.data); */
-    _objects[obj_id]._scene = aiImportFile(path,
-                          aiProcessPreset_TargetRealtime_MaxQuality |
-                              aiProcess_CalcTangentSpace |
-                              aiProcess_Triangulate |
-                              aiProcess_JoinIdenticalVertices |
-                              aiProcess_SortByPType);
-    if (_objects[obj_id]._scene)
-    {
-        get_bounding_box(&_objects[obj_id]._scene_min, &_objects[obj_id]._scene_max, obj_id);
-        _objects[obj_id]._scene_center.x = (_objects[obj_id]._scene_min.x + _objects[obj_id]._scene_max.x) / 2.0f;
-        _objects[obj_id]._scene_center.y = (_objects[obj_id]._scene_min.y + _objects[obj_id]._scene_max.y) / 2.0f;
-        _objects[obj_id]._scene_center.z = (_objects[obj_id]._scene_min.z + _objects[obj_id]._scene_max.z) / 2.0f;
-        return 0;
+    if (!(sc = aiImportFile(path, ASSIMP_PPFLAGS)))
+        return 1;
+    sceneCount(sc, sc->mRootNode, counts);
+    /* room for the levels of detail, each smaller than the full
+     * meshes; build_lods trims what is left */
+    if (mcCreate(mc, counts[0], counts[1], sc->mNumMaterials, counts[2], ASSIMP_LODS * counts[3]) != 0 ||
+        mcStamp(mc, path, ASSIMP_PPFLAGS) != 0)
+    {
+        mcFree(mc);
+        aiReleaseImport(sc);
+        return 1;
+    }
+    get_bounding_box(sc, &min, &max);
+    mc->header->min[0] = min.x;
+    mc->header->min[1] = min.y;
+    mc->header->min[2] = min.z;
+    mc->header->max[0] = max.x;
+    mc->header->max[1] = max.y;
+    mc->header->max[2] = max.z;
+    mc->header->center[0] = (min.x + max.x) / 2.0f;
+    mc->header->center[1] = (min.y + max.y) / 2.0f;
+    mc->header->center[2] = (min.z + max.z) / 2.0f;
+    for (i = 0; i < sc->mNumMaterials; ++i)
+        bake_material(sc->mMaterials[i], &mc->materials[i]);
+    sceneBake(sc, sc->mRootNode, mc, cursors);
+    mc->header->nbIndices = cursors[3];
+    optimize_meshes(path, mc);
+    build_lods(path, mc);
+    /* cleanup - calling 'aiReleaseImport' is important, as the library
+     keeps internal resources until the scene is freed again. Not
+     doing so can cause severe resource leaking. */
+    aiReleaseImport(sc);
+    return 0;
+}
+
+static int loadasset(const char *path, objectScene_t *obj)
+{
+    char cpath[BUFSIZ];
+    double t0 = now_ms();
+    int warm;
+    PROF_BEGIN("loadasset");
+    mcPath(path, cpath, sizeof cpath);
+    if (!(warm = (mcOpen(&obj->_cache, cpath, path, ASSIMP_PPFLAGS) == 0)))
+    {
+        if (importasset(path, &obj->_cache) != 0)
+        {
+            PROF_END();
+            return 1;
+        }
+        if (mcWrite(&obj->_cache, cpath) != 0)
+            fprintf(stderr, "Impossible d'ecrire le cache %s\n", cpath);
     }
-    return 1;
+    obj->_scene_min.x = obj->_cache.header->min[0];
+    obj->_scene_min.y = obj->_cache.header->min[1];
+    obj->_scene_min.z = obj->_cache.header->min[2];
+    obj->_scene_max.x = obj->_cache.header->max[0];
+    obj->_scene_max.y = obj->_cache.header->max[1];
+    obj->_scene_max.z = obj->_cache.header->max[2];
+    obj->_scene_center.x = obj->_cache.header->center[0];
+    obj->_scene_center.y = obj->_cache.header->center[1];
+    obj->_scene_center.z = obj->_cache.header->center[2];
+    fprintf(stderr, "%s: %s load in %.2f ms\n", path, warm ? "warm (cache)" : "cold (assimp)", now_ms() - t0);
+    PROF_END();
+    return 0;
 }
@@ -13,8 +13,18 @@
 extern "C" {
 #endif
 
+/*!\brief levels of detail of a model, the full one included */
+#define ASSIMP_MAX_LODS 4
+
   extern int assimpInit(const char *filename);
+  extern int assimpInitAsync(const char **paths, int n, int *ids);
+  extern int assimpBake(const char *filename);
   extern void assimpDrawScene(int id);
+  extern void assimpDrawSceneInstanced(int id, const float *instanceMatrices, int n);
+  extern void assimpGetBoundingBox(int id, float min[3], float max[3]);
+  extern void assimpSetLodThresholds(const float *pixels, int n);
+  extern int  assimpLodLevel(float pixels);
+  extern void assimpSetLod(int level);
   extern void assimpQuit(void);
   
 #ifdef __cplusplus
@@ -0,0 +1,305 @@
+/*!\file bench.c
+ *
+ * \brief headless benchmark (see bench.h).
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL4D/gl4du.h>
+
+#include "bench.h"
+
+#if defined(__APPLE__)
+
+int benchContextInit(int w, int h)
+{
+    fprintf(stderr, "Erreur : pas de contexte OpenGL sans fenetre (EGL) sous macOS\n");
+    return -1;
+}
+
+void benchContextFree(void)
+{
+}
+
+#else
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+static EGLDisplay _dpy = EGL_NO_DISPLAY;
+static EGLContext _ctx = EGL_NO_CONTEXT;
+static EGLSurface _surface = EGL_NO_SURFACE;
+/*!\brief the framebuffer object drawn into and its colour and depth
+ * renderbuffers */
+static GLuint _fbo = 0, _rbo[2] = {0};
+
+/*!\brief the Mesa surfaceless platform (no X11 nor Wayland server
+ * needed) when the client library has it, the default display
+ * otherwise. */
+static EGLDisplay openDisplay(void)
+{
+    const char *ext = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (ext && strstr(ext, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+        {
+            EGLDisplay dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            if (dpy != EGL_NO_DISPLAY)
+                return dpy;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+/*!\brief creates an OpenGL 3.3 core context without any window and
+ * binds a \a w x \a h framebuffer object (RGBA8, depth 24 and
+ * stencil 8) that stays bound: the program draws into it as into the
+ * window. Returns 0, or -1 with a message on stderr. */
+int benchContextInit(int w, int h)
+{
+    const EGLint cfgAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    const EGLint ctxAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                 EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+    const EGLint pbAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    EGLConfig cfg = EGL_NO_CONFIG_KHR;
+    EGLint major, minor, n = 0;
+    if ((_dpy = openDisplay()) == EGL_NO_DISPLAY || !eglInitialize(_dpy, &major, &minor))
+    {
+        fprintf(stderr, "Erreur lors de l'initialisation d'EGL (0x%x)\n", eglGetError());
+        return -1;
+    }
+    /* the surfaceless platform may have no config at all: contexts
+     * are then created without any (EGL_KHR_no_config_context) */
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(_dpy, cfgAttribs, &cfg, 1, &n) || !n)
+        cfg = EGL_NO_CONFIG_KHR;
+    if ((_ctx = eglCreateContext(_dpy, cfg, EGL_NO_CONTEXT, ctxAttribs)) == EGL_NO_CONTEXT)
+    {
+        fprintf(stderr, "Erreur lors de la creation du contexte OpenGL 3.3 (0x%x)\n", eglGetError());
+        benchContextFree();
+        return -1;
+    }
+    /* without EGL_KHR_surfaceless_context, a 1x1 pbuffer is current */
+    if (!eglMakeCurrent(_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, _ctx) &&
+        (!n || (_surface = eglCreatePbufferSurface(_dpy, cfg, pbAttribs)) == EGL_NO_SURFACE ||
+         !eglMakeCurrent(_dpy, _surface, _surface, _ctx)))
+    {
+        fprintf(stderr, "Erreur lors de l'activation du contexte OpenGL (0x%x)\n", eglGetError());
+        benchContextFree();
+        return -1;
+    }
+    glGenRenderbuffers(2, _rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, _rbo[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, _rbo[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _rbo[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, _rbo[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Erreur : framebuffer %dx%d incomplet\n", w, h);
+        benchContextFree();
+        return -1;
+    }
+    glViewport(0, 0, w, h);
+    fprintf(stderr, "bench: EGL %d.%d, %s, %s\n", major, minor, glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    return 0;
+}
+
+/*!\brief deletes the framebuffer object and the context. */
+void benchContextFree(void)
+{
+    if (_fbo)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &_fbo);
+        glDeleteRenderbuffers(2, _rbo);
+        _fbo = 0;
+    }
+    if (_dpy == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (_surface != EGL_NO_SURFACE)
+        eglDestroySurface(_dpy, _surface);
+    if (_ctx != EGL_NO_CONTEXT)
+        eglDestroyContext(_dpy, _ctx);
+    eglTerminate(_dpy);
+    _dpy = EGL_NO_DISPLAY;
+    _ctx = EGL_NO_CONTEXT;
+    _surface = EGL_NO_SURFACE;
+}
+
+#endif
+
+/*!\brief parses the steps of a camera path (see bench.h); ';' also
+ * ends a step, so that a whole path fits on a command line. Returns
+ * the number of steps, or -1 with a message on stderr. */
+int benchPathParse(benchPath_t *path, const char *text)
+{
+    int cap = 0, line = 1;
+    const char *p = text;
+    memset(path, 0, sizeof *path);
+    while (*p)
+    {
+        benchStep_t step = {0, 0};
+        char *end;
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            ++p;
+        if (*p == '\n' || *p == ';' || *p == '#' || !*p)
+        {
+            while (*p && *p != '\n' && *p != ';')
+                ++p;
+            line += *p == '\n';
+            p += *p != '\0';
+            continue;
+        }
+        step.frames = (int)strtol(p, &end, 10);
+        if (end == p || step.frames <= 0)
+            goto error;
+        for (p = end; *p && *p != '\n' && *p != ';' && *p != '#'; ++p)
+            switch (*p)
+            {
+            case 'l': step.keys |= BENCH_LEFT; break;
+            case 'r': step.keys |= BENCH_RIGHT; break;
+            case 'u': step.keys |= BENCH_UP; break;
+            case 'd': step.keys |= BENCH_DOWN; break;
+            case '-': case ' ': case '\t': case '\r': break;
+            default: goto error;
+            }
+        if (path->nbSteps == cap)
+        {
+            cap = cap ? 2 * cap : 16;
+            path->steps = realloc(path->steps, cap * sizeof *path->steps);
+        }
+        path->steps[path->nbSteps++] = step;
+        path->frames += step.frames;
+    }
+    return path->nbSteps;
+error:
+    fprintf(stderr, "Erreur ligne %d du chemin de camera : %.*s\n", line, (int)strcspn(p, "\n;"), p);
+    benchPathFree(path);
+    return -1;
+}
+
+/*!\brief reads and parses the camera path of file \a filename. */
+int benchPathLoad(benchPath_t *path, const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    char *text;
+    long size;
+    int r;
+    if (!f)
+    {
+        fprintf(stderr, "Erreur lors de l'ouverture du chemin de camera %s\n", filename);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    text = malloc(size + 1);
+    text[fread(text, 1, size, f)] = '\0';
+    fclose(f);
+    r = benchPathParse(path, text);
+    free(text);
+    return r;
+}
+
+/*!\brief keys held at frame \a frame; the path loops when the
+ * benchmark is longer than it. */
+unsigned int benchPathKeys(const benchPath_t *path, int frame)
+{
+    if (!path->frames)
+        return 0;
+    frame %= path->frames;
+    for (int i = 0; i < path->nbSteps; ++i)
+    {
+        if (frame < path->steps[i].frames)
+            return path->steps[i].keys;
+        frame -= path->steps[i].frames;
+    }
+    return 0;
+}
+
+void benchPathFree(benchPath_t *path)
+{
+    if (path->steps)
+        free(path->steps);
+    memset(path, 0, sizeof *path);
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*!\brief nearest-rank percentile \a p (in ]0, 100]) of the \a n
+ * sorted values. */
+static double percentile(const double *sorted, int n, double p)
+{
+    int i = (int)ceil(p / 100.0 * n) - 1;
+    return sorted[i < 0 ? 0 : (i >= n ? n - 1 : i)];
+}
+
+/*!\brief writes "name": {mean, p50, p95, p99, max} of the \a n
+ * values of \a v (sorted in place). */
+static void writeSummary(FILE *f, const char *name, double *v, int n, const char *sep)
+{
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i)
+        sum += v[i];
+    qsort(v, n, sizeof *v, cmpDouble);
+    fprintf(f, "    \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+            name, sum / n, percentile(v, n, 50.0), percentile(v, n, 95.0), percentile(v, n, 99.0), v[n - 1], sep);
+}
+
+/*!\brief writes the report of \a n frames as JSON: \a config (a JSON
+ * object, written as is), the measures of every frame and, over all
+ * the frames, the mean, percentiles and maximum of each of them. When
+ * \a write is not NULL, it writes the value of one more member, \a
+ * name. */
+void benchWriteJson(FILE *f, const char *config, const benchFrame_t *frames, int n,
+                    const char *name, void (*write)(FILE *f))
+{
+    double *v = malloc((n ? n : 1) * sizeof *v);
+    fprintf(f, "{\n  \"config\": %s,\n  \"frames\": [\n", config);
+    for (int i = 0; i < n; ++i)
+        fprintf(f, "    {\"cpu_ms\": %.4f, \"frame_ms\": %.4f, \"gl_calls\": %lu, \"draw_calls\": %lu, \"programs\": %lu, "
+                   "\"triangles\": %lu, \"drawn\": %lu, \"culled\": %lu}%s\n",
+                frames[i].cpu, frames[i].total, frames[i].glCalls, frames[i].drawCalls, frames[i].programs,
+                frames[i].triangles, frames[i].drawn, frames[i].culled, i + 1 < n ? "," : "");
+    fprintf(f, "  ],\n  \"summary\": {\n    \"frames\": %d%s\n", n, n ? "," : "");
+    if (n)
+    {
+        for (int i = 0; i < n; ++i)
+            v[i] = frames[i].cpu;
+        writeSummary(f, "cpu_ms", v, n, ",");
+        for (int i = 0; i < n; ++i)
+            v[i] = frames[i].total;
+        writeSummary(f, "frame_ms", v, n, ",");
+        for (int i = 0; i < n; ++i)
+            v[i] = frames[i].drawCalls;
+        writeSummary(f, "draw_calls", v, n, ",");
+        for (int i = 0; i < n; ++i)
+            v[i] = frames[i].triangles;
+        writeSummary(f, "triangles", v, n, "");
+    }
+    fprintf(f, "  }");
+    if (write)
+    {
+        fprintf(f, ",\n  \"%s\": ", name);
+        write(f);
+    }
+    fprintf(f, "\n}\n");
+    free(v);
+}
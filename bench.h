@@ -0,0 +1,69 @@
+/*!\file bench.h
+ *
+ * \brief headless benchmark: offscreen OpenGL context, scripted
+ * camera paths and the per-frame report.
+ *
+ * The context is an EGL one without any window (the Mesa surfaceless
+ * platform when present, so that llvmpipe is enough) rendering into
+ * a framebuffer object of the requested size.
+ *
+ * A camera path is a list of steps, one per line of its text: a
+ * number of frames followed by the keys held during these frames,
+ * among l(eft), r(ight), u(p) and d(own), or '-' for none. Text after
+ * a '#' is a comment.
+ */
+
+#ifndef _BENCH_H
+
+#define _BENCH_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  enum
+  {
+    BENCH_LEFT  = 1,
+    BENCH_RIGHT = 2,
+    BENCH_UP    = 4,
+    BENCH_DOWN  = 8
+  };
+
+  typedef struct benchStep_t benchStep_t;
+  struct benchStep_t {
+    int frames;
+    /*!\brief BENCH_* keys held during the step */
+    unsigned int keys;
+  };
+
+  typedef struct benchFrame_t benchFrame_t;
+  /*!\brief measures of one frame: time spent in idle and draw, the
+   * same plus the wait for the rendering (glFinish), and the stats.h
+   * counters */
+  struct benchFrame_t {
+    double cpu, total;
+    unsigned long glCalls, drawCalls, programs, triangles, drawn, culled;
+  };
+
+  typedef struct benchPath_t benchPath_t;
+  struct benchPath_t {
+    benchStep_t *steps;
+    int nbSteps, frames;
+  };
+
+  extern int          benchContextInit(int w, int h);
+  extern void         benchContextFree(void);
+  extern int          benchPathParse(benchPath_t *path, const char *text);
+  extern int          benchPathLoad(benchPath_t *path, const char *filename);
+  extern unsigned int benchPathKeys(const benchPath_t *path, int frame);
+  extern void         benchPathFree(benchPath_t *path);
+  extern void         benchWriteJson(FILE *f, const char *config, const benchFrame_t *frames, int n,
+                                         const char *name, void (*write)(FILE *f));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
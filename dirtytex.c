@@ -0,0 +1,165 @@
+/*!\file dirtytex.c
+ *
+ * \brief incremental updates of an RGBA texture (see dirtytex.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirtytex.h"
+#include "stats.h"
+
+/* GL 4.4 or ARB_buffer_storage: glBufferStorage and persistent maps */
+static int hasBufferStorage(void)
+{
+#ifdef GL_MAP_PERSISTENT_BIT
+    GLint major = 0, minor = 0, n = 0, i;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 4))
+        return 1;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+    for (i = 0; i < n; ++i)
+        if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0)
+            return 1;
+#endif
+    return 0;
+}
+
+/*!\brief prepares the updates of texture \a tex, at most \a capacity
+ * texels per flush (dirtyTexSet flushes earlier when full).
+ *
+ * \return 0 on success, -1 on allocation failure.
+ */
+int dirtyTexInit(dirtyTex_t *dt, GLuint tex, int capacity)
+{
+    GLsizeiptr size = (GLsizeiptr)capacity * sizeof(GLuint);
+    memset(dt, 0, sizeof *dt);
+    dt->tex = tex;
+    dt->capacity = capacity;
+    if (!(dt->pending = malloc(capacity * sizeof *dt->pending)))
+        return -1;
+    glGenBuffers(1, &dt->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, dt->pbo);
+#ifdef GL_MAP_PERSISTENT_BIT
+    if (hasBufferStorage())
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, DIRTYTEX_REGIONS * size, NULL, flags);
+        dt->mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, DIRTYTEX_REGIONS * size, flags);
+    }
+#endif
+    if (!dt->mapped)
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return 0;
+}
+
+/*!\brief texel (\a x, \a y) of the texture becomes \a rgba at the
+ * next flush. */
+void dirtyTexSet(dirtyTex_t *dt, GLint x, GLint y, GLuint rgba)
+{
+    dtTexel_t *t;
+    if (dt->nbPending == dt->capacity)
+        dirtyTexFlush(dt);
+    t = &dt->pending[dt->nbPending++];
+    t->x = x;
+    t->y = y;
+    t->rgba = rgba;
+    t->seq = dt->seq++;
+}
+
+static int cmpTexels(const void *a, const void *b)
+{
+    const dtTexel_t *ta = a, *tb = b;
+    if (ta->y != tb->y)
+        return ta->y < tb->y ? -1 : 1;
+    if (ta->x != tb->x)
+        return ta->x < tb->x ? -1 : 1;
+    return ta->seq < tb->seq ? -1 : ta->seq > tb->seq;
+}
+
+/*!\brief sends the texels set since the last flush. */
+void dirtyTexFlush(dirtyTex_t *dt)
+{
+    GLuint *dst;
+    GLintptr base = 0;
+    int i, n, start;
+    if (!dt->nbPending)
+        return;
+    /* row-major order, the last write of a texel wins */
+    qsort(dt->pending, dt->nbPending, sizeof *dt->pending, cmpTexels);
+    for (i = 1, n = 1; i < dt->nbPending; ++i)
+    {
+        if (dt->pending[i].x == dt->pending[n - 1].x && dt->pending[i].y == dt->pending[n - 1].y)
+            --n;
+        dt->pending[n++] = dt->pending[i];
+    }
+    STATS_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, dt->pbo));
+    if (dt->mapped)
+    {
+        /* waits (in practice never) for the GPU to be done with the
+         * region written DIRTYTEX_REGIONS flushes ago */
+        GLsync *fence = &dt->fences[dt->region];
+        if (*fence)
+        {
+            STATS_CALL(glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull));
+            STATS_CALL(glDeleteSync(*fence));
+            *fence = 0;
+        }
+        base = (GLintptr)dt->region * dt->capacity * sizeof(GLuint);
+        dst = dt->mapped + dt->region * dt->capacity;
+    }
+    else
+        dst = STATS_CALL(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, n * sizeof(GLuint),
+                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    for (i = 0; i < n; ++i)
+        dst[i] = dt->pending[i].rgba;
+    if (!dt->mapped)
+        STATS_CALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, dt->tex));
+    /* one upload per run of consecutive texels of a row */
+    for (start = 0, i = 1; i <= n; ++i)
+    {
+        if (i < n && dt->pending[i].y == dt->pending[i - 1].y && dt->pending[i].x == dt->pending[i - 1].x + 1)
+            continue;
+        STATS_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, dt->pending[start].x, dt->pending[start].y, i - start, 1,
+                                   GL_RGBA, GL_UNSIGNED_BYTE, (const void *)(base + start * sizeof(GLuint))));
+        ++dt->uploads;
+        start = i;
+    }
+    if (dt->mipmap)
+        STATS_CALL(glGenerateMipmap(GL_TEXTURE_2D));
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    STATS_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    if (dt->mapped)
+    {
+        dt->fences[dt->region] = STATS_CALL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        dt->region = (dt->region + 1) % DIRTYTEX_REGIONS;
+    }
+    STATS_UPLOAD(n * sizeof(GLuint));
+    dt->bytes += n * sizeof(GLuint);
+    ++dt->flushes;
+    dt->nbPending = 0;
+}
+
+/*!\brief releases the PBO and the fences (the texture stays). */
+void dirtyTexFree(dirtyTex_t *dt)
+{
+    int i;
+    for (i = 0; i < DIRTYTEX_REGIONS; ++i)
+        if (dt->fences[i])
+            glDeleteSync(dt->fences[i]);
+    if (dt->pbo)
+    {
+        if (dt->mapped)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, dt->pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &dt->pbo);
+    }
+    free(dt->pending);
+    memset(dt, 0, sizeof *dt);
+}
@@ -0,0 +1,59 @@
+/*!\file dirtytex.h
+ *
+ * \brief incremental updates of an RGBA texture.
+ *
+ * The texels changed during a frame are collected by dirtyTexSet and
+ * sent by dirtyTexFlush in one go: they are sorted, each texel keeps
+ * its last value, consecutive texels of a row become one
+ * glTexSubImage2D, and all of them are read from one pixel buffer
+ * object. When the context allows it (GL 4.4 or ARB_buffer_storage),
+ * the PBO is mapped once and for all and split into regions used in
+ * turn, each guarded by a fence; otherwise it is orphaned and mapped
+ * at each flush.
+ */
+
+#ifndef _DIRTYTEX_H
+
+#define _DIRTYTEX_H
+
+#include <GL4D/gl4du.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!\brief regions of a persistent PBO (frames in flight) */
+#define DIRTYTEX_REGIONS 3
+
+  typedef struct dtTexel_t dtTexel_t;
+  struct dtTexel_t {
+    GLint  x, y;
+    GLuint rgba, seq;
+  };
+
+  typedef struct dirtyTex_t dirtyTex_t;
+  struct dirtyTex_t {
+    GLuint        tex, pbo;
+    /*!\brief regenerate the mipmaps of tex after each flush */
+    GLboolean     mipmap;
+    dtTexel_t    *pending;
+    int           nbPending, capacity;
+    GLuint        seq;
+    /*!\brief persistent mapping (NULL when mapped at each flush) */
+    GLuint       *mapped;
+    int           region;
+    GLsync        fences[DIRTYTEX_REGIONS];
+    /*!\brief flushes, glTexSubImage2D calls and bytes sent */
+    unsigned long flushes, uploads, bytes;
+  };
+
+  extern int  dirtyTexInit(dirtyTex_t *dt, GLuint tex, int capacity);
+  extern void dirtyTexSet(dirtyTex_t *dt, GLint x, GLint y, GLuint rgba);
+  extern void dirtyTexFlush(dirtyTex_t *dt);
+  extern void dirtyTexFree(dirtyTex_t *dt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
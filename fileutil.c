@@ -0,0 +1,55 @@
+/*!\file fileutil.c
+ *
+ * \brief helpers of the on-disk caches (see fileutil.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fileutil.h"
+
+/*!\brief FNV-1a hash of \a size bytes of \a data, continuing \a h
+ * (FILE_HASH_INIT to start a chain). */
+uint64_t fileHash(uint64_t h, const void *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= ((const unsigned char *)data)[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/*!\brief writes \a head then \a data (either may be empty) to \a path,
+ * through a temporary file renamed over it so that a concurrent reader
+ * never sees a partial file. The temporary file is unique to the call
+ * (mkstemp): threads writing the same path at once each publish a
+ * whole file, the last rename winning. Returns 0, or -1 and no file. */
+int fileWriteAtomic(const char *path, const void *head, size_t headSize, const void *data, size_t size)
+{
+    char tmp[BUFSIZ];
+    FILE *f;
+    int fd;
+    if (snprintf(tmp, sizeof tmp, "%s.XXXXXX", path) >= (int)sizeof tmp || (fd = mkstemp(tmp)) < 0)
+        return -1;
+    /* mkstemp creates it private to the user */
+    if (fchmod(fd, 0644) != 0 || !(f = fdopen(fd, "wb")))
+    {
+        close(fd);
+        remove(tmp);
+        return -1;
+    }
+    if (fwrite(head, 1, headSize, f) != headSize || fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        remove(tmp);
+        return -1;
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0)
+    {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
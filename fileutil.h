@@ -0,0 +1,30 @@
+/*!\file fileutil.h
+ *
+ * \brief helpers of the on-disk caches (meshes, mazes, program
+ * binaries): a content hash for their keys and a writer that never
+ * leaves a partial file behind.
+ */
+
+#ifndef _FILEUTIL_H
+
+#define _FILEUTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!\brief initial value of a fileHash chain (FNV-1a offset basis) */
+#define FILE_HASH_INIT 0xcbf29ce484222325ull
+
+  extern uint64_t fileHash(uint64_t h, const void *data, size_t size);
+  extern int      fileWriteAtomic(const char *path, const void *head, size_t headSize,
+                                  const void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+/*!\file frustum.c
+ *
+ * \brief view frustum and box visibility test (see frustum.h).
+ */
+#include "frustum.h"
+
+/*!\brief extracts the planes of the frustum in world space from the
+ * gl4du \a projection and \a view matrices (row-major, as returned by
+ * gl4duGetMatrixData). Planes are not normalized: only their sign is
+ * used. */
+void frustumFromMatrices(frustum_t *f, const GLfloat *projection, const GLfloat *view)
+{
+    GLfloat m[16];
+    int r, c, k;
+    for (r = 0; r < 4; ++r)
+        for (c = 0; c < 4; ++c)
+        {
+            m[4 * r + c] = 0.0f;
+            for (k = 0; k < 4; ++k)
+                m[4 * r + c] += projection[4 * r + k] * view[4 * k + c];
+        }
+    /* left, right, bottom, top, near, far: row 3 +/- rows 0, 1, 2 */
+    for (k = 0; k < 6; ++k)
+    {
+        const GLfloat *row = &m[4 * (k / 2)];
+        GLfloat sign = (k & 1) ? -1.0f : 1.0f;
+        for (c = 0; c < 4; ++c)
+            f->planes[k][c] = m[12 + c] + sign * row[c];
+    }
+}
+
+/*!\brief returns 0 when the box [\a min, \a max] is entirely outside
+ * one of the planes, 1 otherwise (the box may still be outside near a
+ * corner of the frustum; it is then drawn). */
+int frustumTestAABB(const frustum_t *f, const GLfloat min[3], const GLfloat max[3])
+{
+    int k;
+    for (k = 0; k < 6; ++k)
+    {
+        const GLfloat *p = f->planes[k];
+        /* the corner of the box that is the furthest along the normal */
+        GLfloat d = p[0] * (p[0] >= 0.0f ? max[0] : min[0]) +
+                    p[1] * (p[1] >= 0.0f ? max[1] : min[1]) +
+                    p[2] * (p[2] >= 0.0f ? max[2] : min[2]) + p[3];
+        if (d < 0.0f)
+            return 0;
+    }
+    return 1;
+}
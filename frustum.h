@@ -0,0 +1,31 @@
+/*!\file frustum.h
+ *
+ * \brief view frustum extracted from the gl4du projection and view
+ * matrices, and box visibility test.
+ */
+
+#ifndef _FRUSTUM_H
+
+#define _FRUSTUM_H
+
+#include <GL4D/gl4du.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /*!\brief the six planes (a, b, c, d) of a frustum: a point p is
+   * inside when a p.x + b p.y + c p.z + d >= 0 for every plane */
+  typedef struct frustum_t frustum_t;
+  struct frustum_t {
+    GLfloat planes[6][4];
+  };
+
+  extern void frustumFromMatrices(frustum_t *f, const GLfloat *projection, const GLfloat *view);
+  extern int  frustumTestAABB(const frustum_t *f, const GLfloat min[3], const GLfloat max[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
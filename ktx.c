@@ -0,0 +1,594 @@
+/*!\file ktx.c
+ *
+ * \brief block-compressed textures with their full mip chain, in KTX
+ * 1.1 files (see ktx.h).
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include "ktx.h"
+#include "stats.h"
+
+static const unsigned char _identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+/* the 13 words following the identifier */
+typedef struct ktxHeader_t
+{
+    uint32_t endianness, glType, glTypeSize, glFormat, glInternalFormat, glBaseInternalFormat;
+    uint32_t pixelWidth, pixelHeight, pixelDepth, numberOfArrayElements, numberOfFaces;
+    uint32_t numberOfMipmapLevels, bytesOfKeyValueData;
+} ktxHeader_t;
+
+static int blockBytes(uint32_t format)
+{
+    return format == KTX_BC1 ? 8 : 16;
+}
+
+static uint32_t levelSize(uint32_t format, int w, int h)
+{
+    return (uint32_t)((w + 3) / 4) * ((h + 3) / 4) * blockBytes(format);
+}
+
+/* the 4x4 block (bx, by), pixels out of the image clamped to its edge */
+static void fetchBlock(const unsigned char *rgba, int w, int h, int bx, int by, unsigned char px[16][4])
+{
+    int i, j;
+    for (j = 0; j < 4; ++j)
+        for (i = 0; i < 4; ++i)
+        {
+            int x = 4 * bx + i < w ? 4 * bx + i : w - 1, y = 4 * by + j < h ? 4 * by + j : h - 1;
+            memcpy(px[4 * j + i], &rgba[4 * ((size_t)y * w + x)], 4);
+        }
+}
+
+static uint16_t to565(const float c[3])
+{
+    int r = (int)(c[0] * 31.0f / 255.0f + 0.5f), g = (int)(c[1] * 63.0f / 255.0f + 0.5f), b = (int)(c[2] * 31.0f / 255.0f + 0.5f);
+    r = r < 0 ? 0 : r > 31 ? 31 : r;
+    g = g < 0 ? 0 : g > 63 ? 63 : g;
+    b = b < 0 ? 0 : b > 31 ? 31 : b;
+    return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static void from565(uint16_t v, int c[3])
+{
+    int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+    c[0] = r << 3 | r >> 2;
+    c[1] = g << 2 | g >> 4;
+    c[2] = b << 3 | b >> 2;
+}
+
+static void put16(unsigned char *p, uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+/* the four colours of a block (three and transparent black in BC1
+ * when c0 <= c1) */
+static void palette(uint16_t c0, uint16_t c1, int fourColours, int p[4][4])
+{
+    int k;
+    from565(c0, p[0]);
+    from565(c1, p[1]);
+    p[0][3] = p[1][3] = p[2][3] = p[3][3] = 255;
+    for (k = 0; k < 3; ++k)
+        if (fourColours)
+        {
+            p[2][k] = (2 * p[0][k] + p[1][k]) / 3;
+            p[3][k] = (p[0][k] + 2 * p[1][k]) / 3;
+        }
+        else
+        {
+            p[2][k] = (p[0][k] + p[1][k]) / 2;
+            p[3][k] = 0;
+        }
+    if (!fourColours)
+        p[3][3] = 0;
+}
+
+/* colour block: the endpoints are the extremes of the pixels along
+ * their principal axis, always in the four colours mode */
+static void encodeColour(unsigned char px[16][4], unsigned char *out)
+{
+    float mean[3] = {0, 0, 0}, cov[6] = {0, 0, 0, 0, 0, 0}, axis[3] = {1, 1, 1}, tmin = 1e9f, tmax = -1e9f, e[2][3];
+    int i, k, it, p[4][4];
+    uint16_t c0, c1;
+    uint32_t bits = 0;
+    for (i = 0; i < 16; ++i)
+        for (k = 0; k < 3; ++k)
+            mean[k] += px[i][k] / 16.0f;
+    for (i = 0; i < 16; ++i)
+    {
+        float d[3] = {px[i][0] - mean[0], px[i][1] - mean[1], px[i][2] - mean[2]};
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+    /* power iteration */
+    for (it = 0; it < 8; ++it)
+    {
+        float a[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                      cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                      cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        float n = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        if (n < 1e-6f)
+            break;
+        for (k = 0; k < 3; ++k)
+            axis[k] = a[k] / n;
+    }
+    for (i = 0; i < 16; ++i)
+    {
+        float t = (px[i][0] - mean[0]) * axis[0] + (px[i][1] - mean[1]) * axis[1] + (px[i][2] - mean[2]) * axis[2];
+        tmin = t < tmin ? t : tmin;
+        tmax = t > tmax ? t : tmax;
+    }
+    for (k = 0; k < 3; ++k)
+    {
+        e[0][k] = mean[k] + tmax * axis[k];
+        e[1][k] = mean[k] + tmin * axis[k];
+    }
+    c0 = to565(e[0]);
+    c1 = to565(e[1]);
+    if (c0 < c1)
+    {
+        uint16_t t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+    put16(out, c0);
+    put16(out + 2, c1);
+    if (c0 != c1)
+    {
+        palette(c0, c1, 1, p);
+        for (i = 0; i < 16; ++i)
+        {
+            int best = 0, bestD = 1 << 30;
+            for (k = 0; k < 4; ++k)
+            {
+                int dr = px[i][0] - p[k][0], dg = px[i][1] - p[k][1], db = px[i][2] - p[k][2];
+                int d = dr * dr + dg * dg + db * db;
+                if (d < bestD)
+                {
+                    bestD = d;
+                    best = k;
+                }
+            }
+            bits |= (uint32_t)best << (2 * i);
+        }
+    }
+    put16(out + 4, bits & 0xffff);
+    put16(out + 6, bits >> 16);
+}
+
+/* alpha block of BC3: min and max alpha, eight levels between them */
+static void encodeAlpha(unsigned char px[16][4], unsigned char *out)
+{
+    int a0 = 0, a1 = 255, i, k, p[8];
+    uint64_t bits = 0;
+    for (i = 0; i < 16; ++i)
+    {
+        a0 = px[i][3] > a0 ? px[i][3] : a0;
+        a1 = px[i][3] < a1 ? px[i][3] : a1;
+    }
+    out[0] = a0;
+    out[1] = a1;
+    if (a0 != a1)
+    {
+        p[0] = a0;
+        p[1] = a1;
+        for (k = 1; k < 7; ++k)
+            p[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+        for (i = 0; i < 16; ++i)
+        {
+            int best = 0, bestD = 256;
+            for (k = 0; k < 8; ++k)
+                if (abs(px[i][3] - p[k]) < bestD)
+                {
+                    bestD = abs(px[i][3] - p[k]);
+                    best = k;
+                }
+            bits |= (uint64_t)best << (3 * i);
+        }
+    }
+    for (i = 0; i < 6; ++i)
+        out[2 + i] = (bits >> (8 * i)) & 0xff;
+}
+
+static void decodeColour(const unsigned char *in, int fourColours, unsigned char px[16][4])
+{
+    uint16_t c0 = in[0] | in[1] << 8, c1 = in[2] | in[3] << 8;
+    uint32_t bits = in[4] | in[5] << 8 | in[6] << 16 | (uint32_t)in[7] << 24;
+    int p[4][4], i, k;
+    palette(c0, c1, fourColours || c0 > c1, p);
+    for (i = 0; i < 16; ++i)
+        for (k = 0; k < 4; ++k)
+            px[i][k] = p[(bits >> (2 * i)) & 3][k];
+}
+
+static void decodeAlpha(const unsigned char *in, unsigned char px[16][4])
+{
+    int a0 = in[0], a1 = in[1], p[8], i, k;
+    uint64_t bits = 0;
+    for (i = 0; i < 6; ++i)
+        bits |= (uint64_t)in[2 + i] << (8 * i);
+    p[0] = a0;
+    p[1] = a1;
+    if (a0 > a1)
+        for (k = 1; k < 7; ++k)
+            p[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+    else
+    {
+        for (k = 1; k < 5; ++k)
+            p[k + 1] = ((5 - k) * a0 + k * a1) / 5;
+        p[6] = 0;
+        p[7] = 255;
+    }
+    for (i = 0; i < 16; ++i)
+        px[i][3] = p[(bits >> (3 * i)) & 7];
+}
+
+static void compressLevel(ktxLevel_t *l, const unsigned char *rgba, uint32_t format)
+{
+    int bx, by, bw = (l->w + 3) / 4, bh = (l->h + 3) / 4, bs = blockBytes(format);
+    unsigned char px[16][4];
+    for (by = 0; by < bh; ++by)
+        for (bx = 0; bx < bw; ++bx)
+        {
+            unsigned char *out = &l->data[(by * bw + bx) * bs];
+            fetchBlock(rgba, l->w, l->h, bx, by, px);
+            if (format == KTX_BC3)
+            {
+                encodeAlpha(px, out);
+                out += 8;
+            }
+            encodeColour(px, out);
+        }
+}
+
+/* next level of the chain: 2x2 box filter */
+static void downsample(const unsigned char *src, int w, int h, unsigned char *dst, int dw, int dh)
+{
+    int x, y, k;
+    for (y = 0; y < dh; ++y)
+        for (x = 0; x < dw; ++x)
+        {
+            int x0 = 2 * x < w ? 2 * x : w - 1, x1 = 2 * x + 1 < w ? 2 * x + 1 : w - 1;
+            int y0 = 2 * y < h ? 2 * y : h - 1, y1 = 2 * y + 1 < h ? 2 * y + 1 : h - 1;
+            for (k = 0; k < 4; ++k)
+                dst[4 * (y * dw + x) + k] = (src[4 * (y0 * w + x0) + k] + src[4 * (y0 * w + x1) + k] +
+                                             src[4 * (y1 * w + x0) + k] + src[4 * (y1 * w + x1) + k] + 2) / 4;
+        }
+}
+
+/*!\brief builds the mip chain of the \a w x \a h RGBA image \a rgba
+ * (8 bits per channel) and compresses it in \a format (KTX_BC1 or
+ * KTX_BC3).
+ *
+ * \return 0 on success, -1 on allocation failure or unknown format.
+ */
+int ktxEncode(ktx_t *k, const unsigned char *rgba, int w, int h, uint32_t format)
+{
+    unsigned char *cur, *next;
+    int l;
+    memset(k, 0, sizeof *k);
+    if (format != KTX_BC1 && format != KTX_BC3)
+        return -1;
+    k->format = format;
+    k->w = w;
+    k->h = h;
+    cur = malloc(4 * (size_t)w * h);
+    next = malloc(4 * (size_t)((w + 1) / 2) * ((h + 1) / 2));
+    if (!cur || !next)
+    {
+        free(cur);
+        free(next);
+        return -1;
+    }
+    memcpy(cur, rgba, 4 * (size_t)w * h);
+    for (l = 0; l < KTX_MAX_LEVELS; ++l)
+    {
+        ktxLevel_t *lv = &k->levels[l];
+        unsigned char *t;
+        lv->w = w;
+        lv->h = h;
+        lv->size = levelSize(format, w, h);
+        if (!(lv->data = malloc(lv->size)))
+            break;
+        compressLevel(lv, cur, format);
+        ++k->nbLevels;
+        if (w == 1 && h == 1)
+            break;
+        downsample(cur, w, h, next, w > 1 ? w / 2 : 1, h > 1 ? h / 2 : 1);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        t = cur;
+        cur = next;
+        next = t;
+    }
+    free(cur);
+    free(next);
+    return k->nbLevels && (k->levels[k->nbLevels - 1].w == 1 && k->levels[k->nbLevels - 1].h == 1) ? 0 : -1;
+}
+
+/*!\brief decodes level \a level on the CPU into \a rgba (w x h x 4
+ * bytes of that level). */
+void ktxDecodeLevel(const ktx_t *k, int level, unsigned char *rgba)
+{
+    const ktxLevel_t *l = &k->levels[level];
+    int bx, by, i, j, bw = (l->w + 3) / 4, bh = (l->h + 3) / 4, bs = blockBytes(k->format);
+    unsigned char px[16][4];
+    for (by = 0; by < bh; ++by)
+        for (bx = 0; bx < bw; ++bx)
+        {
+            const unsigned char *in = &l->data[(by * bw + bx) * bs];
+            if (k->format == KTX_BC3)
+            {
+                decodeColour(in + 8, 1, px);
+                decodeAlpha(in, px);
+            }
+            else
+                decodeColour(in, 0, px);
+            for (j = 0; j < 4 && 4 * by + j < l->h; ++j)
+                for (i = 0; i < 4 && 4 * bx + i < l->w; ++i)
+                    memcpy(&rgba[4 * ((size_t)(4 * by + j) * l->w + 4 * bx + i)], px[4 * j + i], 4);
+        }
+}
+
+/*!\brief writes \a k in KTX 1.1 (native endianness, no key/value
+ * data), through a temporary file.
+ *
+ * \return 0 on success.
+ */
+int ktxWrite(const ktx_t *k, const char *path)
+{
+    char tmp[BUFSIZ];
+    ktxHeader_t h;
+    FILE *f;
+    int l, ok;
+    memset(&h, 0, sizeof h);
+    h.endianness = 0x04030201;
+    h.glTypeSize = 1;
+    h.glInternalFormat = k->format;
+    h.glBaseInternalFormat = k->format == KTX_BC1 ? 0x1907 /* GL_RGB */ : 0x1908 /* GL_RGBA */;
+    h.pixelWidth = k->w;
+    h.pixelHeight = k->h;
+    h.numberOfFaces = 1;
+    h.numberOfMipmapLevels = k->nbLevels;
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    if (!(f = fopen(tmp, "wb")))
+        return -1;
+    ok = fwrite(_identifier, sizeof _identifier, 1, f) == 1 && fwrite(&h, sizeof h, 1, f) == 1;
+    /* block sizes are multiples of 8: no padding */
+    for (l = 0; ok && l < k->nbLevels; ++l)
+        ok = fwrite(&k->levels[l].size, sizeof k->levels[l].size, 1, f) == 1 &&
+             fwrite(k->levels[l].data, k->levels[l].size, 1, f) == 1;
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0)
+    {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*!\brief reads a KTX file written by ktxWrite (BC1 or BC3, 2D, native
+ * endianness).
+ *
+ * \return 0 on success, -1 if the file is missing or not supported.
+ */
+int ktxRead(ktx_t *k, const char *path)
+{
+    unsigned char id[sizeof _identifier];
+    ktxHeader_t h;
+    FILE *f;
+    int l, w, hh;
+    memset(k, 0, sizeof *k);
+    if (!(f = fopen(path, "rb")))
+        return -1;
+    if (fread(id, sizeof id, 1, f) != 1 || memcmp(id, _identifier, sizeof id) != 0 ||
+        fread(&h, sizeof h, 1, f) != 1 || h.endianness != 0x04030201 ||
+        (h.glInternalFormat != KTX_BC1 && h.glInternalFormat != KTX_BC3) ||
+        !h.pixelWidth || !h.pixelHeight || h.pixelDepth > 1 || h.numberOfFaces != 1 || h.numberOfArrayElements ||
+        !h.numberOfMipmapLevels || h.numberOfMipmapLevels > KTX_MAX_LEVELS ||
+        fseek(f, h.bytesOfKeyValueData, SEEK_CUR) != 0)
+    {
+        fclose(f);
+        return -1;
+    }
+    k->format = h.glInternalFormat;
+    k->w = w = h.pixelWidth;
+    k->h = hh = h.pixelHeight;
+    for (l = 0; l < (int)h.numberOfMipmapLevels; ++l)
+    {
+        ktxLevel_t *lv = &k->levels[l];
+        lv->w = w;
+        lv->h = hh;
+        if (fread(&lv->size, sizeof lv->size, 1, f) != 1 || lv->size != levelSize(k->format, w, hh) ||
+            !(lv->data = malloc(lv->size)) || fread(lv->data, lv->size, 1, f) != 1)
+        {
+            fclose(f);
+            ktxFree(k);
+            return -1;
+        }
+        ++k->nbLevels;
+        w = w > 1 ? w / 2 : 1;
+        hh = hh > 1 ? hh / 2 : 1;
+    }
+    fclose(f);
+    return 0;
+}
+
+/*!\brief releases the levels. */
+void ktxFree(ktx_t *k)
+{
+    int l;
+    for (l = 0; l < k->nbLevels; ++l)
+        free(k->levels[l].data);
+    memset(k, 0, sizeof *k);
+}
+
+/*!\brief path of the compressed version of image \a source. */
+void ktxPath(const char *source, char *out, size_t outSize)
+{
+    snprintf(out, outSize, "%s%s", source, KTX_EXT);
+}
+
+/*!\brief 1 if \a ktxPath exists and is not older than \a source (or
+ * \a source is missing). */
+int ktxFresh(const char *source, const char *ktxPath)
+{
+    struct stat ss, ks;
+    if (stat(ktxPath, &ks) != 0)
+        return 0;
+    return stat(source, &ss) != 0 || ks.st_mtime >= ss.st_mtime;
+}
+
+const char *ktxFormatName(uint32_t format)
+{
+    return format == KTX_BC1 ? "BC1" : format == KTX_BC3 ? "BC3" : "?";
+}
+
+static double psnr(const unsigned char *a, const unsigned char *b, size_t n)
+{
+    double se = 0.0;
+    size_t i;
+    for (i = 0; i < n; ++i)
+        se += (a[i] - b[i]) * (double)(a[i] - b[i]);
+    return se > 0.0 ? 10.0 * log10(255.0 * 255.0 * n / se) : 99.0;
+}
+
+/* bytes of the whole chain */
+static unsigned long chainSize(const ktx_t *k)
+{
+    unsigned long n = 0;
+    int l;
+    for (l = 0; l < k->nbLevels; ++l)
+        n += k->levels[l].size;
+    return n;
+}
+
+/*!\brief converts \a image to image + KTX_EXT: BC1 if it is opaque,
+ * BC3 otherwise, and reports the sizes, the PSNR of the first level
+ * and the time spent.
+ *
+ * \return 0 on success.
+ */
+int ktxConvert(const char *image)
+{
+    double t0 = now_ms();
+    SDL_Surface *s, *c;
+    unsigned char *rgba, *back;
+    char out[BUFSIZ];
+    uint32_t format = KTX_BC1;
+    ktx_t k;
+    int y, r;
+    size_t i, n;
+    if (!(s = IMG_Load(image)))
+    {
+        fprintf(stderr, "Probleme de chargement de textures %s\n", image);
+        return 1;
+    }
+    c = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(s);
+    if (!c)
+        return 1;
+    n = 4 * (size_t)c->w * c->h;
+    rgba = malloc(n);
+    back = malloc(n);
+    for (y = 0; y < c->h; ++y)
+        memcpy(&rgba[4 * (size_t)y * c->w], (unsigned char *)c->pixels + (size_t)y * c->pitch, 4 * c->w);
+    for (i = 3; i < n; i += 4)
+        if (rgba[i] != 255)
+        {
+            format = KTX_BC3;
+            break;
+        }
+    ktxPath(image, out, sizeof out);
+    r = ktxEncode(&k, rgba, c->w, c->h, format) != 0 || ktxWrite(&k, out) != 0;
+    if (!r)
+    {
+        ktxDecodeLevel(&k, 0, back);
+        fprintf(stderr, "%s -> %s: %dx%d %s, %d levels, %lu bytes (RGBA with mips: %lu), PSNR %.1f dB, %.1f ms\n",
+                image, out, k.w, k.h, ktxFormatName(format), k.nbLevels, chainSize(&k), (unsigned long)(n * 4 / 3),
+                psnr(rgba, back, n), now_ms() - t0);
+    }
+    else
+        fprintf(stderr, "Erreur lors de l'ecriture de %s\n", out);
+    ktxFree(&k);
+    free(rgba);
+    free(back);
+    SDL_FreeSurface(c);
+    return r;
+}
+
+/*!\brief encodes a synthetic image (gradients, edges and an alpha
+ * ramp) in BC1 and BC3, writes and reads it back, decodes it on the
+ * CPU and checks the chain, the round trip and the PSNR. Needs no GL
+ * context.
+ *
+ * \return 0 when every check passes.
+ */
+int ktxCheck(void)
+{
+    static const uint32_t formats[2] = {KTX_BC1, KTX_BC3};
+    const int w = 256, h = 192;
+    unsigned char *rgba = malloc(4 * w * h), *back = malloc(4 * w * h);
+    int x, y, f, fails = 0;
+    for (y = 0; y < h; ++y)
+        for (x = 0; x < w; ++x)
+        {
+            unsigned char *p = &rgba[4 * (y * w + x)];
+            p[0] = x;
+            p[1] = (y * 255) / (h - 1);
+            p[2] = ((x / 32 + y / 32) & 1) ? 200 : 40;
+            p[3] = (x * 255) / (w - 1);
+        }
+    for (f = 0; f < 2; ++f)
+    {
+        ktx_t k, r;
+        double t0 = now_ms(), tenc, q = 0.0;
+        int l, same = 1;
+        /* ktxRead may not run: ktxFree(&r) must find nothing to free */
+        memset(&r, 0, sizeof r);
+        if (ktxEncode(&k, rgba, w, h, formats[f]) != 0)
+        {
+            /* the levels encoded before the failure */
+            ktxFree(&k);
+            ++fails;
+            continue;
+        }
+        tenc = now_ms() - t0;
+        same = ktxWrite(&k, "ktx_check" KTX_EXT) == 0 && ktxRead(&r, "ktx_check" KTX_EXT) == 0 && r.nbLevels == k.nbLevels;
+        for (l = 0; same && l < k.nbLevels; ++l)
+            same = r.levels[l].size == k.levels[l].size && memcmp(r.levels[l].data, k.levels[l].data, k.levels[l].size) == 0;
+        remove("ktx_check" KTX_EXT);
+        if (same)
+        {
+            ktxDecodeLevel(&r, 0, back);
+            if (formats[f] == KTX_BC1)
+            {
+                /* alpha is not stored: compare the colours only */
+                for (x = 0; x < w * h; ++x)
+                    back[4 * x + 3] = rgba[4 * x + 3];
+            }
+            q = psnr(rgba, back, 4 * w * h);
+        }
+        fprintf(stderr, "ktx %s: %dx%d, %d levels, %lu bytes, encoded in %.1f ms, round trip %s, PSNR %.1f dB\n",
+                ktxFormatName(formats[f]), w, h, k.nbLevels, chainSize(&k), tenc, same ? "ok" : "FAILED", q);
+        fails += !same || k.nbLevels != 9 || q < 32.0;
+        ktxFree(&k);
+        ktxFree(&r);
+    }
+    free(rgba);
+    free(back);
+    return fails != 0;
+}
@@ -0,0 +1,60 @@
+/*!\file ktx.h
+ *
+ * \brief block-compressed textures with their full mip chain, in KTX
+ * 1.1 files.
+ *
+ * ktxEncode builds the mip chain of an RGBA image (2x2 box filter
+ * down to 1x1) and compresses every level in BC1 (DXT1, opaque
+ * images) or BC3 (DXT5, with alpha). The converter (--ktx) writes the
+ * result next to the image, as image + KTX_EXT, and the texture cache
+ * loads it instead of the image when it is not older. ktxDecodeLevel
+ * is the CPU decoder used when the GL context has no S3TC support.
+ */
+
+#ifndef _KTX_H
+
+#define _KTX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KTX_EXT        ".ktx"
+#define KTX_MAX_LEVELS 16
+/*!\brief glInternalFormat of the supported formats (S3TC) */
+#define KTX_BC1        0x83F0 /* GL_COMPRESSED_RGB_S3TC_DXT1_EXT */
+#define KTX_BC3        0x83F3 /* GL_COMPRESSED_RGBA_S3TC_DXT5_EXT */
+
+  typedef struct ktxLevel_t ktxLevel_t;
+  struct ktxLevel_t {
+    int            w, h;
+    uint32_t       size;
+    unsigned char *data;
+  };
+
+  typedef struct ktx_t ktx_t;
+  struct ktx_t {
+    uint32_t   format;
+    int        w, h, nbLevels;
+    ktxLevel_t levels[KTX_MAX_LEVELS];
+  };
+
+  extern int         ktxEncode(ktx_t *k, const unsigned char *rgba, int w, int h, uint32_t format);
+  extern void        ktxDecodeLevel(const ktx_t *k, int level, unsigned char *rgba);
+  extern int         ktxWrite(const ktx_t *k, const char *path);
+  extern int         ktxRead(ktx_t *k, const char *path);
+  extern void        ktxFree(ktx_t *k);
+  extern void        ktxPath(const char *source, char *out, size_t outSize);
+  extern int         ktxFresh(const char *source, const char *ktxPath);
+  extern const char *ktxFormatName(uint32_t format);
+  extern int         ktxConvert(const char *image);
+  extern int         ktxCheck(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,11 +2,27 @@
  *
  * \brief Labyrinth generator.
  *
+ * Rooms are the cells with odd coordinates, every other cell is
+ * first a wall (-1); a perfect maze is carved by opening (0) walls
+ * between rooms that are not connected yet. labyrinth() picks the
+ * walls from a shuffled list and tracks the connected regions with a
+ * disjoint-set forest (union by rank, path compression), which is
+ * O(cells) for practical purposes. labyrinthLegacy() is the former
+ * engine (random retries and flood fill relabelling, drawing from
+ * rand()), kept to be compared against.
+ *
  * \author Farès BELHADJ, amsi@ai.univ-paris8.fr
  * \date February 20 2018
  */
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
+#include <SDL.h>
+
+#include "rng.h"
+#include "stats.h"
 
 static void propoagate(int * lab, int v, int x, int y, int w, int * n) {
   int i;
@@ -21,7 +37,9 @@ static void propoagate(int * lab, int v, int x, int y, int w, int * n) {
       propoagate(lab, v, x + dir[i][0], y + dir[i][1], w, n);
 }
 
-unsigned int * labyrinth(int w, int h) {
+/*!\brief the former generator: O(cells^2) in the worst case and its
+ * recursive flood fill overflows the stack on large mazes. */
+unsigned int * labyrinthLegacy(int w, int h) {
   int i, j, k = 0, sw = (w - 1) / 2, sh = (h - 1) / 2;
   int * lab, toGo = sw * sh - 1;
   int mx, my, d;
@@ -66,3 +84,304 @@ unsigned int * labyrinth(int w, int h) {
   }
   return (unsigned int *)lab;
 }
+
+/* root of room r, with path halving */
+static int find(int * parent, int r) {
+  while(parent[r] != r) {
+    parent[r] = parent[parent[r]];
+    r = parent[r];
+  }
+  return r;
+}
+
+static void shuffle(unsigned int * walls, unsigned long n, rng_t * rng) {
+  unsigned long k, r;
+  unsigned int t;
+  for(k = n; k > 1; --k) {
+    r = rngBelow(rng, k);
+    t = walls[k - 1];
+    walls[k - 1] = walls[r];
+    walls[r] = t;
+  }
+}
+
+/* allocates the maze with all the rooms open and all the other cells
+ * walls, and one singleton set per room */
+static unsigned int * initLab(int w, int h, int ** parent, unsigned char ** rank) {
+  int i, j, sw = (w - 1) / 2, sh = (h - 1) / 2;
+  unsigned int * lab;
+  assert((w&1) && (h&1));
+  lab = malloc(w * h * sizeof *lab);
+  *parent = malloc(sw * sh * sizeof **parent);
+  *rank = calloc(sw * sh, sizeof **rank);
+  assert(lab && *parent && *rank);
+  for(i = 0; i < h; ++i)
+    for(j = 0; j < w; ++j)
+      lab[i * w + j] = ((i&1) && (j&1)) ? 0 : (unsigned int)-1;
+  for(i = 0; i < sw * sh; ++i)
+    (*parent)[i] = i;
+  return lab;
+}
+
+/* opens, in order, the walls of the list that join two different sets
+ * until toGo walls are opened. A wall is (r << 1) between room r and
+ * its right neighbour, (r << 1 | 1) between r and its lower one. */
+static void carve(unsigned int * lab, int w, int * parent, unsigned char * rank,
+                  const unsigned int * walls, unsigned long nbWalls, int toGo) {
+  int sw = (w - 1) / 2, i, j;
+  unsigned long k;
+  for(k = 0; k < nbWalls && toGo > 0; ++k) {
+    int r0 = walls[k] >> 1, r1 = (walls[k] & 1) ? r0 + sw : r0 + 1, a, b;
+    if((a = find(parent, r0)) == (b = find(parent, r1)))
+      continue;
+    if(rank[a] < rank[b]) {
+      parent[a] = b;
+    } else {
+      parent[b] = a;
+      if(rank[a] == rank[b])
+        ++rank[a];
+    }
+    /* the wall cell between the two rooms */
+    i = 1 + 2 * (r0 / sw);
+    j = 1 + 2 * (r0 % sw);
+    lab[(i + (walls[k] & 1)) * w + j + !(walls[k] & 1)] = 0;
+    --toGo;
+  }
+}
+
+/*!\brief generates a perfect w x h maze (w and h odd) drawing from
+ * \a rng: walls are -1, rooms and passages 0. */
+unsigned int * labyrinth(int w, int h, rng_t * rng) {
+  int sw = (w - 1) / 2, sh = (h - 1) / 2, i, j, * parent;
+  unsigned char * rank;
+  unsigned int * lab, * walls;
+  unsigned long nbWalls = 0;
+  lab = initLab(w, h, &parent, &rank);
+  walls = malloc(2 * sw * sh * sizeof *walls);
+  assert(walls);
+  for(i = 0; i < sh; ++i)
+    for(j = 0; j < sw; ++j) {
+      if(j + 1 < sw)
+        walls[nbWalls++] = (i * sw + j) << 1;
+      if(i + 1 < sh)
+        walls[nbWalls++] = (i * sw + j) << 1 | 1;
+    }
+  shuffle(walls, nbWalls, rng);
+  carve(lab, w, parent, rank, walls, nbWalls, sw * sh - 1);
+  free(walls);
+  free(rank);
+  free(parent);
+  return lab;
+}
+
+/*!\brief side, in rooms, of a tile of the parallel engine */
+#define TILE_ROOMS 128
+
+typedef struct tiling_t tiling_t;
+struct tiling_t {
+  unsigned int * lab;
+  int w, sw, sh, tw, th;
+  int * parent;
+  unsigned char * rank;
+  uint64_t seed;
+  SDL_atomic_t next;
+};
+
+/* generates a perfect maze inside tiles taken one after the other */
+static int tileWorker(void * data) {
+  tiling_t * t = data;
+  unsigned int * walls = malloc(2 * TILE_ROOMS * TILE_ROOMS * sizeof *walls);
+  int k;
+  assert(walls);
+  while((k = SDL_AtomicAdd(&t->next, 1)) < t->tw * t->th) {
+    int x0 = (k % t->tw) * TILE_ROOMS, y0 = (k / t->tw) * TILE_ROOMS, i, j;
+    int x1 = x0 + TILE_ROOMS < t->sw ? x0 + TILE_ROOMS : t->sw;
+    int y1 = y0 + TILE_ROOMS < t->sh ? y0 + TILE_ROOMS : t->sh;
+    unsigned long nbWalls = 0;
+    rng_t rng;
+    for(i = y0; i < y1; ++i)
+      for(j = x0; j < x1; ++j) {
+        if(j + 1 < x1)
+          walls[nbWalls++] = (i * t->sw + j) << 1;
+        if(i + 1 < y1)
+          walls[nbWalls++] = (i * t->sw + j) << 1 | 1;
+      }
+    rngSeed(&rng, t->seed ^ ((uint64_t)k * 0xd1b54a32d192ed03ull));
+    shuffle(walls, nbWalls, &rng);
+    carve(t->lab, t->w, t->parent, t->rank, walls, nbWalls, (x1 - x0) * (y1 - y0) - 1);
+  }
+  free(walls);
+  return 0;
+}
+
+/*!\brief same contract as labyrinth(), generated by \a threads
+ * threads (all the cores if <= 0) from \a seed.
+ *
+ * The rooms are split into tiles of TILE_ROOMS x TILE_ROOMS; each tile
+ * is a perfect maze carved by one thread, then a final union-find pass
+ * over the shuffled walls between tiles connects them. Every tile
+ * draws from its own rng_t seeded from \a seed and its index, thus the
+ * maze only depends on \a seed (not on the number of threads nor on
+ * the scheduling).
+ */
+unsigned int * labyrinthParallel(int w, int h, unsigned long seed, int threads) {
+  tiling_t t;
+  SDL_Thread ** th;
+  unsigned int * walls;
+  unsigned long nbWalls = 0;
+  rng_t rng;
+  int i, j;
+  memset(&t, 0, sizeof t);
+  t.lab = initLab(w, h, &t.parent, &t.rank);
+  t.w = w;
+  t.sw = (w - 1) / 2;
+  t.sh = (h - 1) / 2;
+  t.tw = (t.sw + TILE_ROOMS - 1) / TILE_ROOMS;
+  t.th = (t.sh + TILE_ROOMS - 1) / TILE_ROOMS;
+  rngSeed(&rng, seed);
+  t.seed = rngNext(&rng);
+  SDL_AtomicSet(&t.next, 0);
+  if(threads <= 0)
+    threads = SDL_GetCPUCount();
+  if(threads > t.tw * t.th)
+    threads = t.tw * t.th;
+  th = malloc(threads * sizeof *th);
+  assert(th);
+  /* the calling thread works too */
+  for(i = 1; i < threads; ++i)
+    th[i] = SDL_CreateThread(tileWorker, "labyrinth", &t);
+  tileWorker(&t);
+  for(i = 1; i < threads; ++i)
+    SDL_WaitThread(th[i], NULL);
+  free(th);
+  /* stitching: the walls on the tile borders */
+  walls = malloc((t.sw * t.th + t.sh * t.tw) * sizeof *walls);
+  assert(walls);
+  for(i = 0; i < t.sh; ++i)
+    for(j = 0; j < t.sw; ++j) {
+      if(j + 1 < t.sw && (j + 1) % TILE_ROOMS == 0)
+        walls[nbWalls++] = (i * t.sw + j) << 1;
+      if(i + 1 < t.sh && (i + 1) % TILE_ROOMS == 0)
+        walls[nbWalls++] = (i * t.sw + j) << 1 | 1;
+    }
+  shuffle(walls, nbWalls, &rng);
+  carve(t.lab, w, t.parent, t.rank, walls, nbWalls, t.tw * t.th - 1);
+  free(walls);
+  free(t.rank);
+  free(t.parent);
+  return t.lab;
+}
+
+/*!\brief checks that \a lab is a perfect maze: every room is open,
+ * every even-even cell is a wall, all the open cells are connected
+ * and there is no cycle (open cells and their adjacencies form a
+ * tree).
+ *
+ * \return 0 when perfect, 1 otherwise.
+ */
+int labyrinthCheck(const unsigned int * lab, int w, int h) {
+  int i, j, * queue, head = 0, tail = 0, open = 0, start = -1;
+  unsigned long edges = 0;
+  unsigned char * seen;
+  for(i = 0; i < h; ++i)
+    for(j = 0; j < w; ++j) {
+      int o = lab[i * w + j] != (unsigned int)-1;
+      if(((i&1) && (j&1) && !o) || (!(i&1) && !(j&1) && o))
+        return 1;
+      if(!o)
+        continue;
+      ++open;
+      start = i * w + j;
+      edges += (j + 1 < w && lab[i * w + j + 1] != (unsigned int)-1);
+      edges += (i + 1 < h && lab[(i + 1) * w + j] != (unsigned int)-1);
+    }
+  if(start < 0 || edges != (unsigned long)open - 1)
+    return 1;
+  queue = malloc(open * sizeof *queue);
+  seen = calloc(w * h, sizeof *seen);
+  assert(queue && seen);
+  queue[tail++] = start;
+  seen[start] = 1;
+  while(head < tail) {
+    const int dir[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+    int c = queue[head++], x = c % w, y = c / w;
+    for(i = 0; i < 4; ++i) {
+      int nx = x + dir[i][0], ny = y + dir[i][1], n = ny * w + nx;
+      if(nx < 0 || ny < 0 || nx >= w || ny >= h || seen[n] || lab[n] == (unsigned int)-1)
+        continue;
+      seen[n] = 1;
+      queue[tail++] = n;
+    }
+  }
+  free(seen);
+  free(queue);
+  return tail != open;
+}
+
+static unsigned int * legacy(int w, int h, rng_t * rng) {
+  srand((unsigned int)rngNext(rng));
+  return labyrinthLegacy(w, h);
+}
+
+/* generates a side x side maze with gen (or with labyrinthParallel
+ * when gen is NULL), prints its time and whether it is perfect;
+ * returns the check result */
+static int benchOne(const char * name, unsigned int * (*gen)(int, int, rng_t *), int side, int threads, double * ms) {
+  unsigned int * lab;
+  rng_t rng;
+  double t0;
+  int r;
+  rngSeed(&rng, side);
+  t0 = now_ms();
+  lab = gen ? gen(side, side, &rng) : labyrinthParallel(side, side, side, threads);
+  t0 = now_ms() - t0;
+  r = labyrinthCheck(lab, side, side);
+  fprintf(stderr, "%-9s %6dx%-6d %10.1f ms %s\n", name, side, side, t0, r ? "NOT PERFECT" : "perfect");
+  if(ms)
+    *ms = t0;
+  free(lab);
+  return r;
+}
+
+/*!\brief times labyrinth() against labyrinthLegacy(), then
+ * labyrinthParallel() from 1 to all the cores on the largest size,
+ * and checks that every generated maze is perfect and that the
+ * parallel ones do not depend on the number of threads. The legacy
+ * engine stops at 1001 (its flood fill recursion would overflow the
+ * stack beyond); the others go up to \a maxSide.
+ *
+ * \return 0 when every maze is perfect.
+ */
+int labyrinthBench(int maxSide) {
+  static const int sides[] = {101, 501, 1001, 2001, 5001, 10001};
+  int i, r = 0, side = 0, cpus = SDL_GetCPUCount();
+  double one = 0.0, ms;
+  unsigned int * ref, * lab;
+  for(i = 0; i < (int)(sizeof sides / sizeof *sides) && sides[i] <= maxSide; ++i) {
+    if(sides[i] <= 1001)
+      r |= benchOne("legacy", legacy, sides[i], 0, NULL);
+    r |= benchOne("unionfind", labyrinth, sides[i], 0, NULL);
+    side = sides[i];
+  }
+  if(!side)
+    return r;
+  for(i = 1;; i = 2 * i < cpus ? 2 * i : cpus) {
+    char name[16];
+    snprintf(name, sizeof name, "tiled/%d", i);
+    r |= benchOne(name, NULL, side, i, &ms);
+    if(i == 1)
+      one = ms;
+    fprintf(stderr, "%-9s speedup x%.2f\n", "", one / ms);
+    if(i >= cpus)
+      break;
+  }
+  ref = labyrinthParallel(side, side, 42, 1);
+  lab = labyrinthParallel(side, side, 42, cpus);
+  if(memcmp(ref, lab, side * side * sizeof *lab)) {
+    fprintf(stderr, "tiled: seed 42 differs between 1 and %d threads\n", cpus);
+    r = 1;
+  }
+  free(ref);
+  free(lab);
+  return r;
+}
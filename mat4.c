@@ -0,0 +1,155 @@
+/*!\file mat4.c
+ *
+ * \brief 4x4 matrix products and per-draw shader matrices (see
+ * mat4.h).
+ */
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#  include <xmmintrin.h>
+#  define MAT4_SSE 1
+#endif
+
+#include "mat4.h"
+#include "stats.h"
+
+/*!\brief locations of the matrices of a program, resolved once */
+typedef struct mat4Locs_t
+{
+    GLuint program;
+    GLint mvp, modelView, normal, projection;
+} mat4Locs_t;
+
+static mat4Locs_t _locs[16];
+static int _nbLocs = 0;
+
+/*!\brief r = a.b; r may alias a or b. */
+void mat4Mul(GLfloat r[16], const GLfloat a[16], const GLfloat b[16])
+{
+#ifdef MAT4_SSE
+    /* row i of r: a[i][0] b0 + a[i][1] b1 + a[i][2] b2 + a[i][3] b3 */
+    __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8), b3 = _mm_loadu_ps(b + 12);
+    for (int i = 0; i < 4; ++i)
+    {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(a[4 * i]), b0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[4 * i + 1]), b1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[4 * i + 2]), b2));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[4 * i + 3]), b3));
+        _mm_storeu_ps(r + 4 * i, row);
+    }
+#else
+    GLfloat t[16];
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            t[4 * i + j] = a[4 * i] * b[j] + a[4 * i + 1] * b[4 + j] + a[4 * i + 2] * b[8 + j] + a[4 * i + 3] * b[12 + j];
+    memcpy(r, t, sizeof t);
+#endif
+}
+
+/*!\brief r = transpose(a), i.e. a row-major matrix to column-major
+ * and back; r may alias a. */
+void mat4Transpose(GLfloat r[16], const GLfloat a[16])
+{
+#ifdef MAT4_SSE
+    __m128 r0 = _mm_loadu_ps(a), r1 = _mm_loadu_ps(a + 4), r2 = _mm_loadu_ps(a + 8), r3 = _mm_loadu_ps(a + 12);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(r, r0);
+    _mm_storeu_ps(r + 4, r1);
+    _mm_storeu_ps(r + 8, r2);
+    _mm_storeu_ps(r + 12, r3);
+#else
+    GLfloat t[16];
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            t[4 * j + i] = a[4 * i + j];
+    memcpy(r, t, sizeof t);
+#endif
+}
+
+/*!\brief normal matrix of \a m: the inverse transpose of its upper
+ * 3x3, i.e. its cofactors over its determinant (row-major 3x3). A
+ * singular \a m gives the cofactors alone, which still have the
+ * right directions. */
+void mat4NormalMatrix(GLfloat n[9], const GLfloat m[16])
+{
+    GLfloat det;
+    n[0] = m[5] * m[10] - m[6] * m[9];
+    n[1] = m[6] * m[8] - m[4] * m[10];
+    n[2] = m[4] * m[9] - m[5] * m[8];
+    n[3] = m[2] * m[9] - m[1] * m[10];
+    n[4] = m[0] * m[10] - m[2] * m[8];
+    n[5] = m[1] * m[8] - m[0] * m[9];
+    n[6] = m[1] * m[6] - m[2] * m[5];
+    n[7] = m[2] * m[4] - m[0] * m[6];
+    n[8] = m[0] * m[5] - m[1] * m[4];
+    det = m[0] * n[0] + m[1] * n[1] + m[2] * n[2];
+    if (det != 0.0f)
+    {
+        det = 1.0f / det;
+        for (int i = 0; i < 9; ++i)
+            n[i] *= det;
+    }
+}
+
+static const mat4Locs_t *locations(GLuint program)
+{
+    static mat4Locs_t spare;
+    mat4Locs_t *l = &spare;
+    for (int i = 0; i < _nbLocs; ++i)
+        if (_locs[i].program == program)
+            return &_locs[i];
+    if (_nbLocs < (int)(sizeof _locs / sizeof *_locs))
+        l = &_locs[_nbLocs++];
+    l->program = program;
+    l->mvp = STATS_CALL(glGetUniformLocation(program, "mvpMatrix"));
+    l->modelView = STATS_CALL(glGetUniformLocation(program, "modelViewMatrix"));
+    l->normal = STATS_CALL(glGetUniformLocation(program, "normalMatrix"));
+    l->projection = STATS_CALL(glGetUniformLocation(program, "projectionMatrix"));
+    return l;
+}
+
+/*!\brief copies the current gl4du model, view and projection
+ * matrices (any of them may be NULL), then binds \a bound again. */
+void mat4Current(GLfloat model[16], GLfloat view[16], GLfloat projection[16], const char *bound)
+{
+    if (model)
+    {
+        gl4duBindMatrix("modelMatrix");
+        memcpy(model, gl4duGetMatrixData(), 16 * sizeof *model);
+    }
+    if (view)
+    {
+        gl4duBindMatrix("viewMatrix");
+        memcpy(view, gl4duGetMatrixData(), 16 * sizeof *view);
+    }
+    if (projection)
+    {
+        gl4duBindMatrix("projectionMatrix");
+        memcpy(projection, gl4duGetMatrixData(), 16 * sizeof *projection);
+    }
+    gl4duBindMatrix(bound);
+}
+
+/*!\brief replaces gl4duSendMatrices: sends to \a program, in use,
+ * the MVP, model-view, normal and projection matrices its shaders
+ * read, products of the current gl4du matrices computed here so that
+ * no vertex multiplies nor inverts them again. \a bound is the gl4du
+ * matrix bound by the caller, bound again on return. */
+void mat4SendMatrices(GLuint program, const char *bound)
+{
+    const mat4Locs_t *l = locations(program);
+    GLfloat m[16], v[16], p[16], mv[16], mvp[16], n[9];
+    mat4Current(m, v, p, bound);
+    mat4Mul(mv, v, m);
+    mat4Mul(mvp, p, mv);
+    STATS_CALL(glUniformMatrix4fv(l->mvp, 1, GL_TRUE, mvp));
+    if (l->modelView >= 0)
+        STATS_CALL(glUniformMatrix4fv(l->modelView, 1, GL_TRUE, mv));
+    if (l->normal >= 0)
+    {
+        mat4NormalMatrix(n, mv);
+        STATS_CALL(glUniformMatrix3fv(l->normal, 1, GL_TRUE, n));
+    }
+    if (l->projection >= 0)
+        STATS_CALL(glUniformMatrix4fv(l->projection, 1, GL_TRUE, p));
+}
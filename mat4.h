@@ -0,0 +1,31 @@
+/*!\file mat4.h
+ *
+ * \brief 4x4 matrix products (SSE when available) and the per-draw
+ * matrices of the shaders, computed once on the CPU instead of once
+ * per vertex.
+ *
+ * Matrices are row-major, as the gl4du ones (gl4duGetMatrixData),
+ * unless stated otherwise.
+ */
+
+#ifndef _MAT4_H
+
+#define _MAT4_H
+
+#include <GL4D/gl4du.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  extern void mat4Mul(GLfloat r[16], const GLfloat a[16], const GLfloat b[16]);
+  extern void mat4Transpose(GLfloat r[16], const GLfloat a[16]);
+  extern void mat4NormalMatrix(GLfloat n[9], const GLfloat m[16]);
+  extern void mat4SendMatrices(GLuint program, const char *bound);
+  extern void mat4Current(GLfloat model[16], GLfloat view[16], GLfloat projection[16], const char *bound);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
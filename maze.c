@@ -0,0 +1,180 @@
+/*!\file maze.c
+ *
+ * \brief compact labyrinth (see maze.h).
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fileutil.h"
+#include "maze.h"
+
+#define MZ_ALIGN(x) (((x) + 63) & ~(uint64_t)63)
+
+/* sets the pointers from the offsets stored in the header */
+static void bind(maze_t *m)
+{
+    char *b = m->base;
+    m->header = (mzHeader_t *)b;
+    m->side = m->header->side;
+    m->rowWords = m->header->rowWords;
+    m->nbObjects = m->header->nbObjects;
+    m->walls = (uint64_t *)(b + m->header->wallsOffset);
+    m->objects = (mzObject_t *)(b + m->header->objectsOffset);
+}
+
+/*!\brief allocates a \a side x \a side maze without walls, with room
+ * for \a nbObjects objects. */
+int mazeCreate(maze_t *m, int side, int nbObjects)
+{
+    mzHeader_t h;
+    memset(&h, 0, sizeof h);
+    h.magic = MZ_MAGIC;
+    h.version = MZ_VERSION;
+    h.side = side;
+    h.rowWords = (side + 63) / 64;
+    h.nbObjects = nbObjects;
+    h.wallsOffset = MZ_ALIGN(sizeof h);
+    h.objectsOffset = MZ_ALIGN(h.wallsOffset + (uint64_t)side * h.rowWords * sizeof(uint64_t));
+    h.totalSize = MZ_ALIGN(h.objectsOffset + (uint64_t)nbObjects * sizeof(mzObject_t));
+    memset(m, 0, sizeof *m);
+    if (!(m->base = calloc(1, h.totalSize)))
+        return -1;
+    m->size = h.totalSize;
+    memcpy(m->base, &h, sizeof h);
+    bind(m);
+    return 0;
+}
+
+/*!\brief packs a labyrinth as returned by labyrinth() (walls are -1). */
+int mazeFromGrid(maze_t *m, const unsigned int *lab, int side, int nbObjects)
+{
+    int x, z;
+    if (mazeCreate(m, side, nbObjects) < 0)
+        return -1;
+    for (z = 0; z < side; ++z)
+        for (x = 0; x < side; ++x)
+            if (lab[(size_t)z * side + x] == (unsigned int)-1)
+                m->walls[(size_t)z * m->rowWords + (x >> 6)] |= (uint64_t)1 << (x & 63);
+    return 0;
+}
+
+static int cmpObjects(const void *a, const void *b)
+{
+    uint32_t ca = ((const mzObject_t *)a)->cell, cb = ((const mzObject_t *)b)->cell;
+    return ca < cb ? -1 : ca > cb;
+}
+
+/*!\brief sorts the object table by cell, as mazeObjectAt expects. */
+void mazeSortObjects(maze_t *m)
+{
+    qsort(m->objects, m->nbObjects, sizeof *m->objects, cmpObjects);
+}
+
+/*!\brief index of the object (not taken) lying in \a cell, -1 if
+ * none. */
+int mazeObjectAt(const maze_t *m, int cell)
+{
+    int lo = 0, hi = m->nbObjects;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (m->objects[mid].cell < (uint32_t)cell)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < m->nbObjects && m->objects[lo].cell == (uint32_t)cell && !(m->objects[lo].flags & MZ_TAKEN))
+        return lo;
+    return -1;
+}
+
+/*!\brief number of wall cells. */
+int mazeCountWalls(const maze_t *m)
+{
+    size_t i, n = (size_t)m->side * m->rowWords;
+    int count = 0;
+    for (i = 0; i < n; ++i)
+        count += __builtin_popcountll(m->walls[i]);
+    return count;
+}
+
+/*!\brief expands cells [x0, x0 + w[ x [z0, z0 + h[ to RGBA texels,
+ * as the minimap shows them: opaque white walls, transparent black
+ * rooms (row-major, \a w texels per row). */
+void mazeExpand(const maze_t *m, uint32_t *rgba, int x0, int z0, int w, int h)
+{
+    int x, z;
+    for (z = 0; z < h; ++z)
+        for (x = 0; x < w; ++x)
+            rgba[(size_t)z * w + x] = mazeIsWall(m, x0 + x, z0 + z) ? 0xffffffffu : 0u;
+}
+
+/*!\brief writes the maze to \a path (through a temporary file). */
+int mazeSave(const maze_t *m, const char *path)
+{
+    return fileWriteAtomic(path, NULL, 0, m->base, m->size);
+}
+
+/*!\brief maps the maze saved in \a path. The mapping is private: the
+ * objects taken while playing do not modify the file, and only the
+ * touched pages are read from it.
+ *
+ * \return 0 on success, -1 if the file is missing or invalid.
+ */
+int mazeLoad(maze_t *m, const char *path)
+{
+    struct stat st;
+    const mzHeader_t *h;
+    void *p;
+    int fd;
+    memset(m, 0, sizeof *m);
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof *h)
+    {
+        close(fd);
+        return -1;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+    h = p;
+    /* an odd side of at least 3 (see makeLabyrinth), then the header,
+     * the wall bit-plane and the objects table in that order, all
+     * within the file */
+    if (h->magic != MZ_MAGIC || h->version != MZ_VERSION || h->totalSize != (uint64_t)st.st_size ||
+        h->side < 3 || !(h->side & 1) || h->side > INT_MAX || h->rowWords != (h->side + 63) / 64 ||
+        h->wallsOffset < sizeof *h || h->wallsOffset % sizeof(uint64_t) != 0 ||
+        h->wallsOffset > h->objectsOffset ||
+        (uint64_t)h->side * h->rowWords * sizeof(uint64_t) > h->objectsOffset - h->wallsOffset ||
+        h->objectsOffset % sizeof(uint32_t) != 0 || h->objectsOffset > h->totalSize ||
+        h->nbObjects > INT_MAX || h->nbObjects > (h->totalSize - h->objectsOffset) / sizeof(mzObject_t))
+    {
+        munmap(p, st.st_size);
+        return -1;
+    }
+    m->base = p;
+    m->size = st.st_size;
+    m->mapped = 1;
+    bind(m);
+    return 0;
+}
+
+/*!\brief releases a maze, whether mapped or built in memory. */
+void mazeFree(maze_t *m)
+{
+    if (!m->base)
+        return;
+    if (m->mapped)
+        munmap(m->base, m->size);
+    else
+        free(m->base);
+    memset(m, 0, sizeof *m);
+}
@@ -0,0 +1,76 @@
+/*!\file maze.h
+ *
+ * \brief compact labyrinth: one bit per cell for the walls and a
+ * sparse table of the objects, stored as a single block that can be
+ * saved to a file and memory-mapped back.
+ *
+ * Rows of the wall bit-plane are padded to 64 bits, so that a row
+ * starts on a word and only the pages of the rows actually read are
+ * brought in from a mapped file. Objects are sorted by cell index.
+ */
+
+#ifndef _MAZE_H
+
+#define _MAZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MZ_MAGIC   0x315a414du /* "MAZ1" */
+#define MZ_VERSION 1
+/*!\brief set in mzObject_t::flags once the object is taken */
+#define MZ_TAKEN   1u
+
+  typedef struct mzHeader_t mzHeader_t;
+  struct mzHeader_t {
+    uint32_t magic, version, side, rowWords;
+    uint32_t nbObjects, pad;
+    uint64_t wallsOffset, objectsOffset, totalSize;
+  };
+
+  /*!\brief an object lying in cell \a cell (z * side + x) at world
+   * position (x, z) */
+  typedef struct mzObject_t mzObject_t;
+  struct mzObject_t {
+    uint32_t cell, flags;
+    float    x, z;
+  };
+
+  typedef struct maze_t maze_t;
+  struct maze_t {
+    void       *base;
+    size_t      size;
+    int         mapped;
+    mzHeader_t *header;
+    int         side, rowWords;
+    uint64_t   *walls;
+    mzObject_t *objects;
+    int         nbObjects;
+  };
+
+  extern int  mazeCreate(maze_t *m, int side, int nbObjects);
+  extern int  mazeFromGrid(maze_t *m, const unsigned int *lab, int side, int nbObjects);
+  extern void mazeSortObjects(maze_t *m);
+  extern int  mazeObjectAt(const maze_t *m, int cell);
+  extern int  mazeCountWalls(const maze_t *m);
+  extern void mazeExpand(const maze_t *m, uint32_t *rgba, int x0, int z0, int w, int h);
+  extern int  mazeSave(const maze_t *m, const char *path);
+  extern int  mazeLoad(maze_t *m, const char *path);
+  extern void mazeFree(maze_t *m);
+
+  /*!\brief 1 if cell (x, z) is a wall; the outside is a wall too */
+  static inline int mazeIsWall(const maze_t *m, int x, int z) {
+    if (x < 0 || z < 0 || x >= m->side || z >= m->side)
+      return 1;
+    return (int)((m->walls[(size_t)z * m->rowWords + (x >> 6)] >> (x & 63)) & 1);
+  }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
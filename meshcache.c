@@ -0,0 +1,240 @@
+/*!\file meshcache.c
+ *
+ * \brief binary on-disk cache of baked Assimp scenes (see meshcache.h).
+ *
+ * Nothing here depends on Assimp: a warm start only maps the file,
+ * checks its key and hands the sections to the GL upload code.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fileutil.h"
+#include "meshcache.h"
+
+#define MC_ALIGN(x) (((x) + 15) & ~(uint64_t)15)
+
+static int hashFile(const char *path, uint64_t *hash)
+{
+    struct stat st;
+    void *p;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        *hash = FILE_HASH_INIT;
+        return 0;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+    *hash = fileHash(FILE_HASH_INIT, p, st.st_size);
+    munmap(p, st.st_size);
+    return 0;
+}
+
+/* sets the section pointers from the offsets stored in the header */
+static void bind(meshCache_t *mc)
+{
+    char *b = mc->base;
+    mc->header = (mcHeader_t *)b;
+    mc->nodes = (mcNode_t *)(b + mc->header->nodesOffset);
+    mc->meshes = (mcMesh_t *)(b + mc->header->meshesOffset);
+    mc->materials = (mcMaterial_t *)(b + mc->header->materialsOffset);
+    mc->vertices = (float *)(b + mc->header->verticesOffset);
+    mc->indices = (uint32_t *)(b + mc->header->indicesOffset);
+}
+
+/* 1 if section [offset, offset + count * size[ is aligned and lies
+ * in the file */
+static int inFile(uint64_t offset, uint64_t count, uint64_t size, uint64_t totalSize)
+{
+    return offset % 16 == 0 && offset <= totalSize && count <= (totalSize - offset) / size;
+}
+
+/* checks what bind() and the loader trust in a mapped file of \a size
+ * bytes: the sections lie in the file, the nodes form one pre-order
+ * tree over the mesh table and the ranges of every mesh and level of
+ * detail lie in the vertex and index blocks. */
+static int valid(const void *base, uint64_t size)
+{
+    const mcHeader_t *h = base;
+    const mcNode_t *nodes;
+    const mcMesh_t *meshes;
+    uint64_t pending = 1, nbMeshes = 0;
+    uint32_t i, l;
+    if (!inFile(h->nodesOffset, h->nbNodes, sizeof *nodes, size) ||
+        !inFile(h->meshesOffset, h->nbMeshes, sizeof *meshes, size) ||
+        !inFile(h->materialsOffset, h->nbMaterials, sizeof(mcMaterial_t), size) ||
+        !inFile(h->verticesOffset, h->nbVertices, MC_VERTEX_FLOATS * sizeof(float), size) ||
+        !inFile(h->indicesOffset, h->nbIndices, sizeof(uint32_t), size) ||
+        h->nodesOffset < sizeof *h)
+        return 0;
+    nodes = (const mcNode_t *)((const char *)base + h->nodesOffset);
+    meshes = (const mcMesh_t *)((const char *)base + h->meshesOffset);
+    for (i = 0; i < h->nbNodes; ++i)
+    {
+        if (!pending)
+            return 0;
+        pending += (uint64_t)nodes[i].nbChildren - 1;
+        nbMeshes += nodes[i].nbMeshes;
+    }
+    if (pending || !h->nbNodes || nbMeshes > h->nbMeshes)
+        return 0;
+    for (i = 0; i < h->nbMeshes; ++i)
+    {
+        const mcMesh_t *m = &meshes[i];
+        if ((uint64_t)m->firstVertex + m->nbVertices > h->nbVertices ||
+            (uint64_t)m->firstIndex + m->nbIndices > h->nbIndices ||
+            m->material >= h->nbMaterials || m->nbLods > MC_MAX_LODS)
+            return 0;
+        for (l = 1; l < m->nbLods; ++l)
+            if ((uint64_t)m->lodFirst[l] + m->lodCount[l] > h->nbIndices)
+                return 0;
+    }
+    return 1;
+}
+
+/*!\brief builds the cache file name associated to a source file. */
+void mcPath(const char *source, char *out, size_t outSize)
+{
+    snprintf(out, outSize, "%s%s", source, MC_EXT);
+}
+
+/*!\brief allocates an empty in-memory cache with room for the given
+ * number of elements; the layout is the one written to disk. */
+int mcCreate(meshCache_t *mc, uint32_t nbNodes, uint32_t nbMeshes, uint32_t nbMaterials,
+             uint32_t nbVertices, uint32_t nbIndices)
+{
+    mcHeader_t h;
+    memset(&h, 0, sizeof h);
+    h.magic = MC_MAGIC;
+    h.version = MC_VERSION;
+    h.nbNodes = nbNodes;
+    h.nbMeshes = nbMeshes;
+    h.nbMaterials = nbMaterials;
+    h.nbVertices = nbVertices;
+    h.nbIndices = nbIndices;
+    h.nodesOffset = MC_ALIGN(sizeof h);
+    h.meshesOffset = MC_ALIGN(h.nodesOffset + nbNodes * sizeof(mcNode_t));
+    h.materialsOffset = MC_ALIGN(h.meshesOffset + nbMeshes * sizeof(mcMesh_t));
+    h.verticesOffset = MC_ALIGN(h.materialsOffset + nbMaterials * sizeof(mcMaterial_t));
+    h.indicesOffset = MC_ALIGN(h.verticesOffset + (uint64_t)nbVertices * MC_VERTEX_FLOATS * sizeof(float));
+    h.totalSize = MC_ALIGN(h.indicesOffset + (uint64_t)nbIndices * sizeof(uint32_t));
+    memset(mc, 0, sizeof *mc);
+    if (!(mc->base = calloc(1, h.totalSize)))
+        return -1;
+    mc->size = h.totalSize;
+    memcpy(mc->base, &h, sizeof h);
+    bind(mc);
+    return 0;
+}
+
+/*!\brief records the key of \a source (path, mtime, size, content
+ * hash) and the post-processing flags in the cache header. */
+int mcStamp(meshCache_t *mc, const char *source, uint32_t ppflags)
+{
+    struct stat st;
+    if (stat(source, &st) < 0 || hashFile(source, &mc->header->srcHash) < 0)
+        return -1;
+    mc->header->ppflags = ppflags;
+    mc->header->srcMtime = st.st_mtime;
+    mc->header->srcSize = st.st_size;
+    snprintf(mc->header->source, sizeof mc->header->source, "%s", source);
+    return 0;
+}
+
+/*!\brief shrinks the index block, the last one of the layout, to
+ * its first \a nbIndices indices (mcCreate takes an upper bound). */
+void mcTrimIndices(meshCache_t *mc, uint32_t nbIndices)
+{
+    mc->header->nbIndices = nbIndices;
+    mc->header->totalSize = MC_ALIGN(mc->header->indicesOffset + (uint64_t)nbIndices * sizeof(uint32_t));
+    mc->size = mc->header->totalSize;
+}
+
+/*!\brief writes the cache to \a cachePath (through a temporary file
+ * so that a concurrent reader never sees a partial file). */
+int mcWrite(const meshCache_t *mc, const char *cachePath)
+{
+    return fileWriteAtomic(cachePath, NULL, 0, mc->base, mc->size);
+}
+
+/*!\brief maps \a cachePath and checks that it was baked from the
+ * current version of \a source with the same post-processing flags.
+ *
+ * A changed mtime alone does not invalidate the cache as long as the
+ * content hash still matches (e.g. after a fresh checkout).
+ *
+ * The sections and the ranges of the meshes are checked too, so that
+ * a truncated or corrupt file is rebuilt rather than read past its end.
+ *
+ * \return 0 on success, -1 if the cache is missing, stale or corrupt.
+ */
+int mcOpen(meshCache_t *mc, const char *cachePath, const char *source, uint32_t ppflags)
+{
+    struct stat st, sst;
+    const mcHeader_t *h;
+    void *p;
+    int fd;
+    memset(mc, 0, sizeof *mc);
+    if (stat(source, &sst) < 0)
+        return -1;
+    if ((fd = open(cachePath, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof *h)
+    {
+        close(fd);
+        return -1;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+    h = p;
+    if (h->magic != MC_MAGIC || h->version != MC_VERSION || h->ppflags != ppflags ||
+        h->totalSize != (uint64_t)st.st_size || h->srcSize != (int64_t)sst.st_size ||
+        strncmp(h->source, source, sizeof h->source) != 0 || !valid(p, st.st_size))
+    {
+        munmap(p, st.st_size);
+        return -1;
+    }
+    if (h->srcMtime != (int64_t)sst.st_mtime)
+    {
+        uint64_t hash;
+        if (hashFile(source, &hash) < 0 || hash != h->srcHash)
+        {
+            munmap(p, st.st_size);
+            return -1;
+        }
+    }
+    mc->base = p;
+    mc->size = st.st_size;
+    mc->mapped = 1;
+    bind(mc);
+    return 0;
+}
+
+/*!\brief releases a cache, whether mapped or built in memory. */
+void mcFree(meshCache_t *mc)
+{
+    if (!mc->base)
+        return;
+    if (mc->mapped)
+        munmap(mc->base, mc->size);
+    else
+        free(mc->base);
+    memset(mc, 0, sizeof *mc);
+}
@@ -0,0 +1,108 @@
+/*!\file meshcache.h
+ *
+ * \brief binary on-disk cache of baked Assimp scenes.
+ *
+ * A cache file is a single block that can be memory-mapped
+ * and used in place: a header keyed by the source file (path,
+ * mtime, size, content hash) and the post-processing flags, followed
+ * by the node hierarchy, the meshes, the materials and the raw
+ * vertex/index data ready to be uploaded to GL, the meshes already
+ * reordered for the vertex cache (see meshopt.h).
+ */
+
+#ifndef _MESHCACHE_H
+
+#define _MESHCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MC_MAGIC   0x31434d41u /* "AMC1" */
+#define MC_VERSION 4
+#define MC_EXT     ".amc"
+#define MC_PATHLEN 256
+/*!\brief floats per interleaved vertex: position, normal, uv */
+#define MC_VERTEX_FLOATS 8
+/*!\brief levels of detail of a mesh, the full one included */
+#define MC_MAX_LODS 4
+
+  /*!\brief vertex attributes present in a baked mesh */
+  enum mcAttribs_t {
+    MC_POSITIONS = 1,
+    MC_NORMALS   = 2,
+    MC_TEXCOORDS = 4
+  };
+
+  typedef struct mcHeader_t mcHeader_t;
+  struct mcHeader_t {
+    uint32_t magic, version, ppflags, pad;
+    int64_t  srcMtime, srcSize;
+    uint64_t srcHash;
+    char     source[MC_PATHLEN];
+    float    min[3], max[3], center[3];
+    uint32_t nbNodes, nbMeshes, nbMaterials, nbVertices, nbIndices;
+    uint64_t nodesOffset, meshesOffset, materialsOffset, verticesOffset, indicesOffset;
+    uint64_t totalSize;
+  };
+
+  /*!\brief a node of the scene hierarchy, stored in pre-order; its
+   * meshes are the next \a nbMeshes entries of the mesh table. */
+  typedef struct mcNode_t mcNode_t;
+  struct mcNode_t {
+    float    transform[16];
+    uint32_t nbMeshes, nbChildren;
+  };
+
+  /*!\brief a mesh as uploaded to GL: \a firstVertex indexes the
+   * interleaved vertex block (missing attributes are zeroed and
+   * flagged off in \a attribs), \a firstIndex the index block;
+   * indices are relative to \a firstVertex. Level of detail l <
+   * \a nbLods is the index range (lodFirst[l], lodCount[l]) over the
+   * same vertices, level 0 being (firstIndex, nbIndices); lodError[l]
+   * is its simplification error, in the units of the mesh. */
+  typedef struct mcMesh_t mcMesh_t;
+  struct mcMesh_t {
+    uint32_t attribs, nbVertices, firstVertex, firstIndex, nbIndices, material;
+    uint32_t nbLods, lodFirst[MC_MAX_LODS], lodCount[MC_MAX_LODS];
+    float    lodError[MC_MAX_LODS];
+  };
+
+  typedef struct mcMaterial_t mcMaterial_t;
+  struct mcMaterial_t {
+    float   diffuse[4], specular[4], ambient[4], emission[4];
+    float   shininess;
+    int32_t hasTexture;
+    char    texture[MC_PATHLEN];
+  };
+
+  typedef struct meshCache_t meshCache_t;
+  struct meshCache_t {
+    void         *base;
+    size_t        size;
+    int           mapped;
+    mcHeader_t   *header;
+    mcNode_t     *nodes;
+    mcMesh_t     *meshes;
+    mcMaterial_t *materials;
+    float        *vertices;
+    uint32_t     *indices;
+  };
+
+  extern void mcPath(const char *source, char *out, size_t outSize);
+  extern int  mcCreate(meshCache_t *mc, uint32_t nbNodes, uint32_t nbMeshes, uint32_t nbMaterials,
+                       uint32_t nbVertices, uint32_t nbIndices);
+  extern int  mcStamp(meshCache_t *mc, const char *source, uint32_t ppflags);
+  extern void mcTrimIndices(meshCache_t *mc, uint32_t nbIndices);
+  extern int  mcWrite(const meshCache_t *mc, const char *cachePath);
+  extern int  mcOpen(meshCache_t *mc, const char *cachePath, const char *source, uint32_t ppflags);
+  extern void mcFree(meshCache_t *mc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
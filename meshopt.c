@@ -0,0 +1,506 @@
+/*!\file meshopt.c
+ *
+ * \brief triangle and vertex reordering of the imported meshes (see
+ * meshopt.h).
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshopt.h"
+#include "rng.h"
+#include "stats.h"
+
+/*!\brief LRU cache modelled by the scores of Forsyth's algorithm */
+#define FORSYTH_CACHE 32
+/*!\brief a cluster of meshOptOverdraw is cut as soon as its ACMR,
+ * from an empty cache, is within this factor of the whole mesh's */
+#define OVERDRAW_THRESHOLD 1.05f
+#define OVERDRAW_MIN_TRIANGLES 16
+
+/* FIFO cache simulation: a vertex is cached when it missed less than
+ * size misses ago */
+typedef struct fifo_t
+{
+    uint32_t *stamp, time;
+    int size;
+} fifo_t;
+
+static int fifoInit(fifo_t *f, uint32_t nbVertices, int size)
+{
+    f->stamp = calloc(nbVertices ? nbVertices : 1, sizeof *f->stamp);
+    f->size = size;
+    f->time = size + 1;
+    return f->stamp ? 0 : -1;
+}
+
+static void fifoClear(fifo_t *f)
+{
+    f->time += f->size + 1;
+}
+
+/* 1 on a miss */
+static int fifoFetch(fifo_t *f, uint32_t v)
+{
+    if (f->stamp[v] && f->time - f->stamp[v] <= (uint32_t)f->size)
+        return 0;
+    f->stamp[v] = ++f->time;
+    return 1;
+}
+
+/*!\brief simulates a FIFO post-transform cache of \a cacheSize
+ * entries on the triangle list \a indices. */
+meshOptStats_t meshOptAnalyze(const uint32_t *indices, uint32_t nbIndices, uint32_t nbVertices, int cacheSize)
+{
+    meshOptStats_t s = {0.0f, 0.0f};
+    unsigned char *used = calloc(nbVertices ? nbVertices : 1, 1);
+    unsigned long misses = 0, referenced = 0;
+    fifo_t f;
+    uint32_t i;
+    if (!used || fifoInit(&f, nbVertices, cacheSize) < 0)
+    {
+        free(used);
+        return s;
+    }
+    for (i = 0; i < nbIndices; ++i)
+    {
+        misses += fifoFetch(&f, indices[i]);
+        if (!used[indices[i]])
+        {
+            used[indices[i]] = 1;
+            ++referenced;
+        }
+    }
+    if (nbIndices)
+    {
+        s.acmr = misses / (nbIndices / 3.0f);
+        s.atvr = misses / (float)referenced;
+    }
+    free(f.stamp);
+    free(used);
+    return s;
+}
+
+/* score of a vertex at position pos of the LRU cache (-1 if out)
+ * with remaining triangles still to emit */
+static float vertexScore(int pos, uint32_t remaining)
+{
+    float s = 0.0f;
+    if (!remaining)
+        return -1.0f;
+    if (pos >= 0)
+        s = pos < 3 ? 0.75f : powf(1.0f - (pos - 3) / (float)(FORSYTH_CACHE - 3), 1.5f);
+    return s + 2.0f / sqrtf((float)remaining);
+}
+
+/*!\brief reorders the triangles of \a indices for the vertex cache
+ * (Forsyth, "Linear-speed vertex cache optimisation").
+ *
+ * \return 0 on success, -1 on allocation failure (indices unchanged).
+ */
+int meshOptVertexCache(uint32_t *indices, uint32_t nbIndices, uint32_t nbVertices)
+{
+    uint32_t nbTris = nbIndices / 3, *offsets, *adj, *remaining, *out, cache[FORSYTH_CACHE + 3];
+    uint32_t t, i, k, cursor = 0;
+    int *cachePos, cacheLen = 0, best = -1;
+    float *score, *triScore;
+    unsigned char *added;
+    if (nbTris < 2)
+        return 0;
+    offsets = calloc(nbVertices + 1, sizeof *offsets);
+    remaining = calloc(nbVertices, sizeof *remaining);
+    adj = malloc(3 * nbTris * sizeof *adj);
+    out = malloc(3 * nbTris * sizeof *out);
+    cachePos = malloc(nbVertices * sizeof *cachePos);
+    score = malloc(nbVertices * sizeof *score);
+    triScore = malloc(nbTris * sizeof *triScore);
+    added = calloc(nbTris, 1);
+    if (!offsets || !remaining || !adj || !out || !cachePos || !score || !triScore || !added)
+    {
+        free(offsets);
+        free(remaining);
+        free(adj);
+        free(out);
+        free(cachePos);
+        free(score);
+        free(triScore);
+        free(added);
+        return -1;
+    }
+    /* triangles of each vertex: adj[offsets[v], offsets[v] + remaining[v][ */
+    for (i = 0; i < 3 * nbTris; ++i)
+        ++offsets[indices[i] + 1];
+    for (i = 0; i < nbVertices; ++i)
+        offsets[i + 1] += offsets[i];
+    for (i = 0; i < 3 * nbTris; ++i)
+        adj[offsets[indices[i]] + remaining[indices[i]]++] = i / 3;
+    for (i = 0; i < nbVertices; ++i)
+    {
+        cachePos[i] = -1;
+        score[i] = vertexScore(-1, remaining[i]);
+    }
+    for (t = 0; t < nbTris; ++t)
+        triScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+    for (t = 0; t < nbTris; ++t)
+    {
+        uint32_t newCache[FORSYTH_CACHE + 3], *tri;
+        int newLen = 0, c;
+        float bestScore = -1.0f;
+        if (best < 0)
+        {
+            /* nothing left around the cache: next triangle in input order */
+            while (added[cursor])
+                ++cursor;
+            best = cursor;
+        }
+        tri = &indices[3 * best];
+        added[best] = 1;
+        memcpy(&out[3 * t], tri, 3 * sizeof *tri);
+        for (k = 0; k < 3; ++k)
+        {
+            uint32_t v = tri[k], *a = &adj[offsets[v]];
+            for (i = 0; a[i] != (uint32_t)best; ++i)
+                ;
+            a[i] = a[--remaining[v]];
+            newCache[newLen++] = v;
+        }
+        for (c = 0; c < cacheLen; ++c)
+            if (cache[c] != tri[0] && cache[c] != tri[1] && cache[c] != tri[2])
+                newCache[newLen++] = cache[c];
+        for (c = 0; c < newLen; ++c)
+        {
+            uint32_t v = newCache[c];
+            cachePos[v] = c < FORSYTH_CACHE ? c : -1;
+            score[v] = vertexScore(cachePos[v], remaining[v]);
+        }
+        best = -1;
+        for (c = 0; c < newLen; ++c)
+        {
+            uint32_t v = newCache[c];
+            for (i = offsets[v]; i < offsets[v] + remaining[v]; ++i)
+            {
+                uint32_t u = adj[i], *ut = &indices[3 * u];
+                triScore[u] = score[ut[0]] + score[ut[1]] + score[ut[2]];
+                if (triScore[u] > bestScore)
+                {
+                    bestScore = triScore[u];
+                    best = u;
+                }
+            }
+        }
+        cacheLen = newLen < FORSYTH_CACHE ? newLen : FORSYTH_CACHE;
+        memcpy(cache, newCache, cacheLen * sizeof *cache);
+    }
+    memcpy(indices, out, 3 * nbTris * sizeof *out);
+    free(offsets);
+    free(remaining);
+    free(adj);
+    free(out);
+    free(cachePos);
+    free(score);
+    free(triScore);
+    free(added);
+    return 0;
+}
+
+typedef struct cluster_t
+{
+    float key;
+    uint32_t first, nbTris;
+} cluster_t;
+
+static int byKey(const void *a, const void *b)
+{
+    const cluster_t *ca = a, *cb = b;
+    return ca->key > cb->key ? -1 : ca->key < cb->key ? 1 : (ca->first > cb->first) - (ca->first < cb->first);
+}
+
+/* area-weighted centroid (times 2 area) and normal (2 area long) of
+ * triangle t */
+static void triangle(const uint32_t *indices, uint32_t t, const float *vertices, int stride, float c[3], float n[3])
+{
+    const float *a = &vertices[stride * indices[3 * t]], *b = &vertices[stride * indices[3 * t + 1]],
+                *d = &vertices[stride * indices[3 * t + 2]];
+    float e0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]}, e1[3] = {d[0] - a[0], d[1] - a[1], d[2] - a[2]}, area;
+    int k;
+    n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+    n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+    n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+    area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (k = 0; k < 3; ++k)
+        c[k] = area * (a[k] + b[k] + d[k]) / 3.0f;
+}
+
+/*!\brief sorts the triangles of \a indices, already ordered for the
+ * vertex cache, to reduce overdraw: the order is cut into clusters
+ * whose cache efficiency does not depend much on what was drawn
+ * before, and the clusters are drawn outermost and outward facing
+ * first (Sander et al., "Fast triangle reordering for vertex locality
+ * and reduced overdraw"). Positions are the first three floats of
+ * each vertex of \a vertices, \a stride floats apart.
+ *
+ * \return the number of clusters, -1 on allocation failure.
+ */
+int meshOptOverdraw(uint32_t *indices, uint32_t nbIndices, const float *vertices, int stride, uint32_t nbVertices)
+{
+    uint32_t nbTris = nbIndices / 3, t, start = 0, misses = 0, *out;
+    float target = OVERDRAW_THRESHOLD * meshOptAnalyze(indices, nbIndices, nbVertices, MO_CACHE_SIZE).acmr;
+    float center[3] = {0.0f, 0.0f, 0.0f}, area = 0.0f;
+    cluster_t *clusters;
+    int nbClusters = 0, c, k;
+    fifo_t f;
+    if (nbTris < 2 * OVERDRAW_MIN_TRIANGLES)
+        return 1;
+    clusters = malloc((nbTris / OVERDRAW_MIN_TRIANGLES + 1) * sizeof *clusters);
+    out = malloc(nbIndices * sizeof *out);
+    if (!clusters || !out || fifoInit(&f, nbVertices, MO_CACHE_SIZE) < 0)
+    {
+        free(clusters);
+        free(out);
+        return -1;
+    }
+    for (t = 0; t < nbTris; ++t)
+    {
+        for (k = 0; k < 3; ++k)
+            misses += fifoFetch(&f, indices[3 * t + k]);
+        if ((t + 1 - start >= OVERDRAW_MIN_TRIANGLES && misses <= target * (t + 1 - start)) || t + 1 == nbTris)
+        {
+            clusters[nbClusters].first = start;
+            clusters[nbClusters++].nbTris = t + 1 - start;
+            start = t + 1;
+            misses = 0;
+            fifoClear(&f);
+        }
+    }
+    free(f.stamp);
+    for (t = 0; t < nbTris; ++t)
+    {
+        float tc[3], tn[3];
+        triangle(indices, t, vertices, stride, tc, tn);
+        area += sqrtf(tn[0] * tn[0] + tn[1] * tn[1] + tn[2] * tn[2]);
+        for (k = 0; k < 3; ++k)
+            center[k] += tc[k];
+    }
+    for (k = 0; k < 3 && area > 0.0f; ++k)
+        center[k] /= area;
+    for (c = 0; c < nbClusters; ++c)
+    {
+        float cc[3] = {0.0f, 0.0f, 0.0f}, cn[3] = {0.0f, 0.0f, 0.0f}, ca = 0.0f, nl;
+        for (t = clusters[c].first; t < clusters[c].first + clusters[c].nbTris; ++t)
+        {
+            float tc[3], tn[3];
+            triangle(indices, t, vertices, stride, tc, tn);
+            ca += sqrtf(tn[0] * tn[0] + tn[1] * tn[1] + tn[2] * tn[2]);
+            for (k = 0; k < 3; ++k)
+            {
+                cc[k] += tc[k];
+                cn[k] += tn[k];
+            }
+        }
+        nl = sqrtf(cn[0] * cn[0] + cn[1] * cn[1] + cn[2] * cn[2]);
+        clusters[c].key = 0.0f;
+        if (ca > 0.0f && nl > 0.0f)
+            for (k = 0; k < 3; ++k)
+                clusters[c].key += (cc[k] / ca - center[k]) * cn[k] / nl;
+    }
+    qsort(clusters, nbClusters, sizeof *clusters, byKey);
+    for (c = 0, t = 0; c < nbClusters; ++c)
+    {
+        memcpy(&out[3 * t], &indices[3 * clusters[c].first], 3 * clusters[c].nbTris * sizeof *out);
+        t += clusters[c].nbTris;
+    }
+    memcpy(indices, out, 3 * nbTris * sizeof *out);
+    free(clusters);
+    free(out);
+    return nbClusters;
+}
+
+/*!\brief renumbers the vertices in their order of first use by \a
+ * indices, moving their \a stride floats accordingly; unused vertices
+ * go last.
+ *
+ * \return 0 on success, -1 on allocation failure.
+ */
+int meshOptVertexFetch(float *vertices, int stride, uint32_t *indices, uint32_t nbIndices, uint32_t nbVertices)
+{
+    uint32_t *remap = malloc(nbVertices * sizeof *remap), i, next = 0;
+    float *tmp = malloc((size_t)nbVertices * stride * sizeof *tmp);
+    if (!remap || !tmp)
+    {
+        free(remap);
+        free(tmp);
+        return -1;
+    }
+    memset(remap, 0xff, nbVertices * sizeof *remap);
+    for (i = 0; i < nbIndices; ++i)
+    {
+        if (remap[indices[i]] == UINT32_MAX)
+            remap[indices[i]] = next++;
+        indices[i] = remap[indices[i]];
+    }
+    for (i = 0; i < nbVertices; ++i)
+    {
+        if (remap[i] == UINT32_MAX)
+            remap[i] = next++;
+        memcpy(&tmp[(size_t)remap[i] * stride], &vertices[(size_t)i * stride], stride * sizeof *tmp);
+    }
+    memcpy(vertices, tmp, (size_t)nbVertices * stride * sizeof *tmp);
+    free(remap);
+    free(tmp);
+    return 0;
+}
+
+/* test meshes: vertices (x, y, z, original id) in random order,
+ * triangles in random order */
+static void shuffle(float *vertices, uint32_t nbVertices, uint32_t *indices, uint32_t nbIndices, rng_t *rng)
+{
+    uint32_t *inv = malloc(nbVertices * sizeof *inv), i, j, tmp[3];
+    float v[4];
+    for (i = 0; i < nbVertices; ++i)
+        vertices[4 * i + 3] = (float)i;
+    for (i = nbVertices - 1; i > 0; --i)
+    {
+        j = rngBelow(rng, i + 1);
+        memcpy(v, &vertices[4 * i], sizeof v);
+        memcpy(&vertices[4 * i], &vertices[4 * j], sizeof v);
+        memcpy(&vertices[4 * j], v, sizeof v);
+    }
+    for (i = 0; i < nbVertices; ++i)
+        inv[(uint32_t)vertices[4 * i + 3]] = i;
+    for (i = 0; i < nbIndices; ++i)
+        indices[i] = inv[indices[i]];
+    for (i = nbIndices / 3 - 1; i > 0; --i)
+    {
+        j = rngBelow(rng, i + 1);
+        memcpy(tmp, &indices[3 * i], sizeof tmp);
+        memcpy(&indices[3 * i], &indices[3 * j], sizeof tmp);
+        memcpy(&indices[3 * j], tmp, sizeof tmp);
+    }
+    free(inv);
+}
+
+static int compareTriangles(const void *a, const void *b)
+{
+    const uint32_t *ta = a, *tb = b;
+    int k;
+    for (k = 0; k < 3; ++k)
+        if (ta[k] != tb[k])
+            return ta[k] < tb[k] ? -1 : 1;
+    return 0;
+}
+
+/* the triangles in original vertex ids, rotated (winding kept) to
+ * start with their smallest id, sorted */
+static uint32_t *canonicalTriangles(const float *vertices, const uint32_t *indices, uint32_t nbIndices)
+{
+    uint32_t *t = malloc(nbIndices * sizeof *t), i;
+    for (i = 0; i < nbIndices; i += 3)
+    {
+        uint32_t a = (uint32_t)vertices[4 * indices[i] + 3], b = (uint32_t)vertices[4 * indices[i + 1] + 3],
+                 c = (uint32_t)vertices[4 * indices[i + 2] + 3];
+        uint32_t r[3] = {a, b, c};
+        int s = a < b ? (a < c ? 0 : 2) : (b < c ? 1 : 2);
+        t[i] = r[s];
+        t[i + 1] = r[(s + 1) % 3];
+        t[i + 2] = r[(s + 2) % 3];
+    }
+    qsort(t, nbIndices / 3, 3 * sizeof *t, compareTriangles);
+    return t;
+}
+
+static int checkMesh(const char *name, float *vertices, uint32_t nbVertices, uint32_t *indices, uint32_t nbIndices,
+                     float maxAcmr)
+{
+    uint32_t *before = canonicalTriangles(vertices, indices, nbIndices), *after, i, next = 0;
+    meshOptStats_t s0 = meshOptAnalyze(indices, nbIndices, nbVertices, MO_CACHE_SIZE), s1, s2;
+    double t0 = now_ms(), tcache, tover;
+    int clusters, ordered = 1, same;
+    meshOptVertexCache(indices, nbIndices, nbVertices);
+    tcache = now_ms() - t0;
+    s1 = meshOptAnalyze(indices, nbIndices, nbVertices, MO_CACHE_SIZE);
+    t0 = now_ms();
+    clusters = meshOptOverdraw(indices, nbIndices, vertices, 4, nbVertices);
+    tover = now_ms() - t0;
+    s2 = meshOptAnalyze(indices, nbIndices, nbVertices, MO_CACHE_SIZE);
+    meshOptVertexFetch(vertices, 4, indices, nbIndices, nbVertices);
+    for (i = 0; i < nbIndices && ordered; ++i)
+        if (indices[i] == next)
+            ++next;
+        else
+            ordered = indices[i] < next;
+    after = canonicalTriangles(vertices, indices, nbIndices);
+    same = memcmp(before, after, nbIndices * sizeof *before) == 0;
+    fprintf(stderr, "meshopt %s: %u triangles, ACMR %.3f -> %.3f (%.1f ms) -> %.3f with %d overdraw clusters (%.1f ms), "
+                    "ATVR %.3f -> %.3f, triangles %s, fetch order %s\n",
+            name, nbIndices / 3, s0.acmr, s1.acmr, tcache, s2.acmr, clusters, tover, s0.atvr, s2.atvr,
+            same ? "kept" : "CHANGED", ordered ? "ok" : "WRONG");
+    free(before);
+    free(after);
+    return !same || !ordered || s1.acmr > maxAcmr || s2.acmr > OVERDRAW_THRESHOLD * s1.acmr + 0.01f;
+}
+
+/*!\brief optimizes a shuffled grid and a shuffled sphere, checks that
+ * their triangles (and windings) are kept, that the vertices end in
+ * fetch order and that the simulated ACMR gets below reference
+ * values. Headless.
+ *
+ * \return 0 when every check passes.
+ */
+int meshOptCheck(void)
+{
+    const int n = 128, rings = 48, segments = 96;
+    uint32_t nbVertices = (n + 1) * (n + 1), nbIndices = 6 * n * n, i, j, *indices, *q;
+    float *vertices;
+    rng_t rng;
+    int fails = 0;
+    rngSeed(&rng, 1);
+    /* grid */
+    vertices = malloc(4 * nbVertices * sizeof *vertices);
+    q = indices = malloc(nbIndices * sizeof *indices);
+    for (j = 0; j <= (uint32_t)n; ++j)
+        for (i = 0; i <= (uint32_t)n; ++i)
+        {
+            float *v = &vertices[4 * (j * (n + 1) + i)];
+            v[0] = (float)i;
+            v[1] = 0.0f;
+            v[2] = (float)j;
+        }
+    for (j = 0; j < (uint32_t)n; ++j)
+        for (i = 0; i < (uint32_t)n; ++i)
+        {
+            uint32_t a = j * (n + 1) + i, b = a + 1, c = a + n + 1, d = c + 1;
+            *q++ = a, *q++ = c, *q++ = b;
+            *q++ = b, *q++ = c, *q++ = d;
+        }
+    shuffle(vertices, nbVertices, indices, nbIndices, &rng);
+    fails += checkMesh("grid", vertices, nbVertices, indices, nbIndices, 0.75f);
+    free(vertices);
+    free(indices);
+    /* sphere (closed, the poles being rings of coincident vertices) */
+    nbVertices = (rings + 1) * (segments + 1);
+    nbIndices = 6 * rings * segments;
+    vertices = malloc(4 * nbVertices * sizeof *vertices);
+    q = indices = malloc(nbIndices * sizeof *indices);
+    for (j = 0; j <= (uint32_t)rings; ++j)
+        for (i = 0; i <= (uint32_t)segments; ++i)
+        {
+            float *v = &vertices[4 * (j * (segments + 1) + i)], th = 3.14159265f * j / rings,
+                  ph = 6.2831853f * i / segments;
+            v[0] = sinf(th) * cosf(ph);
+            v[1] = cosf(th);
+            v[2] = sinf(th) * sinf(ph);
+        }
+    for (j = 0; j < (uint32_t)rings; ++j)
+        for (i = 0; i < (uint32_t)segments; ++i)
+        {
+            uint32_t a = j * (segments + 1) + i, b = a + 1, c = a + segments + 1, d = c + 1;
+            *q++ = a, *q++ = b, *q++ = c;
+            *q++ = b, *q++ = d, *q++ = c;
+        }
+    shuffle(vertices, nbVertices, indices, nbIndices, &rng);
+    fails += checkMesh("sphere", vertices, nbVertices, indices, nbIndices, 0.75f);
+    free(vertices);
+    free(indices);
+    return fails != 0;
+}
@@ -0,0 +1,48 @@
+/*!\file meshopt.h
+ *
+ * \brief triangle and vertex reordering of the imported meshes, run
+ * once when a model is baked (see meshcache.h).
+ *
+ * meshOptVertexCache reorders the triangles for the post-transform
+ * vertex cache (Forsyth's linear-speed algorithm), meshOptOverdraw
+ * then sorts clusters of them, front-facing outer ones first, to
+ * reduce overdraw without losing much of the cache locality, and
+ * meshOptVertexFetch renumbers the vertices in their order of first
+ * use. meshOptAnalyze simulates a FIFO cache of MO_CACHE_SIZE entries
+ * and gives the average cache miss ratio (ACMR, transformed vertices
+ * per triangle, from 3 down to about 0.5) and the average transformed
+ * vertex ratio (ATVR, per vertex, 1 at best).
+ */
+
+#ifndef _MESHOPT_H
+
+#define _MESHOPT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!\brief post-transform cache simulated by the reports */
+#define MO_CACHE_SIZE 16
+
+  typedef struct meshOptStats_t meshOptStats_t;
+  struct meshOptStats_t {
+    float acmr, atvr;
+  };
+
+  extern meshOptStats_t meshOptAnalyze(const uint32_t *indices, uint32_t nbIndices, uint32_t nbVertices,
+                                       int cacheSize);
+  extern int            meshOptVertexCache(uint32_t *indices, uint32_t nbIndices, uint32_t nbVertices);
+  extern int            meshOptOverdraw(uint32_t *indices, uint32_t nbIndices, const float *vertices,
+                                        int stride, uint32_t nbVertices);
+  extern int            meshOptVertexFetch(float *vertices, int stride, uint32_t *indices,
+                                           uint32_t nbIndices, uint32_t nbVertices);
+  extern int            meshOptCheck(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,260 @@
+/*!\file prof.c
+ *
+ * \brief scoped profiling zones (see prof.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <GL4D/gl4du.h>
+
+#include "prof.h"
+#include "stats.h"
+
+/*!\brief threads (the GPU track included) that can record */
+#define PROF_THREADS 64
+/*!\brief GL_TIME_ELAPSED queries in flight */
+#define PROF_QUERIES 256
+
+typedef struct profEvent_t
+{
+    const char *name;
+    /*!\brief start and duration, in microseconds since profInit */
+    double ts, dur;
+} profEvent_t;
+
+typedef struct profThread_t
+{
+    int tid;
+    char name[32];
+    profEvent_t *ring;
+    /*!\brief events ever recorded: the last PROF_RING are in ring */
+    unsigned long count;
+    struct
+    {
+        const char *name;
+        double ts;
+        /*!\brief did this zone start a GL query */
+        int gl;
+    } stack[PROF_DEPTH];
+    int depth;
+} profThread_t;
+
+typedef struct profQuery_t
+{
+    GLuint id;
+    const char *name;
+    double ts;
+} profQuery_t;
+
+int profEnabled = 0;
+
+static const char *_filename = NULL;
+static double _t0 = 0.0;
+static profThread_t *_threads[PROF_THREADS];
+static int _nbThreads = 0;
+static SDL_SpinLock _lock = 0;
+static _Thread_local profThread_t *_self = NULL;
+/*!\brief the GPU track, GL queries ring (pending ones are in [_qTail,
+ * _qHead[) and the zones not timed for lack of a free query */
+static profThread_t *_gpuTrack = NULL;
+static profQuery_t _queries[PROF_QUERIES];
+static unsigned long _qHead = 0, _qTail = 0, _qDropped = 0;
+static int _gpu = 0, _glOpen = 0;
+
+static profThread_t *newThread(const char *name)
+{
+    profThread_t *t = calloc(1, sizeof *t);
+    if (!t || !(t->ring = malloc(PROF_RING * sizeof *t->ring)))
+    {
+        free(t);
+        return NULL;
+    }
+    SDL_AtomicLock(&_lock);
+    if (_nbThreads == PROF_THREADS)
+    {
+        SDL_AtomicUnlock(&_lock);
+        free(t->ring);
+        free(t);
+        return NULL;
+    }
+    t->tid = _nbThreads;
+    _threads[_nbThreads++] = t;
+    SDL_AtomicUnlock(&_lock);
+    if (name)
+        snprintf(t->name, sizeof t->name, "%s", name);
+    else
+        snprintf(t->name, sizeof t->name, "thread %d", t->tid);
+    return t;
+}
+
+static profThread_t *self(void)
+{
+    if (!_self)
+        _self = newThread(NULL);
+    return _self;
+}
+
+static void record(profThread_t *t, const char *name, double ts, double dur)
+{
+    profEvent_t *e = &t->ring[t->count++ % PROF_RING];
+    e->name = name;
+    e->ts = ts;
+    e->dur = dur;
+}
+
+/*!\brief enables the zones, that will be written to \a filename by
+ * profDump; \a gpu also times the GL zones on the GPU (the calling
+ * thread must own the GL context). The calling thread is named
+ * "main". */
+void profInit(const char *filename, int gpu)
+{
+    _filename = filename;
+    _t0 = 1000.0 * now_ms();
+    _gpu = gpu;
+    profThreadName("main");
+    if (gpu)
+    {
+        GLuint ids[PROF_QUERIES];
+        _gpuTrack = newThread("GPU");
+        glGenQueries(PROF_QUERIES, ids);
+        for (int i = 0; i < PROF_QUERIES; ++i)
+            _queries[i].id = ids[i];
+    }
+    profEnabled = 1;
+}
+
+/*!\brief names the track of the calling thread in the trace. */
+void profThreadName(const char *name)
+{
+    profThread_t *t = self();
+    if (t)
+        snprintf(t->name, sizeof t->name, "%s", name);
+}
+
+/*!\brief opens zone \a name on the calling thread (see PROF_BEGIN). */
+void profBegin(const char *name, int gl)
+{
+    profThread_t *t = self();
+    if (!t)
+        return;
+    if (t->depth < PROF_DEPTH)
+    {
+        t->stack[t->depth].name = name;
+        t->stack[t->depth].gl = 0;
+        if (gl && _gpu && !_glOpen)
+        {
+            if (_qHead - _qTail < PROF_QUERIES)
+            {
+                profQuery_t *q = &_queries[_qHead++ % PROF_QUERIES];
+                q->name = name;
+                q->ts = 1000.0 * now_ms() - _t0;
+                glBeginQuery(GL_TIME_ELAPSED, q->id);
+                t->stack[t->depth].gl = _glOpen = 1;
+            }
+            else
+                ++_qDropped;
+        }
+        t->stack[t->depth].ts = 1000.0 * now_ms() - _t0;
+    }
+    ++t->depth;
+}
+
+/*!\brief closes the last zone opened on the calling thread. */
+void profEnd(void)
+{
+    profThread_t *t = self();
+    double ts;
+    if (!t || t->depth <= 0)
+        return;
+    if (--t->depth >= PROF_DEPTH)
+        return;
+    ts = t->stack[t->depth].ts;
+    record(t, t->stack[t->depth].name, ts, 1000.0 * now_ms() - _t0 - ts);
+    if (t->stack[t->depth].gl)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        _glOpen = 0;
+    }
+}
+
+/*!\brief moves the GPU times already available to the GPU track,
+ * without waiting for the others; called once per frame. */
+void profFrame(void)
+{
+    while (_qTail < _qHead)
+    {
+        profQuery_t *q = &_queries[_qTail % PROF_QUERIES];
+        GLint available = 0;
+        GLuint64 ns;
+        glGetQueryObjectiv(q->id, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        glGetQueryObjectui64v(q->id, GL_QUERY_RESULT, &ns);
+        record(_gpuTrack, q->name, q->ts, ns / 1000.0);
+        ++_qTail;
+    }
+}
+
+/*!\brief writes the events still in the rings to the file given to
+ * profInit, as a Chrome trace_event JSON file. The rings are read
+ * while the other threads may record: they should be idle. Returns
+ * 0, or -1 with a message on stderr. */
+int profDump(void)
+{
+    FILE *f;
+    unsigned long events = 0;
+    const char *sep = "";
+    if (!profEnabled)
+        return 0;
+    if (!(f = fopen(_filename, "w")))
+    {
+        fprintf(stderr, "Erreur lors de l'ouverture de %s\n", _filename);
+        return -1;
+    }
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int i = 0; i < _nbThreads; ++i)
+    {
+        const profThread_t *t = _threads[i];
+        unsigned long first = t->count > PROF_RING ? t->count - PROF_RING : 0;
+        fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                sep, t->tid, t->name);
+        sep = ",\n";
+        for (unsigned long k = first; k < t->count; ++k)
+        {
+            const profEvent_t *e = &t->ring[k % PROF_RING];
+            fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}",
+                    e->name, t == _gpuTrack ? "gpu" : "cpu", e->ts, e->dur, t->tid);
+        }
+        events += t->count - first;
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    fprintf(stderr, "trace: %lu events of %d threads written to %s", events, _nbThreads, _filename);
+    if (_qDropped)
+        fprintf(stderr, " (%lu GL zones not timed on the GPU)", _qDropped);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/*!\brief disables the zones and frees the rings and the queries. */
+void profFree(void)
+{
+    if (!profEnabled)
+        return;
+    profEnabled = 0;
+    if (_gpu)
+    {
+        for (int i = 0; i < PROF_QUERIES; ++i)
+            glDeleteQueries(1, &_queries[i].id);
+        _qHead = _qTail = 0;
+    }
+    for (int i = 0; i < _nbThreads; ++i)
+    {
+        free(_threads[i]->ring);
+        free(_threads[i]);
+    }
+    _nbThreads = 0;
+    _self = _gpuTrack = NULL;
+}
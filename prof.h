@@ -0,0 +1,60 @@
+/*!\file prof.h
+ *
+ * \brief scoped profiling zones, dumped as a Chrome trace_event JSON
+ * file (chrome://tracing, Perfetto).
+ *
+ * A zone is a PROF_BEGIN("name") ... PROF_END() pair in the same
+ * function, on every path; zones nest. The name must be a string
+ * literal: only its address is kept. Each thread records its closed
+ * zones in its own ring of PROF_RING events, the oldest ones being
+ * overwritten, so recording takes no lock.
+ *
+ * Disabled (profInit not called), a zone costs the test of
+ * profEnabled; compiled with -DPROF_OFF, nothing at all.
+ *
+ * PROF_BEGIN_GL / PROF_END_GL zones, on the thread owning the GL
+ * context, are also timed on the GPU with GL_TIME_ELAPSED queries
+ * when profInit enabled them. Such queries can not nest: a GL zone
+ * opened inside another one is only timed on the CPU. Their results
+ * are collected by profFrame without waiting, a few frames later, and
+ * appear on their own "GPU" track.
+ */
+
+#ifndef _PROF_H
+
+#define _PROF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROF_RING  65536
+#define PROF_DEPTH 32
+
+  /*!\brief non-zero once profInit was called */
+  extern int profEnabled;
+
+  extern void profInit(const char *filename, int gpu);
+  extern void profThreadName(const char *name);
+  extern void profBegin(const char *name, int gl);
+  extern void profEnd(void);
+  extern void profFrame(void);
+  extern int  profDump(void);
+  extern void profFree(void);
+
+#ifdef PROF_OFF
+#  define PROF_BEGIN(name)    ((void)0)
+#  define PROF_BEGIN_GL(name) ((void)0)
+#  define PROF_END()          ((void)0)
+#else
+#  define PROF_BEGIN(name)    do { if (profEnabled) profBegin((name), 0); } while (0)
+#  define PROF_BEGIN_GL(name) do { if (profEnabled) profBegin((name), 1); } while (0)
+#  define PROF_END()          do { if (profEnabled) profEnd(); } while (0)
+#endif
+#define PROF_END_GL() PROF_END()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+/*!\file rng.c
+ *
+ * \brief small seedable pseudo-random generator (see rng.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rng.h"
+#include "stats.h"
+
+static uint64_t splitmix(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/*!\brief initializes \a rng from \a seed; close seeds (0, 1, 2...)
+ * give unrelated sequences. */
+void rngSeed(rng_t *rng, uint64_t seed)
+{
+    int i;
+    for (i = 0; i < 4; ++i)
+        rng->s[i] = splitmix(&seed);
+}
+
+/*!\brief prints the throughput of rngNext, rngBelow and rngFloat
+ * against rand() and the rand() based integers and floats window.c
+ * used to draw. */
+int rngBench(void)
+{
+    const int n = 100000000;
+    volatile uint64_t sink = 0;
+    volatile float fsink = 0.0f;
+    rng_t rng;
+    double t;
+    int i;
+    rngSeed(&rng, 1);
+    srand(1);
+    t = now_ms();
+    for (i = 0; i < n; ++i)
+        sink += rand();
+    t = now_ms() - t;
+    fprintf(stderr, "rand()          %8.2f M/s\n", n / t / 1000.0);
+    t = now_ms();
+    for (i = 0; i < n; ++i)
+        sink += rngNext(&rng);
+    t = now_ms() - t;
+    fprintf(stderr, "rngNext         %8.2f M/s\n", n / t / 1000.0);
+    t = now_ms();
+    for (i = 0; i < n; ++i)
+        sink += rand() % 1001;
+    t = now_ms() - t;
+    fprintf(stderr, "rand() %% n      %8.2f M/s\n", n / t / 1000.0);
+    t = now_ms();
+    for (i = 0; i < n; ++i)
+        sink += rngBelow(&rng, 1001);
+    t = now_ms() - t;
+    fprintf(stderr, "rngBelow        %8.2f M/s\n", n / t / 1000.0);
+    t = now_ms();
+    for (i = 0; i < n; ++i)
+        fsink += (float)rand() / (float)(RAND_MAX + 1.0);
+    t = now_ms() - t;
+    fprintf(stderr, "rand() / MAX    %8.2f M/s\n", n / t / 1000.0);
+    t = now_ms();
+    for (i = 0; i < n; ++i)
+        fsink += rngFloat(&rng);
+    t = now_ms() - t;
+    fprintf(stderr, "rngFloat        %8.2f M/s\n", n / t / 1000.0);
+    (void)sink;
+    (void)fsink;
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*!\file rng.h
+ *
+ * \brief small seedable pseudo-random generator (xoshiro256**, state
+ * seeded with splitmix64).
+ *
+ * Unlike rand(), the state is explicit: every generation function
+ * receives the generator it draws from, so that runs are reproducible
+ * from a seed and threads never share a state.
+ */
+
+#ifndef _RNG_H
+
+#define _RNG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct rng_t rng_t;
+  struct rng_t {
+    uint64_t s[4];
+  };
+
+  extern void   rngSeed(rng_t *rng, uint64_t seed);
+  extern int    rngBench(void);
+
+  static inline uint64_t rngRotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  /*!\brief next 64 random bits */
+  static inline uint64_t rngNext(rng_t *rng) {
+    uint64_t *s = rng->s, r = rngRotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rngRotl(s[3], 45);
+    return r;
+  }
+
+  /*!\brief uniform integer in [0, n[ (n < 2^32, Lemire's multiply
+   * and shift, without the rejection step: the bias is below 2^-32) */
+  static inline uint32_t rngBelow(rng_t *rng, uint32_t n) {
+    return (uint32_t)(((rngNext(rng) >> 32) * (uint64_t)n) >> 32);
+  }
+
+  /*!\brief uniform float in [0, 1[ */
+  static inline float rngFloat(rng_t *rng) {
+    return (rngNext(rng) >> 40) * (1.0f / 16777216.0f);
+  }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
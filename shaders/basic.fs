@@ -1,7 +1,7 @@
 #version 330
+/* COMPLEX_OBJECT, HAS_TEXTURE and BORDER are set by shadervar.c, one
+ * program per combination */
 uniform sampler2D tex;
-uniform int border;
-uniform int complex_object;
 
 out vec4 fragColor;
 
@@ -9,12 +9,14 @@ out vec4 fragColor;
 uniform vec4 lumpos;
 
 uniform sampler2D myTexture;
-uniform int hasTexture;
-uniform vec4 diffuse_color;
-uniform vec4 specular_color;
-uniform vec4 ambient_color;
-uniform vec4 emission_color;
-uniform float shininess;
+/* filled once at load time by assimp_mult.c (materialBlock_t) */
+layout(std140) uniform Material {
+  vec4 diffuse_color;
+  vec4 specular_color;
+  vec4 ambient_color;
+  vec4 emission_color;
+  float shininess;
+};
 
 in vec2 vsoTexCoord;
 in vec3 vsoNormal;
@@ -29,28 +31,31 @@ void complex_geometry(void){
 
     vec4 diffuseReflection = ambient_color*0.2 +diffuse_color * diffuse;
     fragColor = diffuseReflection + specularReflection;
-    if(hasTexture != 0)
-      fragColor *= texture(myTexture, vsoTexCoord);
+#ifdef HAS_TEXTURE
+    fragColor *= texture(myTexture, vsoTexCoord);
+#endif
    
 }
 
 
 void simple_geometry(void){
-    if( border != 0 && (vsoTexCoord.s < 0.02 ||
-		      vsoTexCoord.t < 0.02 ||
-		      (1 - vsoTexCoord.s) < 0.02 || 
-		      (1 - vsoTexCoord.t) < 0.02 ) )
+#ifdef BORDER
+    if( vsoTexCoord.s < 0.02 ||
+	vsoTexCoord.t < 0.02 ||
+	(1 - vsoTexCoord.s) < 0.02 || 
+	(1 - vsoTexCoord.t) < 0.02 )
     fragColor = vec4(0.5, 0, 0, 1);
   else
+#endif
     fragColor = texture(tex, vsoTexCoord);
 }
 
 
 
 void main(void) {
-  if (complex_object == 1){
-    complex_geometry();
-  }else{
-    simple_geometry();
-  }
+#ifdef COMPLEX_OBJECT
+  complex_geometry();
+#else
+  simple_geometry();
+#endif
 }
@@ -1,30 +1,51 @@
 #version 330
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
+/* products computed once per draw on the CPU (mat4SendMatrices), not
+ * once per vertex */
+uniform mat4 mvpMatrix;
+uniform mat4 modelViewMatrix;
+uniform mat3 normalMatrix;
 uniform mat4 projectionMatrix;
 uniform float texRepeat;
 
 layout (location = 0) in vec3 vsiPosition;
 layout (location = 1) in vec3 vsiNormal;
 layout (location = 2) in vec2 vsiTexCoord;
- 
+/* per-instance (x, z, h, w) of a wall (INSTANCED) */
+layout (location = 3) in vec4 vsiInstance;
+/* per-instance model-view and normal matrices of an Assimp object
+ * (COMPLEX_OBJECT and INSTANCED) */
+layout (location = 4) in mat4 vsiModelView;
+layout (location = 8) in mat3 vsiNormalMatrix;
+
 out vec2 vsoTexCoord;
 out vec3 vsoNormal;
 out vec4 vsoModPosition;
 
-uniform int complex_object;
+/* COMPLEX_OBJECT (the Assimp meshes) and INSTANCED are set by
+ * shadervar.c, one program per combination */
 void main(void) {
-  if (complex_object == 1){
-    mat4 modelViewMatrix = viewMatrix * modelMatrix;
-    vsoNormal = (transpose(inverse(modelViewMatrix)) * vec4(vsiNormal.xyz, 0.0)).xyz;
-    vsoModPosition = modelViewMatrix * vec4(vsiPosition.xyz, 1.0);
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vsiPosition.xyz, 1.0);
-    vsoTexCoord = vec2(vsiTexCoord.x, 1.0 - vsiTexCoord.y);
-    
-  }else{
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vsiPosition.xyz, 1.0);
-    vsoTexCoord = texRepeat * vsiTexCoord;
-
-  }
+#ifdef COMPLEX_OBJECT
+#ifdef INSTANCED
+  mat4 mv = vsiModelView;
+  mat3 nm = vsiNormalMatrix;
+#else
+  mat4 mv = modelViewMatrix;
+  mat3 nm = normalMatrix;
+#endif
+  vsoNormal = nm * vsiNormal;
+  vsoModPosition = mv * vec4(vsiPosition.xyz, 1.0);
+  gl_Position = projectionMatrix * vsoModPosition;
+  vsoTexCoord = vec2(vsiTexCoord.x, 1.0 - vsiTexCoord.y);
+#else
+#ifdef INSTANCED
+  /* translate(x, 10, z) * scale(h, 10, w), as the per-wall path does */
+  vec4 p = vec4(vsiInstance.x + vsiInstance.z * vsiPosition.x, 10.0 + 10.0 * vsiPosition.y,
+                vsiInstance.y + vsiInstance.w * vsiPosition.z, 1.0);
+#else
+  vec4 p = vec4(vsiPosition.xyz, 1.0);
+#endif
+  gl_Position = mvpMatrix * p;
+  vsoTexCoord = texRepeat * vsiTexCoord;
+#endif
 }
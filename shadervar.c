@@ -0,0 +1,456 @@
+/*!\file shadervar.c
+ *
+ * \brief specialized shader variants (see shadervar.h).
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fileutil.h"
+#include "shadervar.h"
+#include "stats.h"
+
+/*!\brief runs of draws measured and not yet collected */
+#define SV_SPANS 64
+/*!\brief "SVPB": shader variant program binary */
+#define SV_MAGIC   0x42505653u
+#define SV_VERSION 1
+
+/*!\brief header of a cached program binary, followed by its \a length
+ * bytes */
+typedef struct svHeader_t
+{
+    uint32_t magic, version;
+    /*!\brief hash of the sources, the defines and the driver strings */
+    uint64_t key;
+    uint32_t format, length;
+} svHeader_t;
+
+typedef struct shaderVar_t
+{
+    GLuint program;
+    int failed, cached;
+    double buildMs;
+    /*!\brief sums of the collected spans */
+    unsigned long spans;
+    GLuint64 ns, samples;
+} shaderVar_t;
+
+typedef struct svSpan_t
+{
+    GLuint time, samples;
+    unsigned int key;
+} svSpan_t;
+
+static const char *_defines[] = {"COMPLEX_OBJECT", "HAS_TEXTURE", "BORDER", "INSTANCED"};
+
+static char *_vsFile = NULL, *_fsFile = NULL, *_vsSrc = NULL, *_fsSrc = NULL;
+/*!\brief program binaries cache: enabled, and how the variants were
+ * built */
+static int _cache = 1, _noFormat = 0, _loaded = 0, _compiled = 0, _rejected = 0;
+static double _buildMs = 0.0;
+static shaderVar_t _variants[SV_VARIANTS];
+static int _current = -1;
+/*!\brief span queries ring (pending ones are in [_tail, _head[), the
+ * variant of the open span (-1 if none) and the spans not measured for
+ * lack of a free query */
+static int _timing = 0, _spanKey = -1;
+static svSpan_t _spans[SV_SPANS];
+static unsigned long _head = 0, _tail = 0, _dropped = 0;
+
+static char *read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    char *s = NULL;
+    long n;
+    if (!f)
+        return NULL;
+    if (fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0 &&
+        (s = malloc(n + 1)) != NULL)
+    {
+        if (fread(s, 1, n, f) != (size_t)n)
+        {
+            free(s);
+            s = NULL;
+        }
+        else
+            s[n] = '\0';
+    }
+    fclose(f);
+    return s;
+}
+
+/* the #define lines of variant key */
+static void defines(unsigned int key, char *buf, size_t size)
+{
+    buf[0] = '\0';
+    for (unsigned int b = 0; b < sizeof _defines / sizeof *_defines; ++b)
+        if (key & (1u << b))
+        {
+            size_t l = strlen(buf);
+            snprintf(buf + l, size - l, "#define %s 1\n", _defines[b]);
+        }
+}
+
+/* compiles src with the defines inserted after its #version line, 0
+ * on error */
+static GLuint compile(GLenum type, const char *path, const char *src, const char *defs, unsigned int key)
+{
+    char version[64] = "", line[16];
+    const char *strings[4], *body = src;
+    GLuint id = glCreateShader(type);
+    GLint ok;
+    if (strncmp(src, "#version", 8) == 0)
+    {
+        const char *eol = strchr(src, '\n');
+        size_t l = eol ? (size_t)(eol - src + 1) : strlen(src);
+        if (l < sizeof version)
+        {
+            memcpy(version, src, l);
+            version[l] = '\0';
+            body = src + l;
+        }
+    }
+    /* error messages keep the line numbers of the file */
+    snprintf(line, sizeof line, "#line %d\n", body == src ? 1 : 2);
+    strings[0] = version;
+    strings[1] = defs;
+    strings[2] = line;
+    strings[3] = body;
+    glShaderSource(id, 4, strings, NULL);
+    glCompileShader(id);
+    glGetShaderiv(id, GL_COMPILE_STATUS, &ok);
+    if (!ok)
+    {
+        char log[4096];
+        glGetShaderInfoLog(id, sizeof log, NULL, log);
+        fprintf(stderr, "Erreur lors de la compilation de %s (variante %s) :\n%s\n", path, shaderVarName(key), log);
+        glDeleteShader(id);
+        return 0;
+    }
+    return id;
+}
+
+static GLuint build(unsigned int key, const char *defs)
+{
+    GLuint vs, fs, p = 0;
+    GLint ok;
+    if (!(vs = compile(GL_VERTEX_SHADER, _vsFile, _vsSrc, defs, key)))
+        return 0;
+    if ((fs = compile(GL_FRAGMENT_SHADER, _fsFile, _fsSrc, defs, key)))
+    {
+        p = glCreateProgram();
+        glAttachShader(p, vs);
+        glAttachShader(p, fs);
+        if (_cache)
+            glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(p);
+        glGetProgramiv(p, GL_LINK_STATUS, &ok);
+        if (!ok)
+        {
+            char log[4096];
+            glGetProgramInfoLog(p, sizeof log, NULL, log);
+            fprintf(stderr, "Erreur lors de l'edition de liens de %s et %s (variante %s) :\n%s\n",
+                    _vsFile, _fsFile, shaderVarName(key), log);
+            glDeleteProgram(p);
+            p = 0;
+        }
+        glDeleteShader(fs);
+    }
+    glDeleteShader(vs);
+    return p;
+}
+
+/* the cache file of variant key, next to the vertex shader */
+static void cache_path(unsigned int key, char *path, size_t size)
+{
+    snprintf(path, size, "%s.%u.pbin", _vsFile, key);
+}
+
+/* the key of a cached binary: what the program is built from and the
+ * driver that built it, whose binaries no other driver can load */
+static uint64_t cache_key(const char *defs)
+{
+    const char *strings[] = {_vsSrc, _fsSrc, defs, (const char *)glGetString(GL_VENDOR),
+                             (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION)};
+    uint64_t h = FILE_HASH_INIT;
+    for (size_t i = 0; i < sizeof strings / sizeof *strings; ++i)
+        if (strings[i])
+            /* with its terminating '\0', as a separator */
+            h = fileHash(h, strings[i], strlen(strings[i]) + 1);
+    return h;
+}
+
+/* the program of variant key from its cached binary, 0 if the cache is
+ * missing, stale or rejected by the driver */
+static GLuint cache_load(unsigned int key, uint64_t hash)
+{
+    char path[BUFSIZ];
+    svHeader_t h;
+    void *binary;
+    GLuint p = 0;
+    GLint ok;
+    FILE *f;
+    cache_path(key, path, sizeof path);
+    if (!(f = fopen(path, "rb")))
+        return 0;
+    if (fread(&h, sizeof h, 1, f) == 1 && h.magic == SV_MAGIC && h.version == SV_VERSION && h.key == hash &&
+        (binary = malloc(h.length ? h.length : 1)) != NULL)
+    {
+        if (fread(binary, 1, h.length, f) == h.length)
+        {
+            p = glCreateProgram();
+            glProgramBinary(p, h.format, binary, h.length);
+            glGetProgramiv(p, GL_LINK_STATUS, &ok);
+            if (!ok)
+            {
+                /* e.g. a driver update that kept its version string */
+                ++_rejected;
+                glDeleteProgram(p);
+                p = 0;
+            }
+        }
+        free(binary);
+    }
+    fclose(f);
+    return p;
+}
+
+/* writes the binary of program p, preceded by its header */
+static void cache_save(unsigned int key, uint64_t hash, GLuint p)
+{
+    char path[BUFSIZ];
+    svHeader_t h = {SV_MAGIC, SV_VERSION, hash, 0, 0};
+    GLint length = 0;
+    GLenum format;
+    void *binary;
+    glGetProgramiv(p, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0 || !(binary = malloc(length)))
+        return;
+    glGetProgramBinary(p, length, NULL, &format, binary);
+    h.format = format;
+    h.length = length;
+    cache_path(key, path, sizeof path);
+    if (fileWriteAtomic(path, &h, sizeof h, binary, length) != 0)
+        fprintf(stderr, "Erreur lors de l'ecriture du cache %s\n", path);
+    free(binary);
+}
+
+/*!\brief enables (the default) or disables the program binaries
+ * cache, before the first variant is built. A variant is then loaded
+ * from <vertex shader>.<key>.pbin when its key still matches, built
+ * from the sources and saved there otherwise. */
+void shaderVarCache(int enable)
+{
+    GLint formats = 0;
+    if (enable)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    _noFormat = enable && formats <= 0;
+    _cache = formats > 0;
+}
+
+/*!\brief loads the sources \a vs and \a fs of the variants. */
+void shaderVarInit(const char *vs, const char *fs)
+{
+    _vsFile = strdup(vs);
+    _fsFile = strdup(fs);
+    if (!(_vsSrc = read_file(vs)))
+        fprintf(stderr, "Erreur lors de la lecture de %s\n", vs);
+    if (!(_fsSrc = read_file(fs)))
+        fprintf(stderr, "Erreur lors de la lecture de %s\n", fs);
+}
+
+/*!\brief the program of variant \a key, built (or loaded from the
+ * cache) on its first use; 0 if it does not compile (the error is only
+ * reported once). */
+GLuint shaderVarGet(unsigned int key)
+{
+    shaderVar_t *v = &_variants[key % SV_VARIANTS];
+    if (!v->program && !v->failed && _vsSrc && _fsSrc)
+    {
+        double t0 = now_ms();
+        char defs[256];
+        uint64_t hash = 0;
+        key %= SV_VARIANTS;
+        defines(key, defs, sizeof defs);
+        if (_cache)
+        {
+            hash = cache_key(defs);
+            v->cached = (v->program = cache_load(key, hash)) != 0;
+        }
+        if (!v->program && (v->program = build(key, defs)) && _cache)
+            cache_save(key, hash, v->program);
+        v->failed = !v->program;
+        v->buildMs = now_ms() - t0;
+        _buildMs += v->buildMs;
+        if (v->cached)
+            ++_loaded;
+        else if (v->program)
+            ++_compiled;
+    }
+    return v->program;
+}
+
+static void span_end(void)
+{
+    if (_spanKey < 0)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    glEndQuery(GL_SAMPLES_PASSED);
+    _spanKey = -1;
+}
+
+static void span_begin(unsigned int key)
+{
+    svSpan_t *s;
+    if (_head - _tail >= SV_SPANS)
+    {
+        ++_dropped;
+        return;
+    }
+    s = &_spans[_head++ % SV_SPANS];
+    s->key = key;
+    glBeginQuery(GL_TIME_ELAPSED, s->time);
+    glBeginQuery(GL_SAMPLES_PASSED, s->samples);
+    _spanKey = key;
+}
+
+/*!\brief makes variant \a key the program in use, if it is not
+ * already, and returns it. */
+GLuint shaderVarUse(unsigned int key)
+{
+    GLuint p = shaderVarGet(key);
+    key %= SV_VARIANTS;
+    if ((int)key != _current)
+    {
+        glUseProgram(p);
+        STATS_PROGRAM();
+        _current = key;
+    }
+    if (_timing && (int)key != _spanKey)
+    {
+        span_end();
+        span_begin(key);
+    }
+    return p;
+}
+
+/*!\brief the #define names of variant \a key, "default" for none. */
+const char *shaderVarName(unsigned int key)
+{
+    static char names[SV_VARIANTS][64];
+    char *n = names[key % SV_VARIANTS];
+    if (!n[0])
+    {
+        for (unsigned int b = 0; b < sizeof _defines / sizeof *_defines; ++b)
+            if (key & (1u << b))
+            {
+                size_t l = strlen(n);
+                snprintf(n + l, sizeof names[0] - l, "%s%s", l ? " " : "", _defines[b]);
+            }
+        if (!n[0])
+            strcpy(n, "default");
+    }
+    return n;
+}
+
+/*!\brief enables (or disables) the measure of the draws of each
+ * variant; the thread must own the GL context. */
+void shaderVarTiming(int enable)
+{
+    if (enable && !_timing)
+        for (int i = 0; i < SV_SPANS; ++i)
+        {
+            glGenQueries(1, &_spans[i].time);
+            glGenQueries(1, &_spans[i].samples);
+        }
+    else if (!enable && _timing)
+    {
+        span_end();
+        for (int i = 0; i < SV_SPANS; ++i)
+        {
+            glDeleteQueries(1, &_spans[i].time);
+            glDeleteQueries(1, &_spans[i].samples);
+        }
+        _head = _tail = 0;
+    }
+    _timing = enable;
+}
+
+/*!\brief closes the open span and adds the measures already
+ * available to their variant, without waiting for the others; called
+ * once per frame. */
+void shaderVarFrame(void)
+{
+    if (!_timing)
+        return;
+    span_end();
+    while (_tail < _head)
+    {
+        svSpan_t *s = &_spans[_tail % SV_SPANS];
+        shaderVar_t *v = &_variants[s->key];
+        GLint available = 0;
+        GLuint64 ns, samples;
+        glGetQueryObjectiv(s->samples, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        glGetQueryObjectui64v(s->time, GL_QUERY_RESULT, &ns);
+        glGetQueryObjectui64v(s->samples, GL_QUERY_RESULT, &samples);
+        v->ns += ns;
+        v->samples += samples;
+        ++v->spans;
+        ++_tail;
+    }
+}
+
+/*!\brief prints how the variants built so far were built. */
+void shaderVarReport(void)
+{
+    fprintf(stderr, "shadervar: %d variants loaded from the cache, %d compiled", _loaded, _compiled);
+    if (_rejected)
+        fprintf(stderr, " (%d cached binaries rejected)", _rejected);
+    fprintf(stderr, " in %.1f ms%s\n", _buildMs,
+            _cache ? "" : _noFormat ? ", no program binary format" : ", cache disabled");
+}
+
+/*!\brief writes the built variants, their build time and, when
+ * measured, the GPU time and samples of their draws, as a JSON
+ * array. */
+void shaderVarWriteJson(FILE *f)
+{
+    const char *sep = "";
+    fprintf(f, "[");
+    for (unsigned int k = 0; k < SV_VARIANTS; ++k)
+    {
+        const shaderVar_t *v = &_variants[k];
+        if (!v->program)
+            continue;
+        fprintf(f, "%s\n    {\"variant\": \"%s\", \"cached\": %d, \"build_ms\": %.3f, \"spans\": %lu, \"gpu_ms\": %.4f, "
+                   "\"samples\": %llu, \"ns_per_sample\": %.4f}",
+                sep, shaderVarName(k), v->cached, v->buildMs, v->spans, v->ns / 1e6, (unsigned long long)v->samples,
+                v->samples ? v->ns / (double)v->samples : 0.0);
+        sep = ",";
+    }
+    fprintf(f, "\n  ]");
+    if (_dropped)
+        fprintf(stderr, "shadervar: %lu runs of draws not measured\n", _dropped);
+}
+
+/*!\brief deletes the variants and frees their sources. */
+void shaderVarFree(void)
+{
+    shaderVarTiming(0);
+    for (int k = 0; k < SV_VARIANTS; ++k)
+        if (_variants[k].program)
+            glDeleteProgram(_variants[k].program);
+    memset(_variants, 0, sizeof _variants);
+    _current = -1;
+    _loaded = _compiled = _rejected = 0;
+    _buildMs = 0.0;
+    free(_vsFile);
+    free(_fsFile);
+    free(_vsSrc);
+    free(_fsSrc);
+    _vsFile = _fsFile = _vsSrc = _fsSrc = NULL;
+}
@@ -0,0 +1,57 @@
+/*!\file shadervar.h
+ *
+ * \brief specialized programs compiled from the same vertex and
+ * fragment shader sources, one per combination of #define (variant
+ * key), instead of one program branching on uniforms.
+ *
+ * A variant is compiled on its first use and kept until shaderVarFree.
+ * Unless shaderVarCache disables it, its program binary is cached on
+ * disk (glGetProgramBinary), keyed by the sources, the defines and the
+ * GL vendor, renderer and version strings: the next launches load it
+ * (glProgramBinary) instead of compiling, and compile again whenever
+ * the key changed or the driver rejects the binary.
+ *
+ * shaderVarUse only switches programs when the variant changes, so
+ * draws submitted grouped by variant cost one switch per group.
+ *
+ * When enabled by shaderVarTiming, each run of draws between two
+ * switches is measured with GL_TIME_ELAPSED and GL_SAMPLES_PASSED
+ * queries, collected by shaderVarFrame: the GPU time per sample of a
+ * variant is its fragment cost. These queries can not be mixed with
+ * the GPU zones of prof.h.
+ */
+
+#ifndef _SHADERVAR_H
+
+#define _SHADERVAR_H
+
+#include <stdio.h>
+#include <GL4D/gl4du.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!\brief variant bits, each one a #define of the sources */
+#define SV_COMPLEX  1 /* COMPLEX_OBJECT: lit Assimp meshes */
+#define SV_TEXTURE  2 /* HAS_TEXTURE: their material is textured */
+#define SV_BORDER   4 /* BORDER: red frame, for the minimap */
+#define SV_INSTANCED 8 /* INSTANCED: placed by per-instance attributes */
+#define SV_VARIANTS 16
+
+  extern void        shaderVarInit(const char *vs, const char *fs);
+  extern void        shaderVarCache(int enable);
+  extern GLuint      shaderVarGet(unsigned int key);
+  extern GLuint      shaderVarUse(unsigned int key);
+  extern const char *shaderVarName(unsigned int key);
+  extern void        shaderVarTiming(int enable);
+  extern void        shaderVarFrame(void);
+  extern void        shaderVarReport(void);
+  extern void        shaderVarWriteJson(FILE *f);
+  extern void        shaderVarFree(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
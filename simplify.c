@@ -0,0 +1,630 @@
+/*!\file simplify.c
+ *
+ * \brief quadric error simplification of the imported meshes (see
+ * simplify.h).
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rng.h"
+#include "simplify.h"
+#include "stats.h"
+
+/*!\brief a collapse may not turn the normal of a triangle by more
+ * than acos(FLIP_COS) */
+#define FLIP_COS 0.25f
+#define MAX_PASSES 64
+
+/* symmetric 4x4 matrix: a2 ab ac ad b2 bc bd c2 cd d2 */
+typedef struct quadric_t
+{
+    double q[10];
+} quadric_t;
+
+/* a candidate: collapse of vertex from onto vertex to */
+typedef struct collapse_t
+{
+    uint32_t from, to;
+    float cost;
+} collapse_t;
+
+typedef struct simplifier_t
+{
+    const float *vertices;
+    int stride;
+    uint32_t nbVertices;
+    /* vertices at the same position form a circular list through
+     * wedge, their first one being their position id */
+    uint32_t *position, *wedge;
+    quadric_t *quadrics;
+    /* triangles of each position id for the current pass */
+    uint32_t *offsets, *triangles;
+    unsigned char *border, *locked, *alive;
+    uint32_t *remap;
+} simplifier_t;
+
+static const float *pos(const simplifier_t *s, uint32_t v)
+{
+    return &s->vertices[(size_t)s->stride * v];
+}
+
+static void sub(float r[3], const float a[3], const float b[3])
+{
+    r[0] = a[0] - b[0];
+    r[1] = a[1] - b[1];
+    r[2] = a[2] - b[2];
+}
+
+static void cross(float r[3], const float a[3], const float b[3])
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/* adds the plane through p of unit normal n, times w */
+static void addPlane(quadric_t *q, const float n[3], const float p[3], double w)
+{
+    double a = n[0], b = n[1], c = n[2], d = -(a * p[0] + b * p[1] + c * p[2]);
+    q->q[0] += w * a * a;
+    q->q[1] += w * a * b;
+    q->q[2] += w * a * c;
+    q->q[3] += w * a * d;
+    q->q[4] += w * b * b;
+    q->q[5] += w * b * c;
+    q->q[6] += w * b * d;
+    q->q[7] += w * c * c;
+    q->q[8] += w * c * d;
+    q->q[9] += w * d * d;
+}
+
+static double evaluate(const quadric_t *q, const float p[3])
+{
+    double x = p[0], y = p[1], z = p[2];
+    const double *m = q->q;
+    double e = m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x + m[4] * y * y + 2 * m[5] * y * z +
+               2 * m[6] * y + m[7] * z * z + 2 * m[8] * z + m[9];
+    return e > 0.0 ? e : 0.0;
+}
+
+typedef struct sorted_t
+{
+    float p[3];
+    uint32_t v;
+} sorted_t;
+
+static int byPosition(const void *a, const void *b)
+{
+    const sorted_t *sa = a, *sb = b;
+    int k;
+    for (k = 0; k < 3; ++k)
+        if (sa->p[k] != sb->p[k])
+            return sa->p[k] < sb->p[k] ? -1 : 1;
+    return (sa->v > sb->v) - (sa->v < sb->v);
+}
+
+/* position ids: vertices sorted by position, equal runs linked, the
+ * smallest vertex of a run being its id */
+static int weld(simplifier_t *s)
+{
+    sorted_t *order = malloc(s->nbVertices * sizeof *order);
+    uint32_t i, j, k;
+    if (!order)
+        return -1;
+    for (i = 0; i < s->nbVertices; ++i)
+    {
+        memcpy(order[i].p, pos(s, i), sizeof order[i].p);
+        order[i].v = i;
+    }
+    qsort(order, s->nbVertices, sizeof *order, byPosition);
+    for (i = 0; i < s->nbVertices; i = j)
+    {
+        for (j = i + 1; j < s->nbVertices && memcmp(order[j].p, order[i].p, sizeof order[i].p) == 0; ++j)
+            ;
+        for (k = i; k < j; ++k)
+        {
+            s->position[order[k].v] = order[i].v;
+            s->wedge[order[k].v] = order[k + 1 < j ? k + 1 : i].v;
+        }
+    }
+    free(order);
+    return 0;
+}
+
+/* triangles of position p containing position q, and the last one */
+static int shared(const simplifier_t *s, const uint32_t *idx, uint32_t p, uint32_t q, uint32_t *last)
+{
+    uint32_t i;
+    int n = 0;
+    for (i = s->offsets[p]; i < s->offsets[p + 1]; ++i)
+    {
+        const uint32_t *t = &idx[3 * s->triangles[i]];
+        if (s->position[t[0]] == q || s->position[t[1]] == q || s->position[t[2]] == q)
+        {
+            ++n;
+            if (last)
+                *last = s->triangles[i];
+        }
+    }
+    return n;
+}
+
+/* per pass: triangles of each position, borders, live vertices */
+static int adjacency(simplifier_t *s, const uint32_t *idx, uint32_t nbTris)
+{
+    uint32_t i, k, n = s->nbVertices;
+    memset(s->offsets, 0, (n + 1) * sizeof *s->offsets);
+    memset(s->border, 0, n);
+    memset(s->alive, 0, n);
+    for (i = 0; i < 3 * nbTris; ++i)
+    {
+        ++s->offsets[s->position[idx[i]] + 1];
+        s->alive[idx[i]] = 1;
+    }
+    for (i = 0; i < n; ++i)
+        s->offsets[i + 1] += s->offsets[i];
+    for (i = 0; i < 3 * nbTris; ++i)
+    {
+        uint32_t p = s->position[idx[i]];
+        s->triangles[s->offsets[p]++] = i / 3;
+    }
+    for (i = n; i > 0; --i)
+        s->offsets[i] = s->offsets[i - 1];
+    s->offsets[0] = 0;
+    for (i = 0; i < nbTris; ++i)
+        for (k = 0; k < 3; ++k)
+        {
+            uint32_t a = s->position[idx[3 * i + k]], b = s->position[idx[3 * i + (k + 1) % 3]];
+            if (shared(s, idx, a, b, NULL) == 1)
+                s->border[a] = s->border[b] = 1;
+        }
+    return 0;
+}
+
+/* the quadrics of the full mesh: its planes, and planes perpendicular
+ * to it along the open borders */
+static void quadrics(simplifier_t *s, const uint32_t *idx, uint32_t nbTris)
+{
+    uint32_t i, k;
+    memset(s->quadrics, 0, s->nbVertices * sizeof *s->quadrics);
+    for (i = 0; i < nbTris; ++i)
+    {
+        const float *p[3] = {pos(s, idx[3 * i]), pos(s, idx[3 * i + 1]), pos(s, idx[3 * i + 2])};
+        float e0[3], e1[3], n[3], l;
+        sub(e0, p[1], p[0]);
+        sub(e1, p[2], p[0]);
+        cross(n, e0, e1);
+        if ((l = sqrtf(dot(n, n))) <= 0.0f)
+            continue;
+        n[0] /= l;
+        n[1] /= l;
+        n[2] /= l;
+        for (k = 0; k < 3; ++k)
+            addPlane(&s->quadrics[s->position[idx[3 * i + k]]], n, p[k], 1.0);
+        for (k = 0; k < 3; ++k)
+        {
+            uint32_t a = s->position[idx[3 * i + k]], b = s->position[idx[3 * i + (k + 1) % 3]];
+            float e[3], m[3], ml;
+            if (shared(s, idx, a, b, NULL) != 1)
+                continue;
+            sub(e, p[(k + 1) % 3], p[k]);
+            cross(m, e, n);
+            if ((ml = sqrtf(dot(m, m))) <= 0.0f)
+                continue;
+            m[0] /= ml;
+            m[1] /= ml;
+            m[2] /= ml;
+            addPlane(&s->quadrics[a], m, p[k], 1.0);
+            addPlane(&s->quadrics[b], m, p[k], 1.0);
+        }
+    }
+}
+
+static int byCost(const void *a, const void *b)
+{
+    const collapse_t *ca = a, *cb = b;
+    return ca->cost < cb->cost ? -1 : ca->cost > cb->cost;
+}
+
+/* a border position may only move along a border edge */
+static int movable(const simplifier_t *s, const uint32_t *idx, uint32_t from, uint32_t to)
+{
+    return !s->border[from] || (s->border[to] && shared(s, idx, from, to, NULL) == 1);
+}
+
+/* 1 if no triangle around from (not containing to) turns over when
+ * from moves onto to */
+static int keepsOrientation(const simplifier_t *s, const uint32_t *idx, uint32_t from, uint32_t to)
+{
+    uint32_t i, k;
+    for (i = s->offsets[from]; i < s->offsets[from + 1]; ++i)
+    {
+        const uint32_t *t = &idx[3 * s->triangles[i]];
+        const float *p[3], *q[3];
+        float e0[3], e1[3], n0[3], n1[3];
+        int hasTo = 0;
+        for (k = 0; k < 3; ++k)
+        {
+            uint32_t c = s->position[t[k]];
+            hasTo |= c == to;
+            p[k] = pos(s, c);
+            q[k] = c == from ? pos(s, to) : p[k];
+        }
+        if (hasTo)
+            continue;
+        sub(e0, p[1], p[0]);
+        sub(e1, p[2], p[0]);
+        cross(n0, e0, e1);
+        sub(e0, q[1], q[0]);
+        sub(e1, q[2], q[0]);
+        cross(n1, e0, e1);
+        if (dot(n0, n1) <= FLIP_COS * sqrtf(dot(n0, n0) * dot(n1, n1)))
+            return 0;
+    }
+    return 1;
+}
+
+/* for every live vertex at position from, the vertex at position to
+ * it shares a triangle with (its target); 0 if one has none */
+static int targets(simplifier_t *s, const uint32_t *idx, uint32_t from, uint32_t to)
+{
+    uint32_t w = from, i, k;
+    do
+    {
+        if (s->alive[w])
+        {
+            uint32_t target = UINT32_MAX;
+            for (i = s->offsets[from]; i < s->offsets[from + 1] && target == UINT32_MAX; ++i)
+            {
+                const uint32_t *t = &idx[3 * s->triangles[i]];
+                if (t[0] != w && t[1] != w && t[2] != w)
+                    continue;
+                for (k = 0; k < 3; ++k)
+                    if (s->position[t[k]] == to)
+                        target = t[k];
+            }
+            if (target == UINT32_MAX)
+                return 0;
+            s->remap[w] = target;
+        }
+        w = s->wedge[w];
+    } while (w != from);
+    return 1;
+}
+
+static void lockRing(simplifier_t *s, const uint32_t *idx, uint32_t p)
+{
+    uint32_t i, k;
+    for (i = s->offsets[p]; i < s->offsets[p + 1]; ++i)
+        for (k = 0; k < 3; ++k)
+            s->locked[s->position[idx[3 * s->triangles[i] + k]]] = 1;
+}
+
+static void freeSimplifier(simplifier_t *s)
+{
+    free(s->position);
+    free(s->wedge);
+    free(s->quadrics);
+    free(s->offsets);
+    free(s->triangles);
+    free(s->border);
+    free(s->locked);
+    free(s->alive);
+    free(s->remap);
+}
+
+/*!\brief simplifies the triangle list \a indices over \a nbVertices
+ * vertices of \a stride floats (position first) down to \a
+ * targetIndices indices, without collapsing an edge whose error
+ * (distance of the new vertex to the planes it replaces) exceeds \a
+ * maxError; writes the largest error accepted in \a error if not
+ * NULL.
+ *
+ * \return the number of indices written in \a out (room for \a
+ * nbIndices), \a nbIndices when nothing could be simplified.
+ */
+uint32_t simplifyMesh(uint32_t *out, const uint32_t *indices, uint32_t nbIndices, const float *vertices, int stride,
+                      uint32_t nbVertices, uint32_t targetIndices, float maxError, float *error)
+{
+    simplifier_t s;
+    collapse_t *candidates;
+    uint32_t nbTris = nbIndices / 3, target = targetIndices / 3, i, k, pass;
+    double limit = (double)maxError * maxError, worst = 0.0;
+    memset(&s, 0, sizeof s);
+    s.vertices = vertices;
+    s.stride = stride;
+    s.nbVertices = nbVertices;
+    memcpy(out, indices, 3 * nbTris * sizeof *out);
+    if (error)
+        *error = 0.0f;
+    s.position = malloc(nbVertices * sizeof *s.position);
+    s.wedge = malloc(nbVertices * sizeof *s.wedge);
+    s.quadrics = malloc(nbVertices * sizeof *s.quadrics);
+    s.offsets = malloc((nbVertices + 1) * sizeof *s.offsets);
+    s.triangles = malloc(3 * nbTris * sizeof *s.triangles);
+    s.border = malloc(nbVertices);
+    s.locked = malloc(nbVertices);
+    s.alive = malloc(nbVertices);
+    s.remap = malloc(nbVertices * sizeof *s.remap);
+    candidates = malloc(3 * nbTris * sizeof *candidates);
+    if (!s.position || !s.wedge || !s.quadrics || !s.offsets || !s.triangles || !s.border || !s.locked || !s.alive ||
+        !s.remap || !candidates || weld(&s) < 0)
+    {
+        freeSimplifier(&s);
+        free(candidates);
+        return 3 * nbTris;
+    }
+    adjacency(&s, out, nbTris);
+    quadrics(&s, out, nbTris);
+    for (pass = 0; pass < MAX_PASSES && nbTris > target; ++pass)
+    {
+        uint32_t nbCandidates = 0, removed = 0, collapsed = 0, n;
+        if (pass)
+            adjacency(&s, out, nbTris);
+        for (i = 0; i < nbVertices; ++i)
+            s.remap[i] = i;
+        memset(s.locked, 0, nbVertices);
+        for (i = 0; i < nbTris; ++i)
+            for (k = 0; k < 3; ++k)
+            {
+                uint32_t a = s.position[out[3 * i + k]], b = s.position[out[3 * i + (k + 1) % 3]];
+                double ab = evaluate(&s.quadrics[a], pos(&s, b)), ba = evaluate(&s.quadrics[b], pos(&s, a));
+                /* each edge once (the other triangle sees it reversed)
+                 * unless it is a border */
+                if (a > b && shared(&s, out, a, b, NULL) > 1)
+                    continue;
+                if (ab <= ba && ab <= limit && movable(&s, out, a, b))
+                    candidates[nbCandidates++] = (collapse_t){a, b, (float)ab};
+                else if (ba <= limit && movable(&s, out, b, a))
+                    candidates[nbCandidates++] = (collapse_t){b, a, (float)ba};
+                else if (ab <= limit && movable(&s, out, a, b))
+                    candidates[nbCandidates++] = (collapse_t){a, b, (float)ab};
+            }
+        qsort(candidates, nbCandidates, sizeof *candidates, byCost);
+        for (i = 0; i < nbCandidates && nbTris - removed > target; ++i)
+        {
+            collapse_t *c = &candidates[i];
+            uint32_t w;
+            if (s.locked[c->from] || s.locked[c->to] || !keepsOrientation(&s, out, c->from, c->to))
+                continue;
+            if (!targets(&s, out, c->from, c->to))
+            {
+                /* undoes the targets already set */
+                w = c->from;
+                do
+                {
+                    s.remap[w] = w;
+                    w = s.wedge[w];
+                } while (w != c->from);
+                continue;
+            }
+            removed += shared(&s, out, c->from, c->to, NULL);
+            for (k = 0; k < 10; ++k)
+                s.quadrics[c->to].q[k] += s.quadrics[c->from].q[k];
+            lockRing(&s, out, c->from);
+            lockRing(&s, out, c->to);
+            worst = c->cost > worst ? c->cost : worst;
+            ++collapsed;
+        }
+        if (!collapsed)
+            break;
+        /* remaps and drops the triangles that became degenerate */
+        for (i = 0, n = 0; i < nbTris; ++i)
+        {
+            uint32_t t[3] = {s.remap[out[3 * i]], s.remap[out[3 * i + 1]], s.remap[out[3 * i + 2]]};
+            if (s.position[t[0]] == s.position[t[1]] || s.position[t[1]] == s.position[t[2]] ||
+                s.position[t[2]] == s.position[t[0]])
+                continue;
+            memcpy(&out[3 * n++], t, sizeof t);
+        }
+        nbTris = n;
+    }
+    if (error)
+        *error = (float)sqrt(worst);
+    freeSimplifier(&s);
+    free(candidates);
+    return 3 * nbTris;
+}
+
+static float pointTriangle(const float p[3], const float a[3], const float b[3], const float c[3])
+{
+    /* closest point (Ericson, Real-Time Collision Detection 5.1.5) */
+    float ab[3], ac[3], ap[3], bp[3], cp[3], q[3], d1, d2, d3, d4, d5, d6, va, vb, vc, v, w, den;
+    int k;
+    sub(ab, b, a);
+    sub(ac, c, a);
+    sub(ap, p, a);
+    d1 = dot(ab, ap);
+    d2 = dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return sqrtf(dot(ap, ap));
+    sub(bp, p, b);
+    d3 = dot(ab, bp);
+    d4 = dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return sqrtf(dot(bp, bp));
+    vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    {
+        v = d1 / (d1 - d3);
+        for (k = 0; k < 3; ++k)
+            q[k] = a[k] + v * ab[k];
+        sub(q, p, q);
+        return sqrtf(dot(q, q));
+    }
+    sub(cp, p, c);
+    d5 = dot(ab, cp);
+    d6 = dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return sqrtf(dot(cp, cp));
+    vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    {
+        w = d2 / (d2 - d6);
+        for (k = 0; k < 3; ++k)
+            q[k] = a[k] + w * ac[k];
+        sub(q, p, q);
+        return sqrtf(dot(q, q));
+    }
+    va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+    {
+        w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        for (k = 0; k < 3; ++k)
+            q[k] = b[k] + w * (c[k] - b[k]);
+        sub(q, p, q);
+        return sqrtf(dot(q, q));
+    }
+    den = 1.0f / (va + vb + vc);
+    v = vb * den;
+    w = vc * den;
+    for (k = 0; k < 3; ++k)
+        q[k] = a[k] + ab[k] * v + ac[k] * w;
+    sub(q, p, q);
+    return sqrtf(dot(q, q));
+}
+
+/*!\brief largest distance from a vertex of \a indices to the surface
+ * \a simplified (brute force, for the checks). */
+float simplifyDeviation(const uint32_t *indices, uint32_t nbIndices, const uint32_t *simplified, uint32_t nbSimplified,
+                        const float *vertices, int stride)
+{
+    float worst = 0.0f;
+    uint32_t i, t;
+    for (i = 0; i < nbIndices; ++i)
+    {
+        const float *p = &vertices[(size_t)stride * indices[i]];
+        float best = INFINITY;
+        for (t = 0; t < nbSimplified && best > 0.0f; t += 3)
+        {
+            float d = pointTriangle(p, &vertices[(size_t)stride * simplified[t]], &vertices[(size_t)stride * simplified[t + 1]],
+                                    &vertices[(size_t)stride * simplified[t + 2]]);
+            best = d < best ? d : best;
+        }
+        worst = best > worst ? best : worst;
+    }
+    return worst;
+}
+
+/* edges of the surface used by one triangle only */
+static uint32_t openEdges(const uint32_t *indices, uint32_t nbIndices, const float *vertices, int stride)
+{
+    uint32_t i, j, k, l, open = 0;
+    for (i = 0; i < nbIndices; i += 3)
+        for (k = 0; k < 3; ++k)
+        {
+            const float *a = &vertices[(size_t)stride * indices[i + k]], *b = &vertices[(size_t)stride * indices[i + (k + 1) % 3]];
+            int n = 0;
+            for (j = 0; j < nbIndices; j += 3)
+                for (l = 0; l < 3; ++l)
+                    if (memcmp(&vertices[(size_t)stride * indices[j + l]], b, 3 * sizeof(float)) == 0 &&
+                        memcmp(&vertices[(size_t)stride * indices[j + (l + 1) % 3]], a, 3 * sizeof(float)) == 0)
+                        ++n;
+            open += n == 0;
+        }
+    return open;
+}
+
+static int checkMesh(const char *name, const uint32_t *indices, uint32_t nbIndices, const float *vertices, int stride,
+                     uint32_t nbVertices, float extent)
+{
+    static const float ratios[3] = {0.5f, 0.25f, 0.125f}, errors[3] = {0.005f, 0.015f, 0.04f};
+    uint32_t *out = malloc(nbIndices * sizeof *out), n, open0 = openEdges(indices, nbIndices, vertices, stride);
+    int l, fails = 0;
+    for (l = 0; l < 3; ++l)
+    {
+        double t0 = now_ms();
+        float e, dev;
+        uint32_t open;
+        n = simplifyMesh(out, indices, nbIndices, vertices, stride, nbVertices, (uint32_t)(nbIndices * ratios[l]),
+                         errors[l] * extent, &e);
+        t0 = now_ms() - t0;
+        dev = simplifyDeviation(indices, nbIndices, out, n, vertices, stride);
+        open = openEdges(out, n, vertices, stride);
+        fprintf(stderr, "simplify %s level %d: %u -> %u triangles (target %u) in %.1f ms, error %.4f (limit %.4f), "
+                        "deviation %.4f, %u open edges (%u before)\n",
+                name, l + 1, nbIndices / 3, n / 3, (uint32_t)(nbIndices * ratios[l]) / 3, t0, e, errors[l] * extent,
+                dev, open, open0);
+        /* the deviation of the surface stays within the error bound,
+         * and no hole opens along the seams */
+        fails += e > errors[l] * extent || dev > errors[l] * extent || open > open0 || n >= nbIndices;
+    }
+    free(out);
+    return fails;
+}
+
+/*!\brief simplifies a sphere split along uv seams (duplicated
+ * vertices) and a bumpy open grid at 1/2, 1/4 and 1/8 of their
+ * triangles with growing error bounds, and checks that the surface
+ * stays within each bound, that no seam opens and that the triangle
+ * count goes down. Headless.
+ *
+ * \return 0 when every check passes.
+ */
+int simplifyCheck(void)
+{
+    const int rings = 32, segments = 64, n = 48;
+    uint32_t nbVertices = (rings + 1) * (segments + 1), nbIndices = 6 * rings * segments, i, j, *indices, *q;
+    float *vertices;
+    rng_t rng;
+    int fails = 0;
+    rngSeed(&rng, 1);
+    /* sphere: the first and last column, and each pole ring, are
+     * distinct vertices at the same positions */
+    vertices = malloc(4 * nbVertices * sizeof *vertices);
+    q = indices = malloc(nbIndices * sizeof *indices);
+    for (j = 0; j <= (uint32_t)rings; ++j)
+        for (i = 0; i <= (uint32_t)segments; ++i)
+        {
+            float *v = &vertices[4 * (j * (segments + 1) + i)], th = 3.14159265f * j / rings,
+                  ph = 6.2831853f * (i % segments) / segments;
+            v[0] = j == 0 || j == (uint32_t)rings ? 0.0f : sinf(th) * cosf(ph);
+            v[1] = j == 0 ? 1.0f : j == (uint32_t)rings ? -1.0f : cosf(th);
+            v[2] = j == 0 || j == (uint32_t)rings ? 0.0f : sinf(th) * sinf(ph);
+            v[3] = (float)i / segments;
+        }
+    for (j = 0; j < (uint32_t)rings; ++j)
+        for (i = 0; i < (uint32_t)segments; ++i)
+        {
+            uint32_t a = j * (segments + 1) + i, b = a + 1, c = a + segments + 1, d = c + 1;
+            if (j)
+                *q++ = a, *q++ = b, *q++ = c;
+            if (j + 1 < (uint32_t)rings)
+                *q++ = b, *q++ = d, *q++ = c;
+        }
+    fails += checkMesh("sphere", indices, q - indices, vertices, 4, nbVertices, 2.0f);
+    free(vertices);
+    free(indices);
+    /* open grid with low bumps */
+    nbVertices = (n + 1) * (n + 1);
+    nbIndices = 6 * n * n;
+    vertices = malloc(4 * nbVertices * sizeof *vertices);
+    q = indices = malloc(nbIndices * sizeof *indices);
+    for (j = 0; j <= (uint32_t)n; ++j)
+        for (i = 0; i <= (uint32_t)n; ++i)
+        {
+            float *v = &vertices[4 * (j * (n + 1) + i)];
+            v[0] = (float)i / n;
+            v[1] = 0.05f * sinf(6.0f * i / n) * cosf(4.0f * j / n) + 0.001f * rngFloat(&rng);
+            v[2] = (float)j / n;
+            v[3] = 0.0f;
+        }
+    for (j = 0; j < (uint32_t)n; ++j)
+        for (i = 0; i < (uint32_t)n; ++i)
+        {
+            uint32_t a = j * (n + 1) + i, b = a + 1, c = a + n + 1, d = c + 1;
+            *q++ = a, *q++ = c, *q++ = b;
+            *q++ = b, *q++ = c, *q++ = d;
+        }
+    fails += checkMesh("grid", indices, nbIndices, vertices, 4, nbVertices, 1.0f);
+    free(vertices);
+    free(indices);
+    return fails != 0;
+}
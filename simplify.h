@@ -0,0 +1,37 @@
+/*!\file simplify.h
+ *
+ * \brief quadric error simplification of the imported meshes, for
+ * their levels of detail.
+ *
+ * simplifyMesh collapses edges onto one of their end vertices
+ * (Garland and Heckbert's quadric error metric, half-edge collapses),
+ * so a level is only a new index list over the vertices of the full
+ * mesh: all the levels of a mesh share its vertex range. Vertices
+ * duplicated for their normals or uv (same position) are collapsed
+ * together so the seams stay closed, and open borders may only slide
+ * along themselves.
+ */
+
+#ifndef _SIMPLIFY_H
+
+#define _SIMPLIFY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  extern uint32_t simplifyMesh(uint32_t *out, const uint32_t *indices, uint32_t nbIndices,
+                               const float *vertices, int stride, uint32_t nbVertices,
+                               uint32_t targetIndices, float maxError, float *error);
+  extern float    simplifyDeviation(const uint32_t *indices, uint32_t nbIndices,
+                                    const uint32_t *simplified, uint32_t nbSimplified,
+                                    const float *vertices, int stride);
+  extern int      simplifyCheck(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
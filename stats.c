@@ -0,0 +1,92 @@
+/*!\file stats.c
+ *
+ * \brief per-frame rendering counters (see stats.h).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+stats_t frameStats = {0, 0, 0, 0, 0, 0, 0};
+
+/*!\brief counters of the last closed frame */
+static stats_t _last = {0, 0, 0, 0, 0, 0, 0};
+/*!\brief sums since the last periodic report and since the start */
+static stats_t _window = {0, 0, 0, 0, 0, 0, 0}, _total = {0, 0, 0, 0, 0, 0, 0};
+static unsigned long _windowFrames = 0, _totalFrames = 0;
+static double _windowStart = -1.0;
+static int _enabled = 0;
+
+/*!\brief monotonic time in milliseconds, the clock of every timer of
+ * the program. */
+double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void add(stats_t *dst, const stats_t *src)
+{
+    dst->glCalls += src->glCalls;
+    dst->drawCalls += src->drawCalls;
+    dst->triangles += src->triangles;
+    dst->drawn += src->drawn;
+    dst->culled += src->culled;
+    dst->uploaded += src->uploaded;
+    dst->programs += src->programs;
+}
+
+/*!\brief enables (or disables) the once per second report on stderr. */
+void statsEnable(int enable)
+{
+    _enabled = enable;
+}
+
+/*!\brief closes the current frame: accumulates and resets its
+ * counters, and prints the per-frame averages every second when
+ * enabled. */
+void statsEndFrame(void)
+{
+    double t = now_ms();
+    add(&_window, &frameStats);
+    add(&_total, &frameStats);
+    ++_windowFrames;
+    ++_totalFrames;
+    _last = frameStats;
+    memset(&frameStats, 0, sizeof frameStats);
+    if (_windowStart < 0.0)
+        _windowStart = t;
+    if (t - _windowStart >= 1000.0)
+    {
+        if (_enabled)
+            fprintf(stderr, "frame: %.1f GL calls, %.1f draws, %.1f programs, %.0f triangles, %.1f drawn / %.1f culled, %.0f bytes uploaded (%.1f fps)\n",
+                    _window.glCalls / (double)_windowFrames, _window.drawCalls / (double)_windowFrames,
+                    _window.programs / (double)_windowFrames,
+                    _window.triangles / (double)_windowFrames, _window.drawn / (double)_windowFrames,
+                    _window.culled / (double)_windowFrames, _window.uploaded / (double)_windowFrames,
+                    1000.0 * _windowFrames / (t - _windowStart));
+        memset(&_window, 0, sizeof _window);
+        _windowFrames = 0;
+        _windowStart = t;
+    }
+}
+
+/*!\brief counters of the frame closed by the last statsEndFrame. */
+const stats_t *statsLastFrame(void)
+{
+    return &_last;
+}
+
+/*!\brief prints the per-frame averages since the start. */
+void statsReport(void)
+{
+    if (!_totalFrames)
+        return;
+    fprintf(stderr, "%lu frames: %.1f GL calls, %.1f draws, %.1f programs, %.0f triangles, %.1f drawn / %.1f culled, %.0f bytes uploaded per frame\n",
+            _totalFrames, _total.glCalls / (double)_totalFrames, _total.drawCalls / (double)_totalFrames,
+            _total.programs / (double)_totalFrames,
+            _total.triangles / (double)_totalFrames, _total.drawn / (double)_totalFrames,
+            _total.culled / (double)_totalFrames, _total.uploaded / (double)_totalFrames);
+}
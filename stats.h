@@ -0,0 +1,55 @@
+/*!\file stats.h
+ *
+ * \brief per-frame rendering counters (GL calls, draw calls,
+ * triangles, texture bytes uploaded) and their periodic report.
+ *
+ * Calls are counted where they are made, so that the calls a path
+ * skips are not counted: each GL call of the frame goes through
+ * STATS_CALL, each draw is followed by STATS_DRAW (a gl4dgDraw counts
+ * as the one draw call it makes) and each glUseProgram by
+ * STATS_PROGRAM. Not counted: the timer queries of prof.h and
+ * shadervar.h, and the calls creating GL objects (loading, streamed
+ * wall chunks, texture cache; texture bytes go to STATS_UPLOAD).
+ */
+
+#ifndef _STATS_H
+
+#define _STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct stats_t stats_t;
+  struct stats_t {
+    unsigned long glCalls, drawCalls, triangles;
+    /*!\brief items (wall chunks or walls, objects) that passed or
+     * failed the visibility tests */
+    unsigned long drawn, culled;
+    /*!\brief bytes sent to textures after the loading */
+    unsigned long uploaded;
+    /*!\brief program switches (glUseProgram) */
+    unsigned long programs;
+  };
+
+  /*!\brief counters of the frame being drawn */
+  extern stats_t frameStats;
+
+/*!\brief makes and counts the GL call \a call, whose value it keeps */
+#define STATS_CALL(call) (++frameStats.glCalls, call)
+#define STATS_DRAW(tris) (++frameStats.glCalls, ++frameStats.drawCalls, frameStats.triangles += (tris))
+#define STATS_CULL(d, c) (frameStats.drawn += (d), frameStats.culled += (c))
+#define STATS_UPLOAD(b)  (frameStats.uploaded += (b))
+#define STATS_PROGRAM()  (++frameStats.glCalls, ++frameStats.programs)
+
+  extern double now_ms(void);
+  extern void statsEnable(int enable);
+  extern void statsEndFrame(void);
+  extern const stats_t *statsLastFrame(void);
+  extern void statsReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
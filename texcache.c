@@ -0,0 +1,333 @@
+/*!\file texcache.c
+ *
+ * \brief process-wide cache of the image textures (see texcache.h).
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include "ktx.h"
+#include "stats.h"
+#include "texcache.h"
+
+enum
+{
+    TC_FREE = 0,
+    /*!\brief being decoded by the thread that requested it first */
+    TC_DECODING,
+    /*!\brief decoded (or its KTX version read), waiting for its upload */
+    TC_DECODED,
+    TC_UPLOADED,
+    /*!\brief the image could not be decoded: texture 0 */
+    TC_FAILED
+};
+
+typedef struct texEntry_t
+{
+    char *path;
+    int state, refs;
+    SDL_Surface *surface;
+    ktx_t *ktx;
+    GLuint tex;
+    /*!\brief decoding and upload times, bytes of the texture with its mips */
+    double decodeMs, uploadMs;
+    unsigned long vram;
+} texEntry_t;
+
+/* the table may grow while loader threads run: entries are accessed
+ * by index under _lock; _decoded is signalled when a decoding ends */
+static texEntry_t *_entries = NULL;
+static int _nbEntries = 0, _size = 0;
+static SDL_SpinLock _initLock = 0;
+static SDL_mutex *_lock = NULL;
+static SDL_cond *_decoded = NULL;
+static unsigned long _requests = 0, _decodes = 0, _uploads = 0, _vram = 0;
+static double _loadMs = 0.0;
+/*!\brief -1 until the first upload, then 1 if the context takes S3TC */
+static int _s3tc = -1;
+
+static void init_lock(void)
+{
+    SDL_AtomicLock(&_initLock);
+    if (!_lock)
+    {
+        _lock = SDL_CreateMutex();
+        _decoded = SDL_CreateCond();
+    }
+    SDL_AtomicUnlock(&_initLock);
+}
+
+/* the key: the resolved path when the file exists */
+static void canonical(const char *path, char *out, size_t size)
+{
+    char buf[PATH_MAX];
+    if (realpath(path, buf))
+        path = buf;
+    snprintf(out, size, "%s", path);
+}
+
+/* the KTX version of the image when it is not older, the image
+ * otherwise */
+static void decode(const char *path, SDL_Surface **s, ktx_t **k)
+{
+    char kpath[PATH_MAX];
+    ktxPath(path, kpath, sizeof kpath);
+    *s = NULL;
+    *k = NULL;
+    if (ktxFresh(path, kpath) && (*k = malloc(sizeof **k)) && ktxRead(*k, kpath) != 0)
+    {
+        fprintf(stderr, "Probleme de chargement de textures %s\n", kpath);
+        free(*k);
+        *k = NULL;
+    }
+    if (!*k)
+        *s = IMG_Load(path);
+}
+
+/*!\brief returns a handle on the texture of image \a path, decoding
+ * it if no one did before, and holds a reference on it. May be called
+ * from any thread.
+ *
+ * \return the handle, -1 if the image cannot be decoded.
+ */
+int texCacheRequest(const char *path)
+{
+    char key[PATH_MAX];
+    texEntry_t *e;
+    SDL_Surface *s;
+    ktx_t *k;
+    double t0;
+    int i, slot = -1;
+    canonical(path, key, sizeof key);
+    init_lock();
+    SDL_LockMutex(_lock);
+    ++_requests;
+    for (i = 0; i < _nbEntries; ++i)
+    {
+        e = &_entries[i];
+        if (e->state == TC_FREE)
+        {
+            if (slot < 0)
+                slot = i;
+        }
+        else if (e->state != TC_FAILED && strcmp(e->path, key) == 0)
+        {
+            /* decoded once: waits for the thread doing it if needed */
+            ++e->refs;
+            while (_entries[i].state == TC_DECODING)
+                SDL_CondWait(_decoded, _lock);
+            e = &_entries[i];
+            if (e->state == TC_FAILED)
+            {
+                if (!--e->refs)
+                {
+                    free(e->path);
+                    memset(e, 0, sizeof *e);
+                }
+                i = -1;
+            }
+            SDL_UnlockMutex(_lock);
+            return i;
+        }
+    }
+    if (slot < 0)
+    {
+        if (_nbEntries == _size)
+        {
+            _entries = realloc(_entries, (_size = _size ? 2 * _size : 16) * sizeof *_entries);
+            memset(&_entries[_nbEntries], 0, (_size - _nbEntries) * sizeof *_entries);
+        }
+        slot = _nbEntries++;
+    }
+    e = &_entries[slot];
+    e->path = strdup(key);
+    e->state = TC_DECODING;
+    e->refs = 1;
+    e->tex = 0;
+    e->surface = NULL;
+    e->ktx = NULL;
+    SDL_UnlockMutex(_lock);
+    /* decoded without the lock: other images go on meanwhile, and
+     * requests of this one only take a reference */
+    t0 = now_ms();
+    decode(path, &s, &k);
+    SDL_LockMutex(_lock);
+    e = &_entries[slot];
+    e->surface = s;
+    e->ktx = k;
+    e->decodeMs = now_ms() - t0;
+    e->state = s || k ? TC_DECODED : TC_FAILED;
+    _decodes += s || k;
+    SDL_CondBroadcast(_decoded);
+    if (!s && !k && !--e->refs)
+    {
+        free(e->path);
+        memset(e, 0, sizeof *e);
+    }
+    SDL_UnlockMutex(_lock);
+    return s || k ? slot : -1;
+}
+
+static int s3tc(void)
+{
+    GLint i, n = 0;
+    if (_s3tc < 0)
+    {
+        _s3tc = 0;
+        if (!getenv("KTX_SOFTWARE"))
+        {
+            glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+            for (i = 0; i < n && !_s3tc; ++i)
+                _s3tc = strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), "GL_EXT_texture_compression_s3tc") == 0;
+        }
+    }
+    return _s3tc;
+}
+
+/* every level of the chain, compressed if the context takes S3TC,
+ * decoded on the CPU otherwise */
+static const char *uploadKtx(texEntry_t *e)
+{
+    ktx_t *k = e->ktx;
+    unsigned char *rgba = NULL;
+    int l, cpu = !s3tc();
+    const char *kind = k->format == KTX_BC1 ? "ktx BC1" : "ktx BC3";
+    if (cpu)
+        rgba = malloc(4 * (size_t)k->w * k->h);
+    for (l = 0; l < k->nbLevels; ++l)
+    {
+        ktxLevel_t *lv = &k->levels[l];
+        if (rgba)
+        {
+            ktxDecodeLevel(k, l, rgba);
+            glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, lv->w, lv->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+            e->vram += 4 * lv->w * lv->h;
+        }
+        else
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, l, k->format, lv->w, lv->h, 0, lv->size, lv->data);
+            e->vram += lv->size;
+        }
+        STATS_UPLOAD(lv->size);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, k->nbLevels - 1);
+    free(rgba);
+    ktxFree(k);
+    free(k);
+    e->ktx = NULL;
+    return cpu ? "ktx decoded on the CPU" : kind;
+}
+
+static const char *uploadSurface(texEntry_t *e)
+{
+    SDL_Surface *t = e->surface;
+#ifdef __APPLE__
+    glTexImage2D(GL_TEXTURE_2D, 0, t->format->BytesPerPixel == 3 ? GL_RGB : GL_RGBA, t->w, t->h, 0,
+                 t->format->BytesPerPixel == 3 ? GL_BGR : GL_BGRA, GL_UNSIGNED_BYTE, t->pixels);
+#else
+    glTexImage2D(GL_TEXTURE_2D, 0, t->format->BytesPerPixel == 3 ? GL_RGB : GL_RGBA, t->w, t->h, 0,
+                 t->format->BytesPerPixel == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, t->pixels);
+#endif
+    glGenerateMipmap(GL_TEXTURE_2D);
+    STATS_UPLOAD(t->pitch * t->h);
+    /* drivers keep RGB in 4 bytes; the mips add a third */
+    e->vram = 4UL * t->w * t->h * 4 / 3;
+    SDL_FreeSurface(t);
+    e->surface = NULL;
+    return "image";
+}
+
+static void upload(texEntry_t *e)
+{
+    double t0 = now_ms();
+    const char *kind;
+    int w = e->ktx ? e->ktx->w : e->surface->w, h = e->ktx ? e->ktx->h : e->surface->h, levels = 1;
+    glGenTextures(1, &e->tex);
+    glBindTexture(GL_TEXTURE_2D, e->tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    if (e->ktx)
+    {
+        levels = e->ktx->nbLevels;
+        kind = uploadKtx(e);
+    }
+    else
+    {
+        for (levels = 0; (w | h) >> levels; ++levels)
+            ;
+        kind = uploadSurface(e);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    e->uploadMs = now_ms() - t0;
+    e->state = TC_UPLOADED;
+    ++_uploads;
+    _vram += e->vram;
+    _loadMs += e->decodeMs + e->uploadMs;
+    fprintf(stderr, "texcache: %s: %dx%d %s, %d levels, %lu KB, %.1f ms (%.1f decoding, %.1f upload)\n",
+            e->path, w, h, kind, levels, e->vram / 1024, e->decodeMs + e->uploadMs, e->decodeMs, e->uploadMs);
+}
+
+/*!\brief the GL texture of \a handle, uploaded on first call (waits
+ * if another thread is still decoding the image). GL thread only.
+ *
+ * \return the texture name, 0 for an invalid handle.
+ */
+GLuint texCacheTexture(int handle)
+{
+    texEntry_t *e;
+    GLuint tex;
+    if (handle < 0)
+        return 0;
+    SDL_LockMutex(_lock);
+    while (_entries[handle].state == TC_DECODING)
+        SDL_CondWait(_decoded, _lock);
+    e = &_entries[handle];
+    if (e->state == TC_DECODED)
+        upload(e);
+    tex = e->tex;
+    SDL_UnlockMutex(_lock);
+    return tex;
+}
+
+/*!\brief drops a reference on \a handle; the texture is deleted with
+ * the last one. GL thread only. */
+void texCacheRelease(int handle)
+{
+    texEntry_t *e;
+    if (handle < 0)
+        return;
+    SDL_LockMutex(_lock);
+    e = &_entries[handle];
+    if (!--e->refs)
+    {
+        if (e->tex)
+            glDeleteTextures(1, &e->tex);
+        if (e->surface)
+            SDL_FreeSurface(e->surface);
+        if (e->ktx)
+        {
+            ktxFree(e->ktx);
+            free(e->ktx);
+        }
+        _vram -= e->vram;
+        free(e->path);
+        memset(e, 0, sizeof *e);
+    }
+    SDL_UnlockMutex(_lock);
+}
+
+/*!\brief prints how many requests were served by how many decodings
+ * and uploads, the time they took and the memory of the textures
+ * still alive. */
+void texCacheReport(void)
+{
+    if (_requests)
+        fprintf(stderr, "texcache: %lu requests, %lu images decoded, %lu textures uploaded in %.1f ms, %lu KB still resident\n",
+                _requests, _decodes, _uploads, _loadMs, _vram / 1024);
+}
@@ -0,0 +1,38 @@
+/*!\file texcache.h
+ *
+ * \brief process-wide cache of the image textures, keyed by canonical
+ * path and reference counted.
+ *
+ * An image is decoded and uploaded once however many materials,
+ * models or callers use it. texCacheRequest may run on any thread
+ * (the Assimp loader threads decode there); it returns a handle and
+ * holds a reference. texCacheTexture, on the GL thread, creates the
+ * GL texture on first use. The texture is deleted when its last
+ * reference is released.
+ *
+ * When image + KTX_EXT exists and is not older than the image, its
+ * compressed mip chain is loaded instead (see ktx.h); images get
+ * their mips from glGenerateMipmap. Every upload prints its kind,
+ * size, memory and load time.
+ */
+
+#ifndef _TEXCACHE_H
+
+#define _TEXCACHE_H
+
+#include <GL4D/gl4du.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  extern int    texCacheRequest(const char *path);
+  extern GLuint texCacheTexture(int handle);
+  extern void   texCacheRelease(int handle);
+  extern void   texCacheReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,255 @@
+/*!\file visibility.c
+ *
+ * \brief CPU visibility pass over the labyrinth grid (see
+ * visibility.h).
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maze.h"
+#include "rng.h"
+#include "stats.h"
+#include "visibility.h"
+
+/* from makeLabyrinth.c */
+extern unsigned int *labyrinth(int w, int h, rng_t *rng);
+
+/*!\brief rays of the first sweep of the field of view */
+#define BASE_RAYS 64
+/*!\brief maximum subdivisions between two rays of the first sweep */
+#define MAX_DEPTH 16
+
+/* end of a ray: its last cell (the wall hit, or the last room before
+ * the distance limit or the border) and the distance travelled */
+typedef struct rayEnd_t
+{
+    int x, z;
+    float t;
+} rayEnd_t;
+
+/* grid traversal (Amanatides & Woo) from (x, z) along (dx, dz), unit
+ * length; calls mark on every cell crossed (if mark is not NULL) and
+ * stops on the first wall, on the border or after maxDist. If
+ * (tx, tz) is a cell, stops when reaching it and returns 1. */
+static int traverse(const maze_t *maze, float x, float z, float dx, float dz, float maxDist,
+                    int tx, int tz, visibility_t *mark, rayEnd_t *end)
+{
+    int ix = (int)floorf(x), iz = (int)floorf(z);
+    int sx = dx > 0.0f ? 1 : -1, sz = dz > 0.0f ? 1 : -1;
+    float ddx = dx != 0.0f ? fabsf(1.0f / dx) : INFINITY, ddz = dz != 0.0f ? fabsf(1.0f / dz) : INFINITY;
+    float mx = dx != 0.0f ? (dx > 0.0f ? ix + 1 - x : x - ix) * ddx : INFINITY;
+    float mz = dz != 0.0f ? (dz > 0.0f ? iz + 1 - z : z - iz) * ddz : INFINITY;
+    float t = 0.0f;
+    int side = maze->side;
+    for (;;)
+    {
+        int i = iz * side + ix;
+        if (mark && mark->stamp[i] != mark->frame)
+        {
+            mark->stamp[i] = mark->frame;
+            mark->cells[mark->nbCells++] = i;
+        }
+        if (ix == tx && iz == tz)
+            break;
+        if (mazeIsWall(maze, ix, iz) || t > maxDist)
+            break;
+        if (mx < mz)
+        {
+            if (ix + sx < 0 || ix + sx >= side)
+                break;
+            t = mx;
+            mx += ddx;
+            ix += sx;
+        }
+        else
+        {
+            if (iz + sz < 0 || iz + sz >= side)
+                break;
+            t = mz;
+            mz += ddz;
+            iz += sz;
+        }
+    }
+    if (end)
+    {
+        end->x = ix;
+        end->z = iz;
+        end->t = t;
+    }
+    return ix == tx && iz == tz;
+}
+
+typedef struct fan_t
+{
+    visibility_t *v;
+    float x, z, maxDist;
+} fan_t;
+
+static rayEnd_t cast(fan_t *f, float a)
+{
+    rayEnd_t e;
+    traverse(f->v->maze, f->x, f->z, cosf(a), sinf(a), f->maxDist, -1, -1, f->v, &e);
+    ++f->v->nbRays;
+    return e;
+}
+
+/* subdivides [a0, a1] until the two rays end in the same or in two
+ * edge-adjacent cells */
+static void fan(fan_t *f, float a0, rayEnd_t e0, float a1, rayEnd_t e1, int depth)
+{
+    float am;
+    rayEnd_t em;
+    if (abs(e0.x - e1.x) + abs(e0.z - e1.z) <= 1 || depth >= MAX_DEPTH)
+        return;
+    am = 0.5f * (a0 + a1);
+    em = cast(f, am);
+    fan(f, a0, e0, am, em, depth + 1);
+    fan(f, am, em, a1, e1, depth + 1);
+}
+
+/*!\brief allocates the visibility state of the labyrinth \a maze. */
+int visInit(visibility_t *v, const maze_t *maze)
+{
+    int side = maze->side;
+    memset(v, 0, sizeof *v);
+    v->maze = maze;
+    v->side = side;
+    v->stamp = calloc(side * side, sizeof *v->stamp);
+    v->cells = malloc(side * side * sizeof *v->cells);
+    if (!v->stamp || !v->cells)
+    {
+        visFree(v);
+        return -1;
+    }
+    return 0;
+}
+
+/*!\brief computes the cells that can be seen from (\a x, \a z)
+ * looking along (\a dirx, \a dirz) with a horizontal field of view of
+ * 2 \a halfFov radians, up to \a maxDist cells. */
+void visCompute(visibility_t *v, float x, float z, float dirx, float dirz, float halfFov, float maxDist)
+{
+    double t0 = now_ms();
+    fan_t f = {v, x, z, maxDist};
+    float a = atan2f(dirz, dirx), a0 = a - halfFov, step = 2.0f * halfFov / BASE_RAYS;
+    rayEnd_t prev, e;
+    int r;
+    /* a new frame invalidates all the stamps at once */
+    if (++v->frame == 0)
+    {
+        memset(v->stamp, 0, v->side * v->side * sizeof *v->stamp);
+        v->frame = 1;
+    }
+    v->nbCells = 0;
+    v->nbRays = 0;
+    if (x >= 0.0f && z >= 0.0f && x < v->side && z < v->side)
+    {
+        prev = cast(&f, a0);
+        for (r = 1; r <= BASE_RAYS; ++r)
+        {
+            e = cast(&f, a0 + r * step);
+            fan(&f, a0 + (r - 1) * step, prev, a0 + r * step, e, 0);
+            prev = e;
+        }
+    }
+    v->totalTime += now_ms() - t0;
+    ++v->passes;
+}
+
+/*!\brief reference for visCompute: a cell is visible if the segment
+ * from the camera to its centre or to one of its (slightly inset)
+ * corners is in the field of view and crosses no other wall. Fills \a
+ * visible (side x side) and returns the number of visible cells. */
+int visBruteForce(const maze_t *maze, float x, float z, float dirx, float dirz,
+                  float halfFov, float maxDist, unsigned char *visible)
+{
+    static const float samples[5][2] = {{0.5f, 0.5f}, {0.01f, 0.01f}, {0.99f, 0.01f}, {0.99f, 0.99f}, {0.01f, 0.99f}};
+    float cosFov = cosf(halfFov);
+    int side = maze->side, cx, cz, s, n = 0;
+    memset(visible, 0, side * side);
+    for (cz = 0; cz < side; ++cz)
+        for (cx = 0; cx < side; ++cx)
+            for (s = 0; s < 5; ++s)
+            {
+                float px = cx + samples[s][0] - x, pz = cz + samples[s][1] - z;
+                float d = sqrtf(px * px + pz * pz);
+                if (d > maxDist)
+                    continue;
+                if (d > 1e-6f && (px * dirx + pz * dirz) / d < cosFov)
+                    continue;
+                if (d <= 1e-6f || traverse(maze, x, z, px / d, pz / d, maxDist + 2.0f, cx, cz, NULL, NULL))
+                {
+                    visible[cz * side + cx] = 1;
+                    ++n;
+                    break;
+                }
+            }
+    return n;
+}
+
+/*!\brief compares visCompute with visBruteForce from \a samples
+ * random viewpoints of a random \a side x \a side labyrinth (fixed
+ * seed, thus deterministic) and reports the cells missed by
+ * visCompute and its mean time.
+ *
+ * \return 0 when visCompute never misses a visible cell.
+ */
+int visCheck(int side, int samples)
+{
+    const float halfFov = 0.6f, maxDist = (float)side;
+    visibility_t v;
+    unsigned char *ref = malloc(side * side);
+    unsigned int *lab;
+    maze_t maze;
+    rng_t rng;
+    unsigned long missed = 0, extra = 0, visible = 0;
+    int s;
+    memset(&maze, 0, sizeof maze);
+    rngSeed(&rng, 1);
+    lab = labyrinth(side, side, &rng);
+    if (!ref || !lab || mazeFromGrid(&maze, lab, side, 0) < 0 || visInit(&v, &maze) < 0)
+    {
+        free(ref);
+        free(lab);
+        mazeFree(&maze);
+        return 2;
+    }
+    free(lab);
+    for (s = 0; s < samples; ++s)
+    {
+        float x, z, a;
+        int i, n;
+        do
+        {
+            x = side * rngFloat(&rng);
+            z = side * rngFloat(&rng);
+        } while (mazeIsWall(&maze, (int)x, (int)z));
+        a = 6.2831853f * rngFloat(&rng);
+        visCompute(&v, x, z, cosf(a), sinf(a), halfFov, maxDist);
+        n = visBruteForce(&maze, x, z, cosf(a), sinf(a), halfFov, maxDist, ref);
+        visible += n;
+        for (i = 0; i < side * side; ++i)
+        {
+            if (ref[i] && !visIsVisible(&v, i))
+                ++missed;
+            else if (!ref[i] && visIsVisible(&v, i))
+                ++extra;
+        }
+    }
+    fprintf(stderr, "visibility %dx%d, %d viewpoints: %.1f visible cells, %lu missed, %lu extra, %.4f ms per pass\n",
+            side, side, samples, visible / (double)samples, missed, extra, v.totalTime / v.passes);
+    visFree(&v);
+    free(ref);
+    mazeFree(&maze);
+    return missed != 0;
+}
+
+/*!\brief releases the visibility state. */
+void visFree(visibility_t *v)
+{
+    free(v->stamp);
+    free(v->cells);
+    memset(v, 0, sizeof *v);
+}
@@ -0,0 +1,56 @@
+/*!\file visibility.h
+ *
+ * \brief CPU visibility pass over the labyrinth grid.
+ *
+ * Walls are full-height boxes and the camera stays below their top,
+ * so visibility is a 2D problem: rays are cast from the camera cell
+ * through the ROOM cells, inside the horizontal field of view, and
+ * stop on the first WALL cell. Adjacent rays whose hits are not
+ * neighbours are subdivided until they are, so corridors opening at a
+ * grazing angle are not missed between two rays.
+ *
+ * Coordinates are in cells: cell (x, z) covers [x, x + 1[ x [z, z +
+ * 1[, z growing with the row of the labyrinth.
+ */
+
+#ifndef _VISIBILITY_H
+
+#define _VISIBILITY_H
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct visibility_t visibility_t;
+  struct visibility_t {
+    const maze_t       *maze;
+    int                 side;
+    /*!\brief a cell i is visible when stamp[i] == frame */
+    unsigned int       *stamp;
+    unsigned int        frame;
+    /*!\brief the visible cells of the last pass, in no given order */
+    int                *cells;
+    int                 nbCells;
+    /*!\brief rays cast by the last pass, time spent in all the passes */
+    int                 nbRays;
+    double              totalTime;
+    unsigned long       passes;
+  };
+
+#define visIsVisible(v, i) ((v)->stamp[(i)] == (v)->frame)
+
+  extern int  visInit(visibility_t *v, const maze_t *maze);
+  extern void visCompute(visibility_t *v, float x, float z, float dirx, float dirz,
+                         float halfFov, float maxDist);
+  extern int  visBruteForce(const maze_t *maze, float x, float z, float dirx, float dirz,
+                            float halfFov, float maxDist, unsigned char *visible);
+  extern int  visCheck(int side, int samples);
+  extern void visFree(visibility_t *v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,366 @@
+/*!\file wallmesh.c
+ *
+ * \brief static mesh of the labyrinth walls (see wallmesh.h).
+ *
+ * Cell (x, z) of a labyrinth of side n covers, in world space,
+ * [-s + x c, -s + (x + 1) c] along x and [s - (z + 1) c, s - z c]
+ * along z, with s the plane scale and c = 2 s / n; walls stand on
+ * the floor from 0 to height. This is the box that genWalls in
+ * window.c gives to each WALL cell. The uvs repeat once per cell so
+ * that the wall texture keeps the scale it has on a single cube.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maze.h"
+#include "stats.h"
+#include "wallmesh.h"
+
+/*!\brief at most four side faces and one top face per cell */
+#define MAX_QUADS_PER_CELL 5
+
+typedef struct builder_t builder_t;
+struct builder_t
+{
+    const maze_t *maze;
+    int side;
+    GLfloat scale, cell, height;
+    GLfloat *vertices;
+    GLuint nbVertices;
+    GLuint *indices;
+    GLsizei nbIndices;
+};
+
+/* side faces: 0 faces +x, 1 faces -x, 2 faces +z (towards cell z - 1)
+ * and 3 faces -z (towards cell z + 1) */
+static const int _dx[4] = {1, -1, 0, 0}, _dz[4] = {0, 0, -1, 1};
+
+static int solid(const builder_t *b, int x, int z)
+{
+    if (x < 0 || z < 0 || x >= b->side || z >= b->side)
+        return 0;
+    return mazeIsWall(b->maze, x, z);
+}
+
+/* world coordinates of the cell boundaries */
+static GLfloat wx(const builder_t *b, int x)
+{
+    return -b->scale + x * b->cell;
+}
+
+static GLfloat wz(const builder_t *b, int z)
+{
+    return b->scale - z * b->cell;
+}
+
+/* appends the quad o, o + u, o + u + v, o + v (u x v along n) with uvs
+ * going from (0, 0) to (ur, vr) */
+static void quad(builder_t *b, const GLfloat o[3], const GLfloat u[3], const GLfloat v[3],
+                 const GLfloat n[3], GLfloat ur, GLfloat vr)
+{
+    static const GLfloat corners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    static const GLuint tris[6] = {0, 1, 2, 0, 2, 3};
+    int c, k;
+    for (c = 0; c < 4; ++c)
+    {
+        GLfloat *p = &b->vertices[8 * (b->nbVertices + c)];
+        for (k = 0; k < 3; ++k)
+        {
+            p[k] = o[k] + corners[c][0] * u[k] + corners[c][1] * v[k];
+            p[3 + k] = n[k];
+        }
+        p[6] = corners[c][0] * ur;
+        p[7] = corners[c][1] * vr;
+    }
+    for (k = 0; k < 6; ++k)
+        b->indices[b->nbIndices++] = b->nbVertices + tris[k];
+    b->nbVertices += 4;
+}
+
+/* a side face covering cells [a, e[ of line \a line in direction d */
+static void sideRun(builder_t *b, int d, int line, int a, int e)
+{
+    GLfloat len = (e - a) * b->cell;
+    GLfloat v[3] = {0, b->height, 0};
+    switch (d)
+    {
+    case 0:
+    {
+        GLfloat o[3] = {wx(b, line + 1), 0, wz(b, a)}, u[3] = {0, 0, -len}, n[3] = {1, 0, 0};
+        quad(b, o, u, v, n, e - a, 1);
+        break;
+    }
+    case 1:
+    {
+        GLfloat o[3] = {wx(b, line), 0, wz(b, e)}, u[3] = {0, 0, len}, n[3] = {-1, 0, 0};
+        quad(b, o, u, v, n, e - a, 1);
+        break;
+    }
+    case 2:
+    {
+        GLfloat o[3] = {wx(b, a), 0, wz(b, line)}, u[3] = {len, 0, 0}, n[3] = {0, 0, 1};
+        quad(b, o, u, v, n, e - a, 1);
+        break;
+    }
+    default:
+    {
+        GLfloat o[3] = {wx(b, e), 0, wz(b, line + 1)}, u[3] = {-len, 0, 0}, n[3] = {0, 0, -1};
+        quad(b, o, u, v, n, e - a, 1);
+        break;
+    }
+    }
+}
+
+/* fills the builder with the faces of cells [x0, x1[ x [z0, z1[;
+ * runs and rectangles never cross the chunk border */
+static void chunkFaces(builder_t *b, int x0, int z0, int x1, int z1, unsigned char *used)
+{
+    int d, line, r, x, z, w, h;
+    b->nbVertices = 0;
+    b->nbIndices = 0;
+    for (d = 0; d < 4; ++d)
+    {
+        int l0 = d < 2 ? x0 : z0, l1 = d < 2 ? x1 : z1;
+        int r0 = d < 2 ? z0 : x0, r1 = d < 2 ? z1 : x1;
+        for (line = l0; line < l1; ++line)
+        {
+            int start = -1;
+            for (r = r0; r <= r1; ++r)
+            {
+                int cx = d < 2 ? line : r, cz = d < 2 ? r : line;
+                int f = r < r1 && solid(b, cx, cz) && !solid(b, cx + _dx[d], cz + _dz[d]);
+                if (f && start < 0)
+                    start = r;
+                else if (!f && start >= 0)
+                {
+                    sideRun(b, d, line, start, r);
+                    start = -1;
+                }
+            }
+        }
+    }
+    /* top faces: grow each free wall cell along x, then along z */
+    memset(used, 0, (x1 - x0) * (z1 - z0));
+#define USED(x, z) used[((z) - z0) * (x1 - x0) + (x) - x0]
+    for (z = z0; z < z1; ++z)
+        for (x = x0; x < x1; ++x)
+        {
+            if (USED(x, z) || !solid(b, x, z))
+                continue;
+            for (w = 1; x + w < x1 && !USED(x + w, z) && solid(b, x + w, z); ++w)
+                ;
+            for (h = 1; z + h < z1; ++h)
+            {
+                for (r = 0; r < w && !USED(x + r, z + h) && solid(b, x + r, z + h); ++r)
+                    ;
+                if (r < w)
+                    break;
+            }
+            for (d = 0; d < h; ++d)
+                memset(&USED(x, z + d), 1, w);
+            {
+                GLfloat o[3] = {wx(b, x), b->height, wz(b, z)}, n[3] = {0, 1, 0};
+                GLfloat u[3] = {w * b->cell, 0, 0}, v[3] = {0, 0, -h * b->cell};
+                quad(b, o, u, v, n, w, h);
+            }
+        }
+#undef USED
+}
+
+/* sets the cells and the world-space box of chunk (x0, z0) */
+static void bounds(wallChunk_t *c, const builder_t *b, int x0, int z0, int x1, int z1, int chunkSide)
+{
+    c->x0 = x0;
+    c->z0 = z0;
+    c->side = chunkSide;
+    c->min[0] = wx(b, x0);
+    c->min[1] = 0.0f;
+    c->min[2] = wz(b, z1);
+    c->max[0] = wx(b, x1);
+    c->max[1] = b->height;
+    c->max[2] = wz(b, z0);
+}
+
+static void upload(wallChunk_t *c, const builder_t *b)
+{
+    glGenVertexArrays(1, &c->vao);
+    glGenBuffers(2, c->buffers);
+    glBindVertexArray(c->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, c->buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, 8 * b->nbVertices * sizeof(GLfloat), b->vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void *)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void *)(6 * sizeof(GLfloat)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, c->buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, b->nbIndices * sizeof(GLuint), b->indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    c->nbIndices = b->nbIndices;
+}
+
+/*!\brief builds the merged wall mesh of \a maze in chunks of \a
+ * chunkSide x \a chunkSide cells. Chunks without any wall are not
+ * kept.
+ *
+ * \return the number of chunks, -1 on allocation failure.
+ */
+int wallMeshBuild(wallMesh_t *wm, const maze_t *maze,
+                  GLfloat planeScale, GLfloat height, int chunkSide)
+{
+    builder_t b;
+    unsigned char *used;
+    int side = maze->side, per = (side + chunkSide - 1) / chunkSide, cx, cz, nbWalls;
+    memset(wm, 0, sizeof *wm);
+    memset(&b, 0, sizeof b);
+    b.maze = maze;
+    b.side = side;
+    b.scale = planeScale;
+    b.cell = 2.0f * planeScale / side;
+    b.height = height;
+    b.vertices = malloc(4 * MAX_QUADS_PER_CELL * chunkSide * chunkSide * 8 * sizeof *b.vertices);
+    b.indices = malloc(6 * MAX_QUADS_PER_CELL * chunkSide * chunkSide * sizeof *b.indices);
+    used = malloc(chunkSide * chunkSide);
+    wm->chunks = calloc(per * per, sizeof *wm->chunks);
+    if (!b.vertices || !b.indices || !used || !wm->chunks)
+    {
+        free(b.vertices);
+        free(b.indices);
+        free(used);
+        free(wm->chunks);
+        wm->chunks = NULL;
+        return -1;
+    }
+    wm->chunkSide = chunkSide;
+    nbWalls = mazeCountWalls(maze);
+    for (cz = 0; cz < per; ++cz)
+        for (cx = 0; cx < per; ++cx)
+        {
+            int x0 = cx * chunkSide, z0 = cz * chunkSide;
+            int x1 = x0 + chunkSide < side ? x0 + chunkSide : side;
+            int z1 = z0 + chunkSide < side ? z0 + chunkSide : side;
+            wallChunk_t *c = &wm->chunks[wm->nbChunks];
+            chunkFaces(&b, x0, z0, x1, z1, used);
+            if (!b.nbIndices)
+                continue;
+            upload(c, &b);
+            bounds(c, &b, x0, z0, x1, z1, chunkSide);
+            wm->triangles += b.nbIndices / 3;
+            ++wm->nbChunks;
+        }
+    wm->cubeTriangles = 12ul * nbWalls;
+    free(b.vertices);
+    free(b.indices);
+    free(used);
+    fprintf(stderr, "wallmesh: %d walls, %lu -> %lu triangles (%lu saved) in %d chunks of %dx%d cells\n",
+            nbWalls, wm->cubeTriangles, wm->triangles, wm->cubeTriangles - wm->triangles,
+            wm->nbChunks, chunkSide, chunkSide);
+    return wm->nbChunks;
+}
+
+/*!\brief meshes the chunk of cells starting at (\a x0, \a z0) on the
+ * CPU only: fills the bounds of \a chunk (without GL objects) and the
+ * vertices and indices of \a data, to be given to
+ * wallMeshUploadChunk. Does not touch GL, thus may run on any thread.
+ *
+ * \return the number of indices, -1 on allocation failure.
+ */
+int wallMeshBuildChunk(const maze_t *maze, GLfloat planeScale, GLfloat height, int x0, int z0,
+                       int chunkSide, wallChunk_t *chunk, wallChunkData_t *data)
+{
+    builder_t b;
+    unsigned char *used;
+    int side = maze->side;
+    int x1 = x0 + chunkSide < side ? x0 + chunkSide : side;
+    int z1 = z0 + chunkSide < side ? z0 + chunkSide : side;
+    memset(&b, 0, sizeof b);
+    memset(chunk, 0, sizeof *chunk);
+    memset(data, 0, sizeof *data);
+    b.maze = maze;
+    b.side = side;
+    b.scale = planeScale;
+    b.cell = 2.0f * planeScale / side;
+    b.height = height;
+    b.vertices = malloc(4 * MAX_QUADS_PER_CELL * chunkSide * chunkSide * 8 * sizeof *b.vertices);
+    b.indices = malloc(6 * MAX_QUADS_PER_CELL * chunkSide * chunkSide * sizeof *b.indices);
+    used = malloc(chunkSide * chunkSide);
+    if (!b.vertices || !b.indices || !used)
+    {
+        free(b.vertices);
+        free(b.indices);
+        free(used);
+        return -1;
+    }
+    chunkFaces(&b, x0, z0, x1, z1, used);
+    free(used);
+    bounds(chunk, &b, x0, z0, x1, z1, chunkSide);
+    if (!b.nbIndices)
+    {
+        free(b.vertices);
+        free(b.indices);
+        return 0;
+    }
+    /* shrinks the buffers to what the chunk needs */
+    data->vertices = realloc(b.vertices, 8 * b.nbVertices * sizeof *b.vertices);
+    data->indices = realloc(b.indices, b.nbIndices * sizeof *b.indices);
+    data->nbVertices = b.nbVertices;
+    data->nbIndices = b.nbIndices;
+    return b.nbIndices;
+}
+
+/*!\brief creates the GL objects of \a chunk from \a data (built by
+ * wallMeshBuildChunk) and releases \a data. */
+void wallMeshUploadChunk(wallChunk_t *chunk, wallChunkData_t *data)
+{
+    builder_t b;
+    memset(&b, 0, sizeof b);
+    if (data->nbIndices)
+    {
+        b.vertices = data->vertices;
+        b.nbVertices = data->nbVertices;
+        b.indices = data->indices;
+        b.nbIndices = data->nbIndices;
+        upload(chunk, &b);
+    }
+    wallMeshFreeChunkData(data);
+}
+
+/*!\brief releases the data of a chunk that will not be uploaded. */
+void wallMeshFreeChunkData(wallChunkData_t *data)
+{
+    free(data->vertices);
+    free(data->indices);
+    memset(data, 0, sizeof *data);
+}
+
+/*!\brief releases the GL objects of a chunk. */
+void wallMeshFreeChunk(wallChunk_t *chunk)
+{
+    if (chunk->vao)
+    {
+        glDeleteVertexArrays(1, &chunk->vao);
+        glDeleteBuffers(2, chunk->buffers);
+    }
+    memset(chunk, 0, sizeof *chunk);
+}
+
+/*!\brief draws a chunk with the current program, texture and
+ * matrices (the vertices are in world space). */
+void wallMeshDrawChunk(const wallChunk_t *chunk)
+{
+    STATS_CALL(glBindVertexArray(chunk->vao));
+    glDrawElements(GL_TRIANGLES, chunk->nbIndices, GL_UNSIGNED_INT, 0);
+}
+
+/*!\brief releases the GL objects and the chunk table. */
+void wallMeshFree(wallMesh_t *wm)
+{
+    int i;
+    for (i = 0; i < wm->nbChunks; ++i)
+        wallMeshFreeChunk(&wm->chunks[i]);
+    free(wm->chunks);
+    memset(wm, 0, sizeof *wm);
+}
@@ -0,0 +1,70 @@
+/*!\file wallmesh.h
+ *
+ * \brief static mesh of the labyrinth walls, built once after the
+ * labyrinth generation, or chunk by chunk around the camera (see
+ * wallstream.h).
+ *
+ * Neighbouring WALL cells are merged: faces shared by two walls and
+ * the bottom faces (lying on the floor) are dropped, the remaining
+ * side faces are merged into maximal runs and the top faces into
+ * greedy rectangles. The result is split into square chunks of cells,
+ * each with its own VAO and buffers (interleaved position, normal,
+ * uv as in assimp_mult.c, attributes 0 to 2).
+ */
+
+#ifndef _WALLMESH_H
+
+#define _WALLMESH_H
+
+#include <GL4D/gl4du.h>
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WALLMESH_CHUNK_SIDE 32
+
+  /*!\brief a chunk of cells [x0, x0 + side[ x [z0, z0 + side[ (clamped
+   * to the labyrinth) with its world-space bounding box */
+  typedef struct wallChunk_t wallChunk_t;
+  struct wallChunk_t {
+    GLuint  vao, buffers[2];
+    GLsizei nbIndices;
+    int     x0, z0, side;
+    GLfloat min[3], max[3];
+  };
+
+  /*!\brief CPU side of a chunk, between wallMeshBuildChunk and
+   * wallMeshUploadChunk (8 floats per vertex) */
+  typedef struct wallChunkData_t wallChunkData_t;
+  struct wallChunkData_t {
+    GLfloat *vertices;
+    GLuint   nbVertices;
+    GLuint  *indices;
+    GLsizei  nbIndices;
+  };
+
+  typedef struct wallMesh_t wallMesh_t;
+  struct wallMesh_t {
+    wallChunk_t  *chunks;
+    int           nbChunks, chunkSide;
+    /*!\brief triangles of the merged mesh and of one cube per wall */
+    unsigned long triangles, cubeTriangles;
+  };
+
+  extern int  wallMeshBuild(wallMesh_t *wm, const maze_t *maze,
+                            GLfloat planeScale, GLfloat height, int chunkSide);
+  extern int  wallMeshBuildChunk(const maze_t *maze, GLfloat planeScale, GLfloat height, int x0, int z0,
+                                 int chunkSide, wallChunk_t *chunk, wallChunkData_t *data);
+  extern void wallMeshUploadChunk(wallChunk_t *chunk, wallChunkData_t *data);
+  extern void wallMeshFreeChunkData(wallChunkData_t *data);
+  extern void wallMeshFreeChunk(wallChunk_t *chunk);
+  extern void wallMeshDrawChunk(const wallChunk_t *chunk);
+  extern void wallMeshFree(wallMesh_t *wm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,254 @@
+/*!\file wallstream.c
+ *
+ * \brief streaming of the wall mesh chunks around the camera (see
+ * wallstream.h).
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wallstream.h"
+
+static unsigned int hashChunk(int cx, int cz)
+{
+    return (unsigned int)cx * 73856093u ^ (unsigned int)cz * 19349663u;
+}
+
+static int lookup(const wallStream_t *ws, int cx, int cz)
+{
+    unsigned int h;
+    for (h = hashChunk(cx, cz) & ws->tableMask; ws->table[h] >= 0; h = (h + 1) & ws->tableMask)
+    {
+        const wsSlot_t *s = &ws->slots[ws->table[h]];
+        if (s->cx == cx && s->cz == cz)
+            return ws->table[h];
+    }
+    return -1;
+}
+
+static void insert(wallStream_t *ws, int slot)
+{
+    unsigned int h = hashChunk(ws->slots[slot].cx, ws->slots[slot].cz) & ws->tableMask;
+    while (ws->table[h] >= 0)
+        h = (h + 1) & ws->tableMask;
+    ws->table[h] = slot;
+}
+
+/* linear probing removal: the following entries of the cluster are
+ * shifted back so that no lookup stops on the hole */
+static void removeSlot(wallStream_t *ws, int slot)
+{
+    const wsSlot_t *s = &ws->slots[slot];
+    unsigned int h = hashChunk(s->cx, s->cz) & ws->tableMask, j, k;
+    while (ws->table[h] != slot)
+        h = (h + 1) & ws->tableMask;
+    ws->table[h] = -1;
+    for (j = (h + 1) & ws->tableMask; ws->table[j] >= 0; j = (j + 1) & ws->tableMask)
+    {
+        const wsSlot_t *o = &ws->slots[ws->table[j]];
+        k = hashChunk(o->cx, o->cz) & ws->tableMask;
+        /* the entry stays if its home k is cyclically in ]h, j] */
+        if (h <= j ? (h < k && k <= j) : (h < k || k <= j))
+            continue;
+        ws->table[h] = ws->table[j];
+        ws->table[j] = -1;
+        h = j;
+    }
+}
+
+static int worker(void *arg)
+{
+    wallStream_t *ws = arg;
+    SDL_LockMutex(ws->mutex);
+    for (;;)
+    {
+        wsSlot_t *s;
+        wallChunk_t chunk;
+        wallChunkData_t data;
+        while (!ws->quit && !ws->qCount)
+            SDL_CondWait(ws->cond, ws->mutex);
+        if (ws->quit)
+            break;
+        s = &ws->slots[ws->queue[ws->qHead]];
+        ws->qHead = (ws->qHead + 1) % ws->capacity;
+        --ws->qCount;
+        /* a queued slot is neither evicted nor moved: it can be read
+         * without the lock */
+        SDL_UnlockMutex(ws->mutex);
+        wallMeshBuildChunk(ws->maze, ws->planeScale, ws->height, s->cx * ws->chunkSide, s->cz * ws->chunkSide,
+                           ws->chunkSide, &chunk, &data);
+        SDL_LockMutex(ws->mutex);
+        s->chunk = chunk;
+        s->data = data;
+        s->state = WS_READY;
+        ++ws->meshed;
+    }
+    SDL_UnlockMutex(ws->mutex);
+    return 0;
+}
+
+/*!\brief starts streaming the walls of \a maze: chunks of \a chunkSide
+ * cells within \a radius chunks of the camera chunk are kept, \a
+ * capacity chunks at most (0: twice the chunks of the radius), meshed
+ * by \a threads workers (0: all the cores but one).
+ *
+ * \return 0 on success, -1 on allocation failure.
+ */
+int wallStreamInit(wallStream_t *ws, const maze_t *maze, GLfloat planeScale, GLfloat height,
+                   int chunkSide, int radius, int capacity, int threads)
+{
+    int i, tableSize = 1;
+    memset(ws, 0, sizeof *ws);
+    if (capacity <= 0)
+        capacity = 2 * (2 * radius + 1) * (2 * radius + 1);
+    if (threads <= 0)
+        threads = SDL_GetCPUCount() > 1 ? SDL_GetCPUCount() - 1 : 1;
+    while (tableSize < 2 * capacity)
+        tableSize <<= 1;
+    ws->maze = maze;
+    ws->planeScale = planeScale;
+    ws->height = height;
+    ws->chunkSide = chunkSide;
+    ws->per = (maze->side + chunkSide - 1) / chunkSide;
+    ws->radius = radius;
+    ws->capacity = capacity;
+    ws->uploadsPerFrame = 4;
+    ws->slots = calloc(capacity, sizeof *ws->slots);
+    ws->table = malloc(tableSize * sizeof *ws->table);
+    ws->tableMask = tableSize - 1;
+    ws->queue = malloc(capacity * sizeof *ws->queue);
+    ws->threads = calloc(threads, sizeof *ws->threads);
+    ws->mutex = SDL_CreateMutex();
+    ws->cond = SDL_CreateCond();
+    if (!ws->slots || !ws->table || !ws->queue || !ws->threads || !ws->mutex || !ws->cond)
+    {
+        wallStreamFree(ws);
+        return -1;
+    }
+    for (i = 0; i < tableSize; ++i)
+        ws->table[i] = -1;
+    for (ws->nbThreads = 0; ws->nbThreads < threads; ++ws->nbThreads)
+        if (!(ws->threads[ws->nbThreads] = SDL_CreateThread(worker, "wall_stream", ws)))
+            break;
+    return 0;
+}
+
+/* a slot for a new chunk: a free one, else the least recently used
+ * one out of the radius of (ccx, ccz) that no worker holds; -1 if
+ * none. Called with the lock held. */
+static int allocSlot(wallStream_t *ws, int ccx, int ccz)
+{
+    int i, lru = -1;
+    for (i = 0; i < ws->capacity; ++i)
+    {
+        const wsSlot_t *s = &ws->slots[i];
+        if (s->state == WS_FREE)
+            return i;
+        if (s->state == WS_QUEUED || (abs(s->cx - ccx) <= ws->radius && abs(s->cz - ccz) <= ws->radius))
+            continue;
+        if (lru < 0 || s->lastUsed < ws->slots[lru].lastUsed)
+            lru = i;
+    }
+    if (lru >= 0)
+    {
+        wsSlot_t *s = &ws->slots[lru];
+        removeSlot(ws, lru);
+        if (s->state == WS_READY)
+            wallMeshFreeChunkData(&s->data);
+        else
+            wallMeshFreeChunk(&s->chunk);
+        s->state = WS_FREE;
+        ++ws->evicted;
+    }
+    return lru;
+}
+
+/*!\brief called once per frame with the camera position (\a x, \a z)
+ * in cells: uploads up to uploadsPerFrame meshed chunks and requests
+ * the missing chunks of the radius, nearest first. */
+void wallStreamUpdate(wallStream_t *ws, float x, float z)
+{
+    int ready[16], nbReady = 0, queued = 0, i, r;
+    int ccx = (int)floorf(x / ws->chunkSide), ccz = (int)floorf(z / ws->chunkSide);
+    int budget = ws->uploadsPerFrame < 16 ? ws->uploadsPerFrame : 16;
+    ++ws->frame;
+    SDL_LockMutex(ws->mutex);
+    for (i = 0; i < ws->capacity && nbReady < budget; ++i)
+        if (ws->slots[i].state == WS_READY)
+            ready[nbReady++] = i;
+    SDL_UnlockMutex(ws->mutex);
+    /* workers never touch a ready slot: upload without the lock */
+    for (i = 0; i < nbReady; ++i)
+    {
+        wsSlot_t *s = &ws->slots[ready[i]];
+        wallMeshUploadChunk(&s->chunk, &s->data);
+        s->state = WS_RESIDENT;
+        ++ws->uploaded;
+    }
+    SDL_LockMutex(ws->mutex);
+    for (r = 0; r <= ws->radius; ++r)
+    {
+        int dx, dz;
+        for (dz = -r; dz <= r; ++dz)
+            for (dx = -r; dx <= r; dx += (dz == -r || dz == r) ? 1 : 2 * r)
+            {
+                int cx = ccx + dx, cz = ccz + dz, s;
+                if (cx < 0 || cz < 0 || cx >= ws->per || cz >= ws->per)
+                    continue;
+                if ((s = lookup(ws, cx, cz)) >= 0)
+                {
+                    ws->slots[s].lastUsed = ws->frame;
+                    continue;
+                }
+                if ((s = allocSlot(ws, ccx, ccz)) < 0)
+                    goto full;
+                ++ws->misses;
+                ws->slots[s].cx = cx;
+                ws->slots[s].cz = cz;
+                ws->slots[s].lastUsed = ws->frame;
+                ws->slots[s].state = WS_QUEUED;
+                insert(ws, s);
+                ws->queue[(ws->qHead + ws->qCount++) % ws->capacity] = s;
+                ++queued;
+            }
+    }
+full:
+    if (queued)
+        SDL_CondBroadcast(ws->cond);
+    SDL_UnlockMutex(ws->mutex);
+}
+
+/*!\brief stops the workers and releases every chunk. */
+void wallStreamFree(wallStream_t *ws)
+{
+    int i;
+    if (ws->mutex)
+    {
+        SDL_LockMutex(ws->mutex);
+        ws->quit = 1;
+        SDL_CondBroadcast(ws->cond);
+        SDL_UnlockMutex(ws->mutex);
+    }
+    for (i = 0; i < ws->nbThreads; ++i)
+        SDL_WaitThread(ws->threads[i], NULL);
+    for (i = 0; ws->slots && i < ws->capacity; ++i)
+    {
+        if (ws->slots[i].state == WS_READY)
+            wallMeshFreeChunkData(&ws->slots[i].data);
+        else if (ws->slots[i].state == WS_RESIDENT)
+            wallMeshFreeChunk(&ws->slots[i].chunk);
+    }
+    if (ws->frame)
+        fprintf(stderr, "wallstream: %lu frames, %lu chunks requested, %lu meshed, %lu uploaded, %lu evicted (radius %d, %d slots, %d threads)\n",
+                ws->frame, ws->misses, ws->meshed, ws->uploaded, ws->evicted, ws->radius, ws->capacity, ws->nbThreads);
+    if (ws->cond)
+        SDL_DestroyCond(ws->cond);
+    if (ws->mutex)
+        SDL_DestroyMutex(ws->mutex);
+    free(ws->slots);
+    free(ws->table);
+    free(ws->queue);
+    free(ws->threads);
+    memset(ws, 0, sizeof *ws);
+}
@@ -0,0 +1,74 @@
+/*!\file wallstream.h
+ *
+ * \brief streaming of the wall mesh chunks around the camera.
+ *
+ * Instead of meshing the whole labyrinth at load, the chunks (see
+ * wallmesh.h) within a radius of the camera chunk are meshed by
+ * background threads from the packed labyrinth, which may be mapped
+ * from a file, and uploaded by the main thread (the only one with a
+ * GL context), a few per frame. At most \a capacity chunks are kept:
+ * when a chunk is needed and no slot is free, the least recently used
+ * chunk out of the radius is evicted. The main thread only holds the
+ * queue lock to post requests and collect results, never while a
+ * chunk is meshed.
+ */
+
+#ifndef _WALLSTREAM_H
+
+#define _WALLSTREAM_H
+
+#include <SDL.h>
+#include "maze.h"
+#include "wallmesh.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  enum {
+    WS_FREE = 0,
+    /*!\brief waiting for or being meshed by a worker */
+    WS_QUEUED,
+    /*!\brief meshed, waiting for its upload */
+    WS_READY,
+    /*!\brief uploaded (chunk.vao is 0 if it holds no wall) */
+    WS_RESIDENT
+  };
+
+  typedef struct wsSlot_t wsSlot_t;
+  struct wsSlot_t {
+    int             state, cx, cz;
+    unsigned long   lastUsed;
+    wallChunk_t     chunk;
+    wallChunkData_t data;
+  };
+
+  typedef struct wallStream_t wallStream_t;
+  struct wallStream_t {
+    const maze_t  *maze;
+    GLfloat        planeScale, height;
+    int            chunkSide, per, radius, capacity, uploadsPerFrame;
+    wsSlot_t      *slots;
+    /*!\brief chunk -> slot, open addressing (-1: empty) */
+    int           *table, tableMask;
+    /*!\brief ring of the slots to mesh */
+    int           *queue, qHead, qCount;
+    int            nbThreads, quit;
+    SDL_Thread   **threads;
+    SDL_mutex     *mutex;
+    SDL_cond      *cond;
+    unsigned long  frame;
+    /*!\brief counters, reported by wallStreamFree */
+    unsigned long  misses, meshed, uploaded, evicted;
+  };
+
+  extern int  wallStreamInit(wallStream_t *ws, const maze_t *maze, GLfloat planeScale, GLfloat height,
+                             int chunkSide, int radius, int capacity, int threads);
+  extern void wallStreamUpdate(wallStream_t *ws, float x, float z);
+  extern void wallStreamFree(wallStream_t *ws);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
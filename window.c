@@ -6,6 +6,7 @@
  * \date March 05 2018
  */
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <GL4D/gl4dg.h>
 #include <GL4D/gl4dp.h>
@@ -13,6 +14,22 @@
 #include <SDL_image.h>
 #include <SDL_mixer.h>
 #include "assimp_mult.h"
+#include "bench.h"
+#include "dirtytex.h"
+#include "frustum.h"
+#include "ktx.h"
+#include "mat4.h"
+#include "maze.h"
+#include "meshopt.h"
+#include "prof.h"
+#include "rng.h"
+#include "shadervar.h"
+#include "simplify.h"
+#include "stats.h"
+#include "texcache.h"
+#include "visibility.h"
+#include "wallmesh.h"
+#include "wallstream.h"
 
 #define NEAR 5.0f
 
@@ -26,33 +43,112 @@ static void keyup(int keycode);
 static void pmotion(int x, int y);
 static void draw(void);
 static void genWalls(void);
-static void genObjects(int obj_number);
-static int randInt(int min, int max);
-static float randFloat(float min, float max);
+static void genGrid(void);
+static void genWallGeometry(void);
+static void genObjects(int obj_number, rng_t *rng);
+static void uploadMinimap(void);
+static int randInt(rng_t *rng, int min, int max);
+static float randFloat(rng_t *rng, float min, float max);
+static int benchRun(int argc, char **argv);
+static int toolBake(int argc, char **argv);
+static int toolBenchLab(int argc, char **argv);
+static int toolBenchRng(int argc, char **argv);
+static int toolVisCheck(int argc, char **argv);
+static int toolLodCheck(int argc, char **argv);
+static int toolMeshOptCheck(int argc, char **argv);
+static int toolKtx(int argc, char **argv);
+static int toolKtxCheck(int argc, char **argv);
 
 /* from makeLabyrinth.c */
-extern unsigned int *labyrinth(int w, int h);
+extern unsigned int *labyrinth(int w, int h, rng_t *rng);
+extern unsigned int *labyrinthParallel(int w, int h, unsigned long seed, int threads);
+extern int labyrinthBench(int maxSide);
 
 /*!\brief opened window width and height */
 static int _wW = 800, _wH = 600;
 /*!\brief mouse position (modified by pmotion function) */
 static int _xm = 400, _ym = 300;
-/*!\brief labyrinth to generate */
-static GLuint *_labyrinth = NULL;
-/*!\brief labyrinth side */
+/*!\brief the labyrinth, packed: one bit per cell and the objects */
+static maze_t _maze;
+/*!\brief labyrinth side (--side, or the side of the loaded maze) */
 static GLuint _lab_side = 15;
+/*!\brief file to map the labyrinth from (--maze) and file to save the
+ * generated one to (--save-maze) */
+static const char *_mazeFile = NULL, *_saveMazeFile = NULL;
+/*!\brief threads of the tiled labyrinth generator (0: sequential
+ * generator, -1: all the cores) */
+static int _labThreads = 0;
+/*!\brief seed of the labyrinth and of the objects placement (--seed,
+ * the time by default) and whether --seed gave it, 0 being a seed as
+ * valid as any other */
+static unsigned long _seed = 0;
+static int _seedGiven = 0;
+/*!\brief program binaries cache of the shader variants (off with
+ * --no-shader-cache) */
+static GLboolean _shaderCache = GL_TRUE;
+/*!\brief start of main and time it took to draw the first frame */
+static double _startTime = 0.0, _firstFrame = -1.0;
+/*!\brief frames of the headless benchmark (--bench; 0 opens the
+ * window) */
+static int _bench = 0;
+/*!\brief camera path (--bench-path, _benchDefaultPath otherwise) and
+ * JSON report (--bench-out, stdout otherwise) of the benchmark */
+static const char *_benchPathFile = NULL, *_benchOutFile = NULL;
+/*!\brief time step of idle, in seconds (0: the elapsed time) */
+static double _fixedDt = 0.0;
+/*!\brief trace file of the profiling zones (--trace; NULL: no
+ * profiling) and boolean to time the GL zones on the GPU too
+ * (--trace-gl) */
+static const char *_traceFile = NULL;
+static GLboolean _traceGL = GL_FALSE;
 /*!\brief Quad geometry Id  */
 static GLuint _plane = 0;
 /*!\brief Cube geometry Id  */
 static GLuint _cube = 0;
 /*!\brief Sphere geometry Id  */
 static GLuint _sphere = 0;
-/*!\brief GLSL program Id */
+/*!\brief instanced wall cube: VAO, vertex/index buffers, the
+ * per-instance (x, z, h, w) buffer and the per-frame buffer of the
+ * visible instances */
+static GLuint _wallVAO = 0, _wallBuffers[4] = {0};
+/*!\brief boolean to draw all walls with a single instanced call and
+ * each Assimp model once for all its collectibles (GL_FALSE falls back
+ * to one draw per wall and one assimpDrawScene per collectible) */
+static GLboolean _instancing = GL_TRUE;
+/*!\brief merged wall mesh, built once after genWalls */
+static wallMesh_t _wallMesh;
+/*!\brief radius, in chunks, of the walls streamed around the camera
+ * (--stream; 0 meshes the whole labyrinth at load into _wallMesh) */
+static int _streamRadius = 0;
+/*!\brief wall chunks streamed around the camera when _streamRadius */
+static wallStream_t _stream;
+/*!\brief boolean to draw the walls from the merged chunks (takes
+ * precedence over _instancing for the walls) */
+static GLboolean _mergedWalls = GL_TRUE;
+/*!\brief boolean to toggle the frustum culling of walls and objects */
+static GLboolean _culling = GL_TRUE;
+/*!\brief view frustum of the frame being drawn */
+static frustum_t _frustum;
+/*!\brief boolean to draw only the cells found by the visibility pass */
+static GLboolean _visibility = GL_TRUE;
+/*!\brief visibility pass over the labyrinth cells */
+static visibility_t _vis;
+/*!\brief per wall chunk: does it hold a cell of the visibility pass */
+static GLubyte *_chunkVisible = NULL;
+/*!\brief instances (x, z, h, w) of the visible walls, re-uploaded at
+ * each frame to _wallBuffers[3] */
+static GLfloat *_visInstances = NULL;
+/*!\brief horizontal half field of view of the visibility pass: the
+ * frustum is 1 wide at distance 1, plus a margin for the pitch */
+#define VIS_HALF_FOV 0.57f
+/*!\brief GLSL program Id: the shader variant in use */
 static GLuint _pId = 0;
 /*!\brief plane texture Id */
 static GLuint _planeTexId = 0;
 /*!\brief wall  floor and objects texture Id */
 static GLuint _matTexId[3] = {0};
+/*!\brief texture cache handles of _matTexId */
+static int _matTex[3] = {-1, -1, -1};
 /*!\brief compass texture Id */
 static GLuint _compassTexId = 0;
 /*!\brief plane scale factor */
@@ -93,45 +189,144 @@ struct cam_t
 /*!\brief the used camera */
 static cam_t _cam = {0, 0, 0};
 
-enum
-{
-    WALL = 0,
-    ROOM
-};
+/*!\brief per-instance attributes (x, z, h, w) of every WALL cell,
+ * filled by genWalls and sorted by grid cell by genGrid */
+static GLfloat *_wallInstances = NULL;
+static int _nbWalls = 0;
 
-typedef struct wall_t wall_t;
-struct wall_t
-{
-    int type;
-    float x;
-    float z;
-    float h;
-    float w;
-    int obj_idx;
-};
-static wall_t *_walls = NULL;
+/*!\brief side, in labyrinth cells, of a cell of the culling grid */
+#define GRID_CELLS 8
 
-typedef struct object_t object_t;
-struct object_t
+typedef struct gridCell_t gridCell_t;
+/*!\brief a cell of the culling grid: labyrinth cells [x0, x1[ x [z0,
+ * z1[, their world-space box and their walls in _wallInstances */
+struct gridCell_t
 {
-    float x;
-    float z;
+    int x0, z0, x1, z1;
+    GLfloat min[3], max[3];
+    int firstWall, nbWalls;
 };
-static object_t *_objects = NULL;
+static gridCell_t *_grid = NULL;
+static int _gridSide = 0;
+/*!\brief per grid cell frustum test result, updated at each frame */
+static GLubyte *_gridVisible = NULL;
+
+/*!\brief per-frame batches of collectible transforms (column-major
+ * 4x4), one batch per Assimp model and level of detail, for
+ * assimpDrawSceneInstanced */
+static GLfloat *_batches[2][ASSIMP_MAX_LODS];
+static int _batchSizes[2][ASSIMP_MAX_LODS];
+/*!\brief per-frame cells whose collectible is drawn by assimpDrawScene
+ * when not instancing */
+static int *_objectCells = NULL, _nbObjectCells = 0;
 static GLuint *_progresstex = NULL;
 static GLuint _progressTexId = 0;
+/*!\brief texels of the minimap and of the progress bar changed since
+ * the last frame, sent at the beginning of draw */
+static dirtyTex_t _minimapDirty, _progressDirty;
 static int count_objects = 0;
 
 static int complex_obj = 0;
 static int complex_obj2 = 0; 
+/*!\brief bounding boxes (min, max) of complex_obj and complex_obj2 as
+ * drawn by assimpDrawScene */
+static GLfloat _objBox[2][2][3];
+typedef struct tool_t tool_t;
+/*!\brief a mode given as first argument, run in place of the game and
+ * without opening any window, on the arguments that follow it */
+struct tool_t
+{
+    const char *name;
+    int (*run)(int argc, char **argv);
+};
+
+static const tool_t _tools[] = {
+    {"--bake", toolBake},
+    {"--bench-lab", toolBenchLab},
+    {"--bench-rng", toolBenchRng},
+    {"--vis-check", toolVisCheck},
+    {"--lod-check", toolLodCheck},
+    {"--meshopt-check", toolMeshOptCheck},
+    {"--ktx", toolKtx},
+    {"--ktx-check", toolKtxCheck},
+};
+
 /*!\brief creates the window, initializes OpenGL parameters,
  * initializes data and maps callback functions */
 int main(int argc, char **argv)
 {
-    srand(time(NULL));
+    _startTime = now_ms();
+    for (size_t t = 0; argc > 1 && t < sizeof _tools / sizeof *_tools; ++t)
+        if (strcmp(argv[1], _tools[t].name) == 0)
+            return _tools[t].run(argc - 2, argv + 2);
+    for (int i = 1; i < argc; ++i)
+        if (strcmp(argv[i], "--stats") == 0)
+            statsEnable(1);
+        else if (strcmp(argv[i], "--per-wall") == 0)
+            _instancing = _mergedWalls = GL_FALSE;
+        else if (strcmp(argv[i], "--no-merge") == 0)
+            _mergedWalls = GL_FALSE;
+        else if (strcmp(argv[i], "--no-cull") == 0)
+            _culling = GL_FALSE;
+        else if (strcmp(argv[i], "--no-vis") == 0)
+            _visibility = GL_FALSE;
+        else if (strcmp(argv[i], "--no-lod") == 0)
+            assimpSetLodThresholds(NULL, 0);
+        else if (strcmp(argv[i], "--lod") == 0 && i + 1 < argc)
+        {
+            /* "--lod 160,64,24": projected sizes, in pixels, below
+             * which the levels 1, 2 and 3 are drawn */
+            float pixels[ASSIMP_MAX_LODS - 1];
+            char *p = argv[++i];
+            int n = 0;
+            while (n < ASSIMP_MAX_LODS - 1 && *p)
+            {
+                pixels[n++] = strtof(p, &p);
+                p += *p == ',';
+            }
+            assimpSetLodThresholds(pixels, n);
+        }
+        else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+            _streamRadius = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--lab-threads") == 0 && i + 1 < argc)
+            _labThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            _seed = strtoul(argv[++i], NULL, 0);
+            _seedGiven = 1;
+        }
+        else if (strcmp(argv[i], "--side") == 0 && i + 1 < argc)
+            _lab_side = atoi(argv[++i]) | 1;
+        else if (strcmp(argv[i], "--maze") == 0 && i + 1 < argc)
+            _mazeFile = argv[++i];
+        else if (strcmp(argv[i], "--save-maze") == 0 && i + 1 < argc)
+            _saveMazeFile = argv[++i];
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &_wW, &_wH);
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+            _bench = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bench-path") == 0 && i + 1 < argc)
+            _benchPathFile = argv[++i];
+        else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc)
+            _benchOutFile = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            _traceFile = argv[++i];
+        else if (strcmp(argv[i], "--trace-gl") == 0)
+            _traceGL = GL_TRUE;
+        else if (strcmp(argv[i], "--no-shader-cache") == 0)
+            _shaderCache = GL_FALSE;
+    /* "--bench frames" renders offscreen, without any window nor
+     * sound, and reports the frame times */
+    if (_bench > 0)
+        return benchRun(argc, argv);
+    if (!_seedGiven)
+        _seed = time(NULL);
+    fprintf(stderr, "seed %lu\n", _seed);
     if (!gl4duwCreateWindow(argc, argv, "GL4Dummies", 10, 10,
                             _wW, _wH, GL4DW_RESIZABLE | GL4DW_SHOWN))
         return 1;
+    if (_traceFile)
+        profInit(_traceFile, _traceGL);
     initGL();
     initData();
     atexit(quit);
@@ -159,7 +354,23 @@ static void initGL(void)
     glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_TEXTURE_2D);
-    _pId = gl4duCreateProgram("<vs>shaders/basic.vs", "<fs>shaders/basic.fs", NULL);
+    {
+        /* the variants draw() uses, compiled now rather than at their
+         * first frame; their other uniforms never change */
+        static const unsigned int variants[] = {0, SV_INSTANCED, SV_BORDER, SV_COMPLEX, SV_COMPLEX | SV_TEXTURE,
+                                                SV_COMPLEX | SV_INSTANCED, SV_COMPLEX | SV_INSTANCED | SV_TEXTURE};
+        GLfloat lum[4] = {0.0, 0.0, 5.0, 1.0};
+        shaderVarInit("shaders/basic.vs", "shaders/basic.fs");
+        shaderVarCache(_shaderCache);
+        for (int v = 0; v < (int)(sizeof variants / sizeof *variants); ++v)
+        {
+            GLuint p = shaderVarUse(variants[v]);
+            glUniform1i(glGetUniformLocation(p, "tex"), 0);
+            glUniform1f(glGetUniformLocation(p, "texRepeat"), 1.0f);
+            glUniform4fv(glGetUniformLocation(p, "lumpos"), 1, lum);
+        }
+        _pId = shaderVarUse(0);
+    }
     gl4duGenMatrix(GL_FLOAT, "modelMatrix");
     gl4duGenMatrix(GL_FLOAT, "viewMatrix");
     gl4duGenMatrix(GL_FLOAT, "projectionMatrix");
@@ -195,24 +406,20 @@ static void initData(void)
 {
     /* a red-white texture used to draw a compass */
     GLuint northsouth[] = {(255 << 24) + 255, -1};
+    rng_t rng;
     /* generates a quad using GL4Dummies */
     _plane = gl4dgGenQuadf();
     /* generates a cube using GL4Dummies */
     _cube = gl4dgGenCubef();
     /* generates a sphere using GL4Dummies */
     _sphere = gl4dgGenSpheref(30, 30);
-    glGenTextures(3, _matTexId);
+    /* linear, repeated textures, shared with the models using the
+     * same images */
     for (int i = 0; i < 3; ++i)
     {
-        SDL_Surface *t = IMG_Load(_filenames[i]);
-        /* creation and parametrization of the plane texture */
-        glBindTexture(GL_TEXTURE_2D, _matTexId[i]);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, t->w, t->h, 0, GL_RGB, GL_UNSIGNED_BYTE, t->pixels);
-        SDL_FreeSurface(t);
+        if ((_matTex[i] = texCacheRequest(_filenames[i])) < 0)
+            fprintf(stderr, "Probleme de chargement de textures %s\n", _filenames[i]);
+        _matTexId[i] = texCacheTexture(_matTex[i]);
     }
 
     glGenTextures(1, &_planeTexId);
@@ -221,10 +428,53 @@ static void initData(void)
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    _labyrinth = labyrinth(_lab_side, _lab_side);
-    genWalls();
-    genObjects(_lab_side);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA, GL_UNSIGNED_BYTE, _labyrinth);
+    /* everything random at level load derives from _seed */
+    rngSeed(&rng, _seed);
+    if (_mazeFile)
+    {
+        /* mapped: only the pages read from now on are loaded */
+        if (mazeLoad(&_maze, _mazeFile) < 0)
+        {
+            fprintf(stderr, "Erreur lors du chargement du labyrinthe %s\n", _mazeFile);
+            exit(6);
+        }
+        _lab_side = _maze.side;
+    }
+    else
+    {
+        GLuint *lab = _labThreads ? labyrinthParallel(_lab_side, _lab_side, rngNext(&rng), _labThreads)
+                                  : labyrinth(_lab_side, _lab_side, &rng);
+        mazeFromGrid(&_maze, lab, _lab_side, _lab_side);
+        free(lab);
+        genObjects(_lab_side, &rng);
+    }
+    if (_saveMazeFile && mazeSave(&_maze, _saveMazeFile) < 0)
+        fprintf(stderr, "Erreur lors de l'enregistrement du labyrinthe %s\n", _saveMazeFile);
+    _progresstex = calloc(_maze.nbObjects, sizeof *_progresstex);
+    if (_streamRadius > 0)
+    {
+        /* the walls only exist as the streamed chunks: no instance
+         * per wall, no mesh of the whole labyrinth */
+        _mergedWalls = GL_TRUE;
+        wallStreamInit(&_stream, &_maze, _planeScale, 20.0f, WALLMESH_CHUNK_SIDE, _streamRadius, 0, 0);
+    }
+    else
+        genWalls();
+    genGrid();
+    genWallGeometry();
+    if (_streamRadius <= 0)
+        wallMeshBuild(&_wallMesh, &_maze, _planeScale, 20.0f, WALLMESH_CHUNK_SIDE);
+    {
+        int per = (_lab_side + WALLMESH_CHUNK_SIDE - 1) / WALLMESH_CHUNK_SIDE;
+        _chunkVisible = malloc(per * per * sizeof *_chunkVisible);
+    }
+    _visInstances = malloc(4 * _nbWalls * sizeof *_visInstances);
+    visInit(&_vis, &_maze);
+    for (int b = 0; b < 2; ++b)
+        for (int l = 0; l < ASSIMP_MAX_LODS; ++l)
+            _batches[b][l] = malloc(16 * _maze.nbObjects * sizeof *_batches[b][l]);
+    _objectCells = malloc((_maze.nbObjects ? _maze.nbObjects : 1) * sizeof *_objectCells);
+    uploadMinimap();
     /* creation and parametrization of the compass texture */
     glGenTextures(1, &_compassTexId);
     glBindTexture(GL_TEXTURE_2D, _compassTexId);
@@ -240,12 +490,23 @@ static void initData(void)
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, _lab_side, 0, GL_RGBA, GL_UNSIGNED_BYTE, _progresstex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, _maze.nbObjects, 0, GL_RGBA, GL_UNSIGNED_BYTE, _progresstex);
     glBindTexture(GL_TEXTURE_2D, 0);
+    dirtyTexInit(&_minimapDirty, _planeTexId, 256);
+    dirtyTexInit(&_progressDirty, _progressTexId, 16);
 
-    complex_obj = assimpInit("./soccer/soccerball.obj");
-    complex_obj2 = assimpInit("./fish/fishOBJ.obj");
-    glUniform1i(glGetUniformLocation(_pId, "complex_object"), 0);
+    {
+        /* both models are parsed and decoded in parallel, then uploaded here */
+        const char *models[] = {"./soccer/soccerball.obj", "./fish/fishOBJ.obj"};
+        int ids[2];
+        assimpInitAsync(models, 2, ids);
+        complex_obj = ids[0];
+        complex_obj2 = ids[1];
+        assimpGetBoundingBox(complex_obj, _objBox[0][0], _objBox[0][1]);
+        assimpGetBoundingBox(complex_obj2, _objBox[1][0], _objBox[1][1]);
+    }
+    if (_bench)
+        return;
     _mmusic = initAudio("./music.mp3");
     _eatSound = initAudio("./0433.mp3");
     Mix_PlayMusic(_mmusic, 1);
@@ -267,86 +528,263 @@ static void resize(int w, int h)
     gl4duFrustumf(-0.5, 0.5, -0.5 * _wH / _wW, 0.5 * _wH / _wW, 1.0, 2.0 * _planeScale + 1.0);
 }
 
-/*!\brief Generates walls from the labyrinth texture
+/*!\brief world-space centre (\a wx, \a wz) of cell (\a x, \a z);
+ * a cell is 2 _planeScale / _lab_side wide.
+ */
+static void cellCenter(int x, int z, GLfloat *wx, GLfloat *wz)
+{
+    GLfloat cs = 2.0f * _planeScale / _lab_side;
+    *wx = -_planeScale + (x + 0.5f) * cs;
+    *wz = _planeScale - (z + 0.5f) * cs;
+}
+
+/*!\brief Generates the wall instances from the labyrinth
  *
  */
 
 static void genWalls(void)
 {
-    float xr = 0, zr = 0;
-    float scale3D = (2.0f * _planeScale), size3D = _planeScale / (float)_lab_side;
-    int lab_size = _lab_side * _lab_side;
-    wall_t *w = malloc(lab_size * sizeof *w);
+    GLfloat size3D = _planeScale / (float)_lab_side;
+    GLfloat *inst;
+    _nbWalls = mazeCountWalls(&_maze);
+    inst = malloc(4 * _nbWalls * sizeof *inst);
+    _nbWalls = 0;
     for (int z = 0; z < _lab_side; ++z)
-    {
-        zr = (float)z;
-        zr /= (float)_lab_side;
-        zr *= scale3D;
-        zr -= _planeScale;
         for (int x = 0; x < _lab_side; ++x)
+            if (mazeIsWall(&_maze, x, z))
+            {
+                cellCenter(x, z, &inst[4 * _nbWalls + 0], &inst[4 * _nbWalls + 1]);
+                inst[4 * _nbWalls + 2] = size3D;
+                inst[4 * _nbWalls + 3] = size3D;
+                ++_nbWalls;
+            }
+    _wallInstances = inst;
+}
+
+/*!\brief Builds the culling grid over the labyrinth and sorts
+ * _wallInstances by grid cell (counting sort on the cell of each
+ * instance, without scanning the labyrinth again), so that the walls
+ * of consecutive visible grid cells are a single instance range.
+ */
+static void genGrid(void)
+{
+    GLfloat cs = 2.0f * _planeScale / _lab_side;
+    GLfloat *inst = _wallInstances ? malloc(4 * _nbWalls * sizeof *inst) : NULL;
+    int *cellOf = _wallInstances ? malloc(_nbWalls * sizeof *cellOf) : NULL, k = 0;
+    _gridSide = (_lab_side + GRID_CELLS - 1) / GRID_CELLS;
+    _grid = malloc(_gridSide * _gridSide * sizeof *_grid);
+    _gridVisible = malloc(_gridSide * _gridSide * sizeof *_gridVisible);
+    for (int gz = 0; gz < _gridSide; ++gz)
+        for (int gx = 0; gx < _gridSide; ++gx)
+        {
+            gridCell_t *gc = &_grid[gz * _gridSide + gx];
+            gc->x0 = gx * GRID_CELLS;
+            gc->z0 = gz * GRID_CELLS;
+            gc->x1 = gc->x0 + GRID_CELLS < _lab_side ? gc->x0 + GRID_CELLS : _lab_side;
+            gc->z1 = gc->z0 + GRID_CELLS < _lab_side ? gc->z0 + GRID_CELLS : _lab_side;
+            gc->min[0] = -_planeScale + gc->x0 * cs;
+            gc->min[1] = 0.0f;
+            gc->min[2] = _planeScale - gc->z1 * cs;
+            gc->max[0] = -_planeScale + gc->x1 * cs;
+            gc->max[1] = 20.0f;
+            gc->max[2] = _planeScale - gc->z0 * cs;
+            gc->nbWalls = 0;
+        }
+    if (!inst)
+    {
+        for (int g = 0; g < _gridSide * _gridSide; ++g)
+            _grid[g].firstWall = 0;
+        return;
+    }
+    /* the labyrinth cell of an instance back from its center (see
+     * cellCenter), then its grid cell */
+    for (int i = 0; i < _nbWalls; ++i)
+    {
+        int x = (int)((_wallInstances[4 * i + 0] + _planeScale) / cs);
+        int z = (int)((_planeScale - _wallInstances[4 * i + 1]) / cs);
+        cellOf[i] = (z / GRID_CELLS) * _gridSide + x / GRID_CELLS;
+        ++_grid[cellOf[i]].nbWalls;
+    }
+    for (int g = 0; g < _gridSide * _gridSide; ++g)
+    {
+        _grid[g].firstWall = k;
+        k += _grid[g].nbWalls;
+        _grid[g].nbWalls = 0;
+    }
+    /* stable: the walls of a grid cell stay in row-major order */
+    for (int i = 0; i < _nbWalls; ++i)
+    {
+        gridCell_t *gc = &_grid[cellOf[i]];
+        memcpy(&inst[4 * (gc->firstWall + gc->nbWalls++)], &_wallInstances[4 * i], 4 * sizeof *inst);
+    }
+    free(cellOf);
+    free(_wallInstances);
+    _wallInstances = inst;
+}
+
+/*!\brief returns 1 if the box [min, max] may be seen by the camera
+ * (always 1 when culling is off). */
+static int visible(const GLfloat min[3], const GLfloat max[3])
+{
+    return !_culling || frustumTestAABB(&_frustum, min, max);
+}
+
+/*!\brief frustum test of object \a o drawn with model \a model (0
+ * for complex_obj, 1 for complex_obj2) at T(x, 0.5, z) S(0.5). */
+static int objectVisible(const mzObject_t *o, int model)
+{
+    GLfloat min[3], max[3], pos[3] = {o->x, 0.5f, o->z};
+    for (int k = 0; k < 3; ++k)
+    {
+        min[k] = pos[k] + 0.5f * _objBox[model][0][k];
+        max[k] = pos[k] + 0.5f * _objBox[model][1][k];
+    }
+    return visible(min, max);
+}
+
+/*!\brief level of detail of object \a o: its models are 1 wide once
+ * normalized and drawn at scale 0.5, and one unit at distance 1 spans
+ * the width of the window (see resize). */
+static int objectLod(const mzObject_t *o)
+{
+    GLfloat dx = o->x - _cam.x, dy = 0.5f - 3.0f, dz = o->z - _cam.z;
+    return assimpLodLevel(_wW * 0.5f / sqrtf(dx * dx + dy * dy + dz * dz));
+}
+
+/*!\brief Creates the cube used to draw all the walls in one instanced
+ * call: same geometry as gl4dgGenCubef ([-1, 1]^3, one [0, 1] uv
+ * square per face) plus the per-instance (x, z, h, w) attribute
+ * (location 3) taken from _wallInstances.
+ */
+static void genWallGeometry(void)
+{
+    /* normal, u and v axes of each face, with u x v = normal (CCW) */
+    static const GLfloat faces[6][3][3] = {
+        {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}},
+        {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+        {{0, 1, 0}, {1, 0, 0}, {0, 0, -1}},
+        {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+        {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},
+        {{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}}};
+    static const GLfloat corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+    GLfloat data[24 * 8];
+    GLuint idx[36];
+    for (int f = 0; f < 6; ++f)
+    {
+        for (int c = 0; c < 4; ++c)
         {
-            xr = (float)x;
-            xr /= (float)_lab_side;
-            xr *= scale3D;
-            xr -= _planeScale;
-
-            w[z * _lab_side + x].type = ROOM;
-            w[z * _lab_side + x].x = xr + size3D;
-            w[z * _lab_side + x].z = -(zr + size3D);
-            w[z * _lab_side + x].h = size3D;
-            w[z * _lab_side + x].w = size3D;
-            w[z * _lab_side + x].obj_idx = -1;
-            if (_labyrinth[z * _lab_side + x] == -1)
+            GLfloat *v = &data[8 * (4 * f + c)];
+            for (int k = 0; k < 3; ++k)
             {
-                w[z * _lab_side + x].type = WALL;
+                v[k] = faces[f][0][k] + corners[c][0] * faces[f][1][k] + corners[c][1] * faces[f][2][k];
+                v[3 + k] = faces[f][0][k];
             }
+            v[6] = (corners[c][0] + 1.0f) / 2.0f;
+            v[7] = (corners[c][1] + 1.0f) / 2.0f;
         }
+        idx[6 * f + 0] = 4 * f + 0;
+        idx[6 * f + 1] = 4 * f + 1;
+        idx[6 * f + 2] = 4 * f + 2;
+        idx[6 * f + 3] = 4 * f + 0;
+        idx[6 * f + 4] = 4 * f + 2;
+        idx[6 * f + 5] = 4 * f + 3;
     }
-    _walls = w;
+    glGenVertexArrays(1, &_wallVAO);
+    glGenBuffers(4, _wallBuffers);
+    glBindVertexArray(_wallVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _wallBuffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof data, data, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void *)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (const void *)(6 * sizeof(GLfloat)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _wallBuffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof idx, idx, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, _wallBuffers[2]);
+    glBufferData(GL_ARRAY_BUFFER, 4 * _nbWalls * sizeof *_wallInstances, _wallInstances, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, _wallBuffers[3]);
+    glBufferData(GL_ARRAY_BUFFER, 4 * _nbWalls * sizeof *_wallInstances, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, _wallBuffers[2]);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+    glVertexAttribDivisor(3, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 /*!\brief Generates a random int objects bitween a min and max number. 
  */
 
-static int randInt(int min, int max)
+static int randInt(rng_t *rng, int min, int max)
 {
-    double r = max * (rand() / (RAND_MAX + 1.0));
-    return (int)r % (max - min) + min;
+    return min + (int)rngBelow(rng, max - min);
 }
 
 /*!\brief Generates a random objects bitween a min and max number. 
  */
 
-static float randFloat(float min, float max)
+static float randFloat(rng_t *rng, float min, float max)
 {
-    float gen = (float)(((float)rand() / (float)(RAND_MAX + 1.0)));
-    return (float)gen * (max - min) + min;
+    return rngFloat(rng) * (max - min) + min;
 }
 
-/*!\brief Generates objects in the labyrinth.
- *
+/*!\brief Generates objects in the labyrinth, at most one per room:
+ * fills the object table of _maze, kept sorted by cell.
  */
-static void genObjects(int obj_number)
+static void genObjects(int obj_number, rng_t *rng)
 {
     GLfloat size3D = _planeScale / (float)_lab_side;
-    int x = 0, z = 0, idx = 0;
-    object_t *obj = malloc(obj_number * sizeof *obj);
-    GLuint *tex = calloc(obj_number, sizeof *tex);
-    _progresstex = tex;
+    mzObject_t *obj = _maze.objects;
+    int idx = 0;
     while (idx < obj_number)
     {
-        do
+        int x, z, cell, lo = 0, hi = idx;
+        GLfloat cx, cz;
+        x = randInt(rng, 0, _lab_side);
+        z = randInt(rng, 0, _lab_side);
+        if (mazeIsWall(&_maze, x, z))
+            continue;
+        cell = z * _lab_side + x;
+        while (lo < hi)
         {
-            x = randInt(0, _lab_side);
-            z = randInt(0, _lab_side);
-        } while (_walls[z * _lab_side + x].type == WALL || _walls[z * _lab_side + x].obj_idx != -1);
-        obj[idx].x = randFloat(_walls[z * _lab_side + x].x - size3D / 2, _walls[z * _lab_side + x].x + size3D / 2);
-        obj[idx].z = randFloat(_walls[z * _lab_side + x].z - size3D / 2, _walls[z * _lab_side + x].z + size3D / 2);
-        ;
-        _walls[z * _lab_side + x].obj_idx = idx;
+            int mid = (lo + hi) / 2;
+            if (obj[mid].cell < (uint32_t)cell)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < idx && obj[lo].cell == (uint32_t)cell)
+            continue;
+        memmove(&obj[lo + 1], &obj[lo], (idx - lo) * sizeof *obj);
+        cellCenter(x, z, &cx, &cz);
+        obj[lo].cell = cell;
+        obj[lo].flags = 0;
+        obj[lo].x = randFloat(rng, cx - size3D / 2, cx + size3D / 2);
+        obj[lo].z = randFloat(rng, cz - size3D / 2, cz + size3D / 2);
         ++idx;
     }
-    _objects = obj;
+}
+
+/*!\brief rows of the minimap expanded at once by uploadMinimap */
+#define MINIMAP_BAND 64
+
+/*!\brief Uploads the minimap (bound texture) from the packed
+ * labyrinth, MINIMAP_BAND rows at a time: the side x side RGBA image
+ * never exists in memory.
+ */
+static void uploadMinimap(void)
+{
+    GLuint *band = malloc(MINIMAP_BAND * _lab_side * sizeof *band);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    for (int z = 0; z < _lab_side; z += MINIMAP_BAND)
+    {
+        int h = z + MINIMAP_BAND < _lab_side ? MINIMAP_BAND : _lab_side - z;
+        mazeExpand(&_maze, band, 0, z, _lab_side, h);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, z, _lab_side, h, GL_RGBA, GL_UNSIGNED_BYTE, band);
+    }
+    free(band);
 }
 
 static float distance(float x1, float y1, float x2, float y2)
@@ -362,24 +800,26 @@ static float distance(float x1, float y1, float x2, float y2)
 static void takeObject(void)
 {
     float fx, fz, d = 0.0;
+    PROF_BEGIN("takeObject");
     fx = _cam.x + _planeScale;
     fz = -_cam.z + _planeScale;
     fx /= (2.0f * _planeScale);
     fz /= (2.0f * _planeScale);
     fx = fx * _lab_side;
     fz = fz * _lab_side;
-    int idx = (int)fz * _lab_side + (int)fx;
-    if ((_walls[idx].type == ROOM) && (_walls[idx].obj_idx != -1))
+    int o = -1;
+    if (!mazeIsWall(&_maze, (int)fx, (int)fz) && (o = mazeObjectAt(&_maze, (int)fz * _lab_side + (int)fx)) >= 0)
     {
-        d = distance(_cam.x, _cam.z, _objects[_walls[idx].obj_idx].x, _objects[_walls[idx].obj_idx].z);
+        d = distance(_cam.x, _cam.z, _maze.objects[o].x, _maze.objects[o].z);
         if (d < 2.0f)
         {   
-            _walls[idx].obj_idx = -1;
-            glBindTexture(GL_TEXTURE_2D, _progressTexId);
-            _progresstex[count_objects++] = RGBA(5, 90, 90, 1);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, _lab_side, 0, GL_RGBA, GL_UNSIGNED_BYTE, _progresstex);
+            _maze.objects[o].flags |= MZ_TAKEN;
+            _progresstex[count_objects] = RGBA(5, 90, 90, 1);
+            dirtyTexSet(&_progressDirty, 0, count_objects, _progresstex[count_objects]);
+            ++count_objects;
         }
     }
+    PROF_END();
 }
 
 /*!\brief Detects collision 
@@ -388,18 +828,18 @@ static void takeObject(void)
 static int collision(float dx, float dz)
 {
     float fx, fz;
+    int wall;
+    PROF_BEGIN("collision");
     fx = _cam.x + dx + _planeScale;
     fz = -(_cam.z + dz) + _planeScale;
     fx /= (2.0f * _planeScale);
     fz /= (2.0f * _planeScale);
     fx = fx * _lab_side;
     fz = fz * _lab_side;
-    int idx = (int)fz * _lab_side + (int)fx;
-    if (_walls[idx].type == WALL)
-    {
-        return 1;
-    }
-    return 0;
+    /* the outside of the labyrinth is a wall too */
+    wall = mazeIsWall(&_maze, (int)fx, (int)fz);
+    PROF_END();
+    return wall;
 }
 
 /*!\brief Help to carry out your work. Tracking the position in the
@@ -409,6 +849,7 @@ static void updatePosition(void)
 {
     GLfloat xf, zf;
     static int xi = -1, zi = -1;
+    PROF_BEGIN("updatePosition");
     /* translate to lower-left */
     xf = _cam.x + _planeScale;
     zf = -_cam.z + _planeScale;
@@ -421,23 +862,15 @@ static void updatePosition(void)
     /* re-set previous position to black and the new one to red */
     if ((int)xf != xi || (int)zf != zi)
     {
-        if (xi >= 0 && xi < _lab_side && zi >= 0 && zi < _lab_side && _labyrinth[zi * _lab_side + xi] != -1)
-        {
-            _labyrinth[zi * _lab_side + xi] = 0;
-            glBindTexture(GL_TEXTURE_2D, _planeTexId);
-            /* try to use the glTexSubImage2D function instead of the glTexImage2D function */
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA, GL_UNSIGNED_BYTE, _labyrinth);
-        }
+        /* only the texels that change are sent, by draw */
+        if (!mazeIsWall(&_maze, xi, zi))
+            dirtyTexSet(&_minimapDirty, xi, zi, 0);
         xi = (int)xf;
         zi = (int)zf;
-        if (xi >= 0 && xi < _lab_side && zi >= 0 && zi < _lab_side && _labyrinth[zi * _lab_side + xi] != -1)
-        {
-            _labyrinth[zi * _lab_side + xi] = RGB(255, 0, 0);
-            glBindTexture(GL_TEXTURE_2D, _planeTexId);
-            /* try to use the glTexSubImage2D function instead of the glTexImage2D function */
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA, GL_UNSIGNED_BYTE, _labyrinth);
-        }
+        if (!mazeIsWall(&_maze, xi, zi))
+            dirtyTexSet(&_minimapDirty, xi, zi, RGB(255, 0, 0));
     }
+    PROF_END();
 }
 
 /*!\brief function called by GL4Dummies' loop at idle.
@@ -450,8 +883,14 @@ static void idle(void)
     double dt, dtheta = M_PI, step = 10.0, px, pz;
     static double t0 = 0, t;
     float fx, fz;
-    dt = ((t = gl4dGetElapsedTime()) - t0) / 1000.0;
-    t0 = t;
+    PROF_BEGIN("idle");
+    if (_fixedDt > 0.0)
+        dt = _fixedDt;
+    else
+    {
+        dt = ((t = gl4dGetElapsedTime()) - t0) / 1000.0;
+        t0 = t;
+    }
     px = (dt * step + NEAR) * sin(_cam.theta);
     pz = (dt * step + NEAR) * cos(_cam.theta);
     fx = (dt * step) * sin(_cam.theta);
@@ -487,6 +926,7 @@ static void idle(void)
         _cam.z += fz;
     }
     updatePosition();
+    PROF_END();
 }
 
 /*!\brief function called by GL4Dummies' loop at key-down (key
@@ -515,6 +955,27 @@ static void keydown(int keycode)
     case GL4DK_ESCAPE:
     case 'q':
         exit(0);
+        /* when 't' pressed, writes the profiling zones recorded so far (--trace) */
+    case 't':
+        profDump();
+        break;
+        /* when 'i' pressed, toggle between instanced and per-wall/per-object drawing */
+    case 'i':
+        _instancing = !_instancing;
+        break;
+        /* when 'v' pressed, toggle the visibility pass */
+    case 'v':
+        _visibility = !_visibility;
+        break;
+        /* when 'c' pressed, toggle the frustum culling */
+    case 'c':
+        _culling = !_culling;
+        break;
+        /* when 'g' pressed, toggle the merged (greedy-meshed) wall chunks */
+    case 'g':
+        if (_streamRadius <= 0)
+            _mergedWalls = !_mergedWalls;
+        break;
         /* when 'w' pressed, toggle between line and filled mode */
     case 'w':
         glGetIntegerv(GL_POLYGON_MODE, v);
@@ -538,6 +999,7 @@ static void keydown(int keycode)
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
         glGenerateMipmap(GL_TEXTURE_2D);
         glBindTexture(GL_TEXTURE_2D, 0);
+        _minimapDirty.mipmap = _mipmap;
         break;
     }
         /* when 'a' pressed, toggle on/off the anisotropic mode */
@@ -594,15 +1056,85 @@ static void pmotion(int x, int y)
     _ym = y;
 }
 
+/*!\brief walls and objects drawn by the current frame */
+static int _drawnWalls = 0, _drawnObjects = 0;
+
+/*!\brief draws what cell \a i holds: its wall when walls are drawn one
+ * by one, its object if it is in the frustum (queued in the batch of
+ * its model when instancing, in _objectCells otherwise).
+ */
+static void drawCell(int i)
+{
+    int o;
+    if (mazeIsWall(&_maze, i % _lab_side, i / _lab_side))
+    {
+        GLfloat x, z, size3D = _planeScale / (float)_lab_side;
+        if (_mergedWalls || _instancing)
+            return;
+        ++_drawnWalls;
+        cellCenter(i % _lab_side, i / _lab_side, &x, &z);
+        STATS_CALL(glBindTexture(GL_TEXTURE_2D, _matTexId[1]));
+        gl4duPushMatrix();
+        {
+            gl4duTranslatef(x, 10.0, z);
+            gl4duScalef(size3D, 10.0, size3D);
+            mat4SendMatrices(_pId, "modelMatrix");
+        }
+        gl4duPopMatrix();
+        gl4dgDraw(_cube);
+        STATS_DRAW(12);
+    }
+    else if ((o = mazeObjectAt(&_maze, i)) < 0 || !objectVisible(&_maze.objects[o], i % 2))
+        return;
+    else if (_instancing)
+    {
+        /* batched by model, drawn after the loop */
+        const mzObject_t *obj = &_maze.objects[o];
+        int b = i % 2, l = objectLod(obj);
+        GLfloat *m = &_batches[b][l][16 * _batchSizes[b][l]++];
+        memset(m, 0, 16 * sizeof *m);
+        m[0] = m[5] = m[10] = 0.5f;
+        m[12] = obj->x;
+        m[13] = 0.5f;
+        m[14] = obj->z;
+        m[15] = 1.0f;
+        ++_drawnObjects;
+    }
+    else
+    {
+        /* drawn after the loop, with the walls' variant no longer in use */
+        _objectCells[_nbObjectCells++] = i;
+        ++_drawnObjects;
+    }
+}
+
+/*!\brief draws a merged wall chunk if the visibility pass and the
+ * frustum keep it (\a per chunks per row of the labyrinth).
+ */
+static void drawWallChunk(const wallChunk_t *chunk, int per)
+{
+    if ((_visibility && !_chunkVisible[chunk->z0 / WALLMESH_CHUNK_SIDE * per + chunk->x0 / WALLMESH_CHUNK_SIDE]) ||
+        !visible(chunk->min, chunk->max))
+    {
+        STATS_CULL(0, 1);
+        return;
+    }
+    wallMeshDrawChunk(chunk);
+    STATS_DRAW(chunk->nbIndices / 3);
+    STATS_CULL(1, 0);
+}
+
 /*!\brief function called by GL4Dummies' loop at draw.*/
 static void draw(void)
 {
-    GLfloat lum[4] = {0.0, 0.0, 5.0, 1.0};
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    PROF_BEGIN("draw");
+    dirtyTexFlush(&_minimapDirty);
+    dirtyTexFlush(&_progressDirty);
+    STATS_CALL(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
     /* clears the OpenGL color buffer and depth buffer */
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    /* sets the current program shader to _pId */
-    glUseProgram(_pId);
+    STATS_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    /* the default variant for the floor, ceiling and walls */
+    _pId = shaderVarUse(0);
     gl4duBindMatrix("viewMatrix");
     /* loads the identity matrix in the current GL4Dummies matrix ("viewMatrix") */
     gl4duLoadIdentityf();
@@ -611,13 +1143,36 @@ static void draw(void)
     gl4duLookAtf(_cam.x, 3.0, _cam.z,
                  _cam.x - sin(_cam.theta), 3.0 - (_ym - (_wH >> 1)) / (GLfloat)_wH, _cam.z - cos(_cam.theta),
                  0.0, 1.0, 0.0);
+    PROF_BEGIN("culling");
+    {
+        /* world-space frustum, then the grid cells it may see */
+        const GLfloat *view = gl4duGetMatrixData();
+        gl4duBindMatrix("projectionMatrix");
+        frustumFromMatrices(&_frustum, gl4duGetMatrixData(), view);
+        for (int g = 0; g < _gridSide * _gridSide; ++g)
+            _gridVisible[g] = visible(_grid[g].min, _grid[g].max);
+    }
+    if (_visibility)
+    {
+        /* cells seen from the camera cell, in labyrinth coordinates
+         * (as in updatePosition) */
+        GLfloat cell = 2.0f * _planeScale / _lab_side;
+        int per = (_lab_side + WALLMESH_CHUNK_SIDE - 1) / WALLMESH_CHUNK_SIDE;
+        visCompute(&_vis, (_cam.x + _planeScale) / cell, (-_cam.z + _planeScale) / cell,
+                   -sin(_cam.theta), cos(_cam.theta), VIS_HALF_FOV, (2.0f * _planeScale + 1.0f) / cell);
+        memset(_chunkVisible, 0, per * per * sizeof *_chunkVisible);
+        for (int k = 0; k < _vis.nbCells; ++k)
+        {
+            int i = _vis.cells[k];
+            _chunkVisible[(i / _lab_side) / WALLMESH_CHUNK_SIDE * per + (i % _lab_side) / WALLMESH_CHUNK_SIDE] = 1;
+        }
+    }
+    PROF_END();
     gl4duBindMatrix("modelMatrix");
     /* loads the identity matrix in the current GL4Dummies matrix ("modelMatrix") */
     gl4duLoadIdentityf();
     /* sets the current texture stage to 0 */
-    glActiveTexture(GL_TEXTURE0);
-    /* tells the pId program that "tex" is set to stage 0 */
-    glUniform1i(glGetUniformLocation(_pId, "tex"), 0);
+    STATS_CALL(glActiveTexture(GL_TEXTURE0));
 
     /* pushs (saves) the current matrix (modelMatrix), scales, rotates,
    * sends matrices to pId and then pops (restore) the matrix */
@@ -625,64 +1180,171 @@ static void draw(void)
     {
         gl4duRotatef(-90, 1, 0, 0);
         gl4duScalef(_planeScale, _planeScale, 1);
-        gl4duSendMatrices();
+        mat4SendMatrices(_pId, "modelMatrix");
     }
     gl4duPopMatrix();
     /* culls the back faces */
-    glCullFace(GL_BACK);
+    STATS_CALL(glCullFace(GL_BACK));
     /* uses the checkboard texture */
-    glBindTexture(GL_TEXTURE_2D, _matTexId[0]);
-    /* sets in pId the uniform variable texRepeat to the plane scale */
-    glUniform1f(glGetUniformLocation(_pId, "texRepeat"), 1.0);
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, _matTexId[0]));
     /* draws the plane */
     gl4dgDraw(_plane);
-    glDisable(GL_CULL_FACE);
-    glBindTexture(GL_TEXTURE_2D, _matTexId[0]);
+    STATS_DRAW(2);
+    STATS_CALL(glDisable(GL_CULL_FACE));
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, _matTexId[0]));
     gl4duPushMatrix();
     {
         gl4duTranslatef(0.0, 9.0, 0.0);
         gl4duScalef(_planeScale, 10.0, _planeScale);
-        gl4duSendMatrices();
+        mat4SendMatrices(_pId, "modelMatrix");
     }
     gl4duPopMatrix();
     gl4dgDraw(_cube);
+    STATS_DRAW(12);
 
-    for (int i = 0; i < _lab_side * _lab_side; ++i)
+    PROF_BEGIN_GL("walls");
+    if (_mergedWalls)
     {
-        if ((_walls[i].type == WALL))
+        /* walls are in world space in the chunks: identity model matrix */
+        STATS_CALL(glBindTexture(GL_TEXTURE_2D, _matTexId[1]));
+        mat4SendMatrices(_pId, "modelMatrix");
+        int per = (_lab_side + WALLMESH_CHUNK_SIDE - 1) / WALLMESH_CHUNK_SIDE;
+        if (_streamRadius > 0)
         {
-            glBindTexture(GL_TEXTURE_2D, _matTexId[1]);
-            gl4duPushMatrix();
+            /* requests the chunks around the camera cell, draws the
+             * resident ones */
+            GLfloat cell = 2.0f * _planeScale / _lab_side;
+            wallStreamUpdate(&_stream, (_cam.x + _planeScale) / cell, (-_cam.z + _planeScale) / cell);
+            for (int k = 0; k < _stream.capacity; ++k)
+                if (_stream.slots[k].state == WS_RESIDENT && _stream.slots[k].chunk.vao)
+                    drawWallChunk(&_stream.slots[k].chunk, per);
+        }
+        else
+            for (int c = 0; c < _wallMesh.nbChunks; ++c)
+                drawWallChunk(&_wallMesh.chunks[c], per);
+        STATS_CALL(glBindVertexArray(0));
+    }
+    else if (_instancing && _visibility)
+    {
+        /* the visible walls are gathered in one instanced call */
+        GLfloat size3D = _planeScale / (float)_lab_side;
+        int drawn = 0;
+        for (int k = 0; k < _vis.nbCells; ++k)
+        {
+            int x = _vis.cells[k] % _lab_side, z = _vis.cells[k] / _lab_side;
+            if (!mazeIsWall(&_maze, x, z))
+                continue;
+            cellCenter(x, z, &_visInstances[4 * drawn + 0], &_visInstances[4 * drawn + 1]);
+            _visInstances[4 * drawn + 2] = size3D;
+            _visInstances[4 * drawn + 3] = size3D;
+            ++drawn;
+        }
+        STATS_CALL(glBindTexture(GL_TEXTURE_2D, _matTexId[1]));
+        _pId = shaderVarUse(SV_INSTANCED);
+        mat4SendMatrices(_pId, "modelMatrix");
+        STATS_CALL(glBindVertexArray(_wallVAO));
+        STATS_CALL(glBindBuffer(GL_ARRAY_BUFFER, _wallBuffers[3]));
+        STATS_CALL(glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * drawn * sizeof *_visInstances, _visInstances));
+        STATS_CALL(glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, drawn);
+        STATS_CALL(glBindBuffer(GL_ARRAY_BUFFER, _wallBuffers[2]));
+        STATS_CALL(glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+        STATS_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        STATS_CALL(glBindVertexArray(0));
+        _pId = shaderVarUse(0);
+        STATS_DRAW(12 * drawn);
+        STATS_CULL(drawn, _nbWalls - drawn);
+    }
+    else if (_instancing)
+    {
+        /* one instanced call per run of visible grid cells, the shader
+         * places each instance */
+        int n = _gridSide * _gridSide, drawn = 0;
+        STATS_CALL(glBindTexture(GL_TEXTURE_2D, _matTexId[1]));
+        _pId = shaderVarUse(SV_INSTANCED);
+        mat4SendMatrices(_pId, "modelMatrix");
+        STATS_CALL(glBindVertexArray(_wallVAO));
+        STATS_CALL(glBindBuffer(GL_ARRAY_BUFFER, _wallBuffers[2]));
+        for (int g = 0; g < n;)
+        {
+            int first = _grid[g].firstWall, count = 0;
+            if (!_gridVisible[g])
             {
-                gl4duTranslatef(_walls[i].x, 10.0, _walls[i].z);
-                gl4duScalef(_walls[i].h, 10.0, _walls[i].w);
-                gl4duSendMatrices();
+                ++g;
+                continue;
             }
-            gl4duPopMatrix();
-            gl4dgDraw(_cube);
+            while (g < n && _gridVisible[g])
+                count += _grid[g++].nbWalls;
+            if (!count)
+                continue;
+            /* no base instance before GL 4.2: offset the attribute instead */
+            STATS_CALL(glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (const void *)(first * 4 * sizeof(GLfloat))));
+            glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, count);
+            STATS_DRAW(12 * count);
+            drawn += count;
         }
-        else if (_walls[i].obj_idx != -1)
+        STATS_CALL(glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+        STATS_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        STATS_CALL(glBindVertexArray(0));
+        _pId = shaderVarUse(0);
+        STATS_CULL(drawn, _nbWalls - drawn);
+    }
+    PROF_END_GL();
+    /* per-wall draws, objects batched or drawn one by one */
+    PROF_BEGIN_GL("cells");
+    _drawnWalls = _drawnObjects = 0;
+    if (_visibility)
+        for (int k = 0; k < _vis.nbCells; ++k)
+            drawCell(_vis.cells[k]);
+    else
+        for (int g = 0; g < _gridSide * _gridSide; ++g)
         {
-            glBindTexture(GL_TEXTURE_2D, _matTexId[2]);
-            gl4duPushMatrix();
+            const gridCell_t *gc = &_grid[g];
+            if (!_gridVisible[g])
+                continue;
+            for (int z = gc->z0; z < gc->z1; ++z)
+                for (int x = gc->x0; x < gc->x1; ++x)
+                    drawCell(z * _lab_side + x);
+        }
+    if (!_mergedWalls && !_instancing)
+        STATS_CULL(_drawnWalls, _nbWalls - _drawnWalls);
+    STATS_CULL(_drawnObjects, _maze.nbObjects - count_objects - _drawnObjects);
+    PROF_END_GL();
+    PROF_BEGIN_GL("objects");
+    /* the Assimp meshes switch to their own variants */
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, _matTexId[2]));
+    if (_instancing)
+    {
+        /* one instanced draw per mesh for all the collectibles of a model */
+        for (int b = 0; b < 2; ++b)
+            for (int l = 0; l < ASSIMP_MAX_LODS; ++l)
             {
-                gl4duTranslatef(_objects[_walls[i].obj_idx].x, 0.5, _objects[_walls[i].obj_idx].z);
-                gl4duScalef(0.5, 0.5, 0.5);
-                glUniform4fv(glGetUniformLocation(_pId, "lumpos"), 1, lum);
-                glUniform1i(glGetUniformLocation(_pId, "complex_object"), 1);
-                if (i % 2 == 0){
-                    assimpDrawScene(complex_obj);
-                }else{
-                    assimpDrawScene(complex_obj2);
-                }    
-                    
-                glUniform1i(glGetUniformLocation(_pId, "complex_object"), 0);
-                gl4duSendMatrices();
+                if (!_batchSizes[b][l])
+                    continue;
+                assimpSetLod(l);
+                gl4duPushMatrix();
+                assimpDrawSceneInstanced(b == 0 ? complex_obj : complex_obj2, _batches[b][l], _batchSizes[b][l]);
+                gl4duPopMatrix();
+                _batchSizes[b][l] = 0;
             }
-            gl4duPopMatrix();
-
+    }
+    for (int k = 0; k < _nbObjectCells; ++k)
+    {
+        const mzObject_t *obj = &_maze.objects[mazeObjectAt(&_maze, _objectCells[k])];
+        gl4duPushMatrix();
+        {
+            gl4duTranslatef(obj->x, 0.5, obj->z);
+            gl4duScalef(0.5, 0.5, 0.5);
+            assimpSetLod(objectLod(obj));
+            assimpDrawScene(_objectCells[k] % 2 == 0 ? complex_obj : complex_obj2);
         }
+        gl4duPopMatrix();
     }
+    _nbObjectCells = 0;
+    /* back to the default variant for the HUD */
+    _pId = shaderVarUse(0);
+    PROF_END_GL();
+    PROF_BEGIN_GL("hud");
 
     /* the compass should be drawn in an orthographic projection, thus
    * we should bind the projection matrix; save it; load identity;
@@ -706,7 +1368,7 @@ static void draw(void)
             gl4duPushMatrix();
             {
                 gl4duLoadIdentityf();
-                gl4duSendMatrices();
+                mat4SendMatrices(_pId, "viewMatrix");
             }
             gl4duPopMatrix();
             gl4duBindMatrix("modelMatrix");
@@ -717,16 +1379,15 @@ static void draw(void)
     gl4duPopMatrix();
     gl4duBindMatrix("modelMatrix");
     /* disables cull facing and depth testing */
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
+    STATS_CALL(glDisable(GL_CULL_FACE));
+    STATS_CALL(glDisable(GL_DEPTH_TEST));
     /* uses the compass texture */
-    glBindTexture(GL_TEXTURE_2D, _compassTexId);
-    /* texture repeat only once */
-    glUniform1f(glGetUniformLocation(_pId, "texRepeat"), 1);
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, _compassTexId));
     /* draws the compass */
     gl4dgDraw(_plane);
+    STATS_DRAW(2);
 
-    glBindTexture(GL_TEXTURE_2D, _progressTexId);
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, _progressTexId));
 
     ///////////////////////////////////////////////////////////////////
     gl4duBindMatrix("projectionMatrix");
@@ -744,7 +1405,7 @@ static void draw(void)
             gl4duPushMatrix();
             {
                 gl4duLoadIdentityf();
-                gl4duSendMatrices();
+                mat4SendMatrices(_pId, "viewMatrix");
             }
             gl4duPopMatrix();
             gl4duBindMatrix("modelMatrix");
@@ -755,15 +1416,18 @@ static void draw(void)
     gl4duPopMatrix();
     gl4duBindMatrix("modelMatrix");
     /* disables cull facing and depth testing */
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
+    STATS_CALL(glDisable(GL_CULL_FACE));
+    STATS_CALL(glDisable(GL_DEPTH_TEST));
     /* uses the compass texture */
-    glBindTexture(GL_TEXTURE_2D, _progressTexId);
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, _progressTexId));
     /* draws the compass */
     gl4dgDraw(_plane);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    STATS_DRAW(2);
     ///////////////////////////////////////////////////////////////////
 
+    /* the map is the only user of the border variant */
+    _pId = shaderVarUse(SV_BORDER);
     gl4duBindMatrix("projectionMatrix");
     gl4duPushMatrix();
     {
@@ -780,7 +1444,7 @@ static void draw(void)
             gl4duPushMatrix();
             {
                 gl4duLoadIdentityf();
-                gl4duSendMatrices();
+                mat4SendMatrices(_pId, "viewMatrix");
             }
             gl4duPopMatrix();
             gl4duBindMatrix("modelMatrix");
@@ -791,32 +1455,68 @@ static void draw(void)
     gl4duPopMatrix();
     gl4duBindMatrix("modelMatrix");
     /* disables cull facing and depth testing */
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
+    STATS_CALL(glDisable(GL_CULL_FACE));
+    STATS_CALL(glDisable(GL_DEPTH_TEST));
     /* uses the labyrinth texture */
-    glBindTexture(GL_TEXTURE_2D, _planeTexId);
-    /* draws borders */
-    glUniform1i(glGetUniformLocation(_pId, "border"), 1);
-    /* draws the map */
+    STATS_CALL(glBindTexture(GL_TEXTURE_2D, _planeTexId));
+    /* draws the map, with its borders */
     gl4dgDraw(_plane);
-    /* do not draw borders */
-    glUniform1i(glGetUniformLocation(_pId, "border"), 0);
 
     /* enables cull facing and depth testing */
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    STATS_CALL(glEnable(GL_DEPTH_TEST));
+    STATS_CALL(glEnable(GL_CULL_FACE));
+    STATS_DRAW(2);
+    PROF_END_GL();
+    PROF_END();
+    statsEndFrame();
+    profFrame();
+    shaderVarFrame();
+    if (_firstFrame < 0.0)
+    {
+        /* time to first frame, rendering included */
+        glFinish();
+        _firstFrame = now_ms() - _startTime;
+        fprintf(stderr, "first frame after %.1f ms\n", _firstFrame);
+        shaderVarReport();
+    }
 }
 
 /*!\brief function called at exit. Frees used textures and clean-up
  * GL4Dummies.*/
 static void quit(void)
 {
-    if (_labyrinth)
-        free(_labyrinth);
-    if (_walls)
-        free(_walls);
-    if (_objects)
-        free(_objects);
+    mazeFree(&_maze);
+    if (_wallInstances)
+        free(_wallInstances);
+    for (int b = 0; b < 2; ++b)
+        for (int l = 0; l < ASSIMP_MAX_LODS; ++l)
+            if (_batches[b][l])
+                free(_batches[b][l]);
+    if (_objectCells)
+        free(_objectCells);
+    wallMeshFree(&_wallMesh);
+    wallStreamFree(&_stream);
+    if (_vis.passes)
+        fprintf(stderr, "visibility: %lu passes, %.4f ms per pass\n", _vis.passes, _vis.totalTime / _vis.passes);
+    visFree(&_vis);
+    if (_minimapDirty.flushes)
+        fprintf(stderr, "minimap: %lu flushes, %lu uploads, %lu bytes\n", _minimapDirty.flushes,
+                _minimapDirty.uploads, _minimapDirty.bytes);
+    dirtyTexFree(&_minimapDirty);
+    dirtyTexFree(&_progressDirty);
+    if (_chunkVisible)
+        free(_chunkVisible);
+    if (_visInstances)
+        free(_visInstances);
+    if (_grid)
+        free(_grid);
+    if (_gridVisible)
+        free(_gridVisible);
+    if (_wallVAO)
+    {
+        glDeleteVertexArrays(1, &_wallVAO);
+        glDeleteBuffers(4, _wallBuffers);
+    }
     if (_progresstex)
         free(_progresstex);
     if (_planeTexId)
@@ -826,5 +1526,182 @@ static void quit(void)
     if (complex_obj){
         assimpQuit();
     }
+    for (int i = 0; i < 3; ++i)
+        texCacheRelease(_matTex[i]);
+    texCacheReport();
+    statsReport();
+    profDump();
+    profFree();
+    shaderVarFree();
     gl4duClean(GL4DU_ALL);
 }
+
+/*!\brief camera path of --bench without --bench-path: a look around,
+ * then corridors with turns both ways, a circle, a step back and an
+ * other circle (idle turns by pi and walks 10 units per second) */
+static const char *_benchDefaultPath =
+    "120 l; 90 u; 30 r; 120 u; 60 l; 120 u; 120 ul; 45 r; 90 u; 60 d; 120 ur";
+/*!\brief labyrinth seed of --bench without --seed */
+#define BENCH_SEED 1
+/*!\brief frames drawn, camera still, before the measured ones */
+#define BENCH_WARMUP 10
+
+/*!\brief moves the camera to the ROOM cell nearest to the centre of
+ * the labyrinth (the centre itself may be a wall).
+ */
+static void centerCamera(void)
+{
+    int c = _lab_side / 2;
+    for (int r = 0; r <= c; ++r)
+        for (int z = c - r; z <= c + r; ++z)
+            for (int x = c - r; x <= c + r; x += (z == c - r || z == c + r) ? 1 : 2 * r)
+                if (!mazeIsWall(&_maze, x, z))
+                {
+                    cellCenter(x, z, &_cam.x, &_cam.z);
+                    return;
+                }
+}
+
+/*!\brief headless benchmark: loads the level in an offscreen context,
+ * replays the camera path through idle and draw with a fixed time
+ * step for _bench frames and writes the JSON report (see bench.h).
+ */
+static int benchRun(int argc, char **argv)
+{
+    benchPath_t path;
+    benchFrame_t *frames;
+    char config[1024];
+    FILE *out = stdout;
+    if (!_seedGiven)
+        _seed = BENCH_SEED;
+    if ((_benchPathFile ? benchPathLoad(&path, _benchPathFile) : benchPathParse(&path, _benchDefaultPath)) <= 0)
+        return 2;
+    if (benchContextInit(_wW, _wH) < 0)
+    {
+        benchPathFree(&path);
+        return 1;
+    }
+    fprintf(stderr, "seed %lu\n", _seed);
+    gl4duInit(argc, argv);
+    if (_traceFile)
+        profInit(_traceFile, _traceGL);
+    _fixedDt = 1.0 / 60.0;
+    initGL();
+    initData();
+    centerCamera();
+    frames = malloc(_bench * sizeof *frames);
+    for (int i = -BENCH_WARMUP; i < _bench; ++i)
+    {
+        unsigned int keys = i < 0 ? 0 : benchPathKeys(&path, i);
+        const stats_t *s;
+        double t0, t1;
+        _keys[KLEFT] = !!(keys & BENCH_LEFT);
+        _keys[KRIGHT] = !!(keys & BENCH_RIGHT);
+        _keys[KUP] = !!(keys & BENCH_UP);
+        _keys[KDOWN] = !!(keys & BENCH_DOWN);
+        /* the variants are measured after the warm-up, unless the GL
+         * zones of prof.h use the timer queries */
+        if (i == 0 && !_traceGL)
+            shaderVarTiming(1);
+        t0 = now_ms();
+        idle();
+        draw();
+        t1 = now_ms();
+        /* what the swap would wait for */
+        glFinish();
+        if (i < 0)
+            continue;
+        s = statsLastFrame();
+        frames[i].cpu = t1 - t0;
+        frames[i].total = now_ms() - t0;
+        frames[i].glCalls = s->glCalls;
+        frames[i].drawCalls = s->drawCalls;
+        frames[i].programs = s->programs;
+        frames[i].triangles = s->triangles;
+        frames[i].drawn = s->drawn;
+        frames[i].culled = s->culled;
+    }
+    snprintf(config, sizeof config,
+             "{\"seed\": %lu, \"side\": %u, \"width\": %d, \"height\": %d, \"frames\": %d, \"warmup\": %d, "
+             "\"dt\": %.6f, \"path\": \"%s\", \"instancing\": %d, \"merged_walls\": %d, \"culling\": %d, "
+             "\"visibility\": %d, \"stream\": %d, \"shader_cache\": %d, \"first_frame_ms\": %.3f, "
+             "\"renderer\": \"%s\", \"version\": \"%s\"}",
+             _seed, _lab_side, _wW, _wH, _bench, BENCH_WARMUP, _fixedDt,
+             _benchPathFile ? _benchPathFile : "default", _instancing, _mergedWalls, _culling, _visibility,
+             _streamRadius, _shaderCache, _firstFrame, (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION));
+    if (_benchOutFile && !(out = fopen(_benchOutFile, "w")))
+    {
+        fprintf(stderr, "Erreur lors de l'ouverture de %s\n", _benchOutFile);
+        out = stdout;
+    }
+    /* the measures of the last frame */
+    shaderVarFrame();
+    benchWriteJson(out, config, frames, _bench, "variants", shaderVarWriteJson);
+    if (out != stdout)
+        fclose(out);
+    free(frames);
+    benchPathFree(&path);
+    quit();
+    benchContextFree();
+    return 0;
+}
+
+/*!\brief "--bake model..." only (re)builds the binary caches of the
+ * given models */
+static int toolBake(int argc, char **argv)
+{
+    int r = 0;
+    for (int i = 0; i < argc; ++i)
+        r |= assimpBake(argv[i]);
+    return r;
+}
+
+/*!\brief "--bench-lab [maxSide]" times the labyrinth generators and
+ * checks that the mazes are perfect */
+static int toolBenchLab(int argc, char **argv)
+{
+    return labyrinthBench(argc > 0 ? atoi(argv[0]) : 10001);
+}
+
+/*!\brief "--bench-rng" compares the generator with rand() */
+static int toolBenchRng(int argc, char **argv)
+{
+    return rngBench();
+}
+
+/*!\brief "--vis-check [side]" compares the visibility pass with brute
+ * force ray casting on a fixed labyrinth */
+static int toolVisCheck(int argc, char **argv)
+{
+    return visCheck(argc > 0 ? atoi(argv[0]) : 1001, 50);
+}
+
+/*!\brief "--lod-check" simplifies test meshes and checks their error
+ * bounds */
+static int toolLodCheck(int argc, char **argv)
+{
+    return simplifyCheck();
+}
+
+/*!\brief "--meshopt-check" optimizes shuffled meshes and checks the
+ * simulated vertex cache */
+static int toolMeshOptCheck(int argc, char **argv)
+{
+    return meshOptCheck();
+}
+
+/*!\brief "--ktx image..." writes the block-compressed mip chains
+ * loaded by the texture cache in place of the images */
+static int toolKtx(int argc, char **argv)
+{
+    int r = 0;
+    for (int i = 0; i < argc; ++i)
+        r |= ktxConvert(argv[i]);
+    return r;
+}
+
+/*!\brief "--ktx-check" encodes and decodes a synthetic image */
+static int toolKtxCheck(int argc, char **argv)
+{
+    return ktxCheck();
+}